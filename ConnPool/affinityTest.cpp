@@ -0,0 +1,154 @@
+/*
+ * 长连接负载下各分派方式的吞吐与缓存缺失：每个连接同一时刻只有一个请求(keep-alive)，
+ * 请求完成后该连接立即发出下一个请求；每个请求读写所属连接的状态(与http_conn大小相当)。
+ *   ./affinityTest [threads] [requests] [conns]
+ * 缓存缺失用perf_event_open统计整个进程(包括工作线程)的L1D读缺失和末级缓存缺失，
+ * 通用事件中没有L2，需要L2时用perf stat -e配合CPU特定的事件运行本程序；没有权限时显示n/a。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <atomic>
+#include "threadpool.hpp"
+
+static const int STATE_SIZE = 4096; //http_conn的读写缓冲区、文件名等约3KB，再加上其他字段
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static std::atomic<int> g_done(0);
+
+/* 满足threadpool<T>接口的模拟连接，actor_model为0时只调用process() */
+struct fake_conn
+{
+    int m_state;
+    uint64_t m_enqueue_ns;
+    uint64_t m_deadline_ns;
+    int improv;
+    int timer_flag;
+    MYSQL *mysql;
+
+    std::atomic<int> busy; //是否有请求在处理中
+    unsigned sum;
+    char state[STATE_SIZE];
+
+    bool read_once() { return true; }
+    bool write() { return true; }
+    void drop() {}
+    void process()
+    {
+        /* 解析请求读一遍连接状态，生成响应再写一遍 */
+        unsigned s = sum;
+        for (int i = 0; i < STATE_SIZE; i += 8)
+            s = s * 31 + state[i];
+        for (int i = 0; i < STATE_SIZE; i += 64)
+            state[i] = (char)(s + i);
+        sum = s;
+        g_done++;
+        busy.store(0, std::memory_order_release);
+    }
+};
+
+/* 统计整个进程的一个硬件事件，inherit使之后创建的线程也计入 */
+static int open_counter(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void print_counter(const char *name, int fd, int requests)
+{
+    uint64_t value;
+    if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value))
+        printf(" %s=n/a", name);
+    else
+        printf(" %s=%.1f/req", name, (double)value / requests);
+}
+
+static void run(int mode, int threads, int requests, int nconn)
+{
+    /* 计数器在线程池创建前打开，工作线程继承它 */
+    int l1d = open_counter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    int llc = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+
+    fake_conn *conns = new fake_conn[nconn];
+    for (int i = 0; i < nconn; ++i)
+    {
+        conns[i].mysql = NULL;
+        conns[i].m_deadline_ns = 0;
+        conns[i].busy = 0;
+        conns[i].sum = i;
+        memset(conns[i].state, i, STATE_SIZE);
+    }
+    threadpool<fake_conn> *pool = new threadpool<fake_conn>(0, NULL, threads, 10000, mode);
+    g_done = 0;
+
+    if (l1d >= 0)
+        ioctl(l1d, PERF_EVENT_IOC_ENABLE, 0);
+    if (llc >= 0)
+        ioctl(llc, PERF_EVENT_IOC_ENABLE, 0);
+    uint64_t begin = now_ns();
+    int sent = 0;
+    while (sent < requests)
+    {
+        for (int i = 0; i < nconn && sent < requests; ++i)
+        {
+            if (conns[i].busy.load(std::memory_order_acquire))
+                continue;
+            conns[i].busy = 1;
+            if (pool->append_p(&conns[i]))
+                ++sent;
+            else
+                conns[i].busy = 0;
+        }
+    }
+    while (g_done.load() < requests)
+        ;
+    double cost = (now_ns() - begin) / 1e9;
+    if (l1d >= 0)
+        ioctl(l1d, PERF_EVENT_IOC_DISABLE, 0);
+    if (llc >= 0)
+        ioctl(llc, PERF_EVENT_IOC_DISABLE, 0);
+
+    static const char *names[] = {"central", "steal-rr", "steal-hash", "affinity"};
+    printf("%-11s %10.0f req/s", names[mode], requests / cost);
+    print_counter("l1d-miss", l1d, requests);
+    print_counter("llc-miss", llc, requests);
+    printf("\n");
+    if (l1d >= 0)
+        close(l1d);
+    if (llc >= 0)
+        close(llc);
+
+    /* 工作线程是分离的且从不退出，线程池和连接数组都不能安全释放，测试进程结束时一并回收 */
+}
+
+int main(int argc, char *argv[])
+{
+    int threads = argc > 1 ? atoi(argv[1]) : 8;
+    int requests = argc > 2 ? atoi(argv[2]) : 1000000;
+    int nconn = argc > 3 ? atoi(argv[3]) : 256;
+
+    printf("threads=%d requests=%d keep-alive conns=%d state=%dB\n", threads, requests, nconn, STATE_SIZE);
+    run(threadpool<fake_conn>::SCHED_CENTRAL, threads, requests, nconn);
+    run(threadpool<fake_conn>::SCHED_STEAL_HASH, threads, requests, nconn);
+    run(threadpool<fake_conn>::SCHED_AFFINITY, threads, requests, nconn);
+    return 0;
+}
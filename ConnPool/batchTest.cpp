@@ -0,0 +1,118 @@
+/*
+ * 事件循环向线程池交付一批就绪请求的开销：逐个append_p与一次append_batch对比
+ *   ./batchTest [threads] [rounds] [work_us]
+ * 每轮模拟一次epoll_wait返回burst个就绪连接，主线程交付后等待这一批处理完再进入下一轮，
+ * 统计主线程每批花在交付上的时间、每批进入内核唤醒线程的次数以及总吞吐。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <vector>
+#include "threadpool.hpp"
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void busy_us(int us)
+{
+    uint64_t end = now_ns() + us * 1000ull;
+    while (now_ns() < end)
+        ;
+}
+
+static std::atomic<int> g_done(0);
+
+/* 满足threadpool<T>接口的模拟请求，actor_model为0时只调用process() */
+struct fake_job
+{
+    int m_state;
+    uint64_t m_enqueue_ns;
+    uint64_t m_deadline_ns;
+    int improv;
+    int timer_flag;
+    MYSQL *mysql;
+
+    int work_us;
+
+    bool read_once() { return true; }
+    bool write() { return true; }
+    void drop() {}
+    void process()
+    {
+        busy_us(work_us);
+        g_done++;
+    }
+};
+
+static void run(int mode, bool batch, int threads, int rounds, int burst, int work_us)
+{
+    fake_job *jobs = new fake_job[burst];
+    std::vector<fake_job *> ready(burst);
+    for (int i = 0; i < burst; ++i)
+    {
+        jobs[i].mysql = NULL;
+        jobs[i].m_deadline_ns = 0;
+        jobs[i].work_us = work_us;
+        ready[i] = &jobs[i];
+    }
+    threadpool<fake_job> *pool = new threadpool<fake_job>(0, NULL, threads, 10000, mode);
+    /* 先让工作线程都进入休眠，和空闲的服务器收到一批请求时一样 */
+    usleep(20000);
+
+    uint64_t handoff_ns = 0;
+    uint64_t wakes = pool->wakeups();
+    uint64_t begin = now_ns();
+    for (int r = 0; r < rounds; ++r)
+    {
+        g_done = 0;
+        uint64_t t = now_ns();
+        if (batch)
+        {
+            pool->append_batch(ready.data(), burst);
+        }
+        else
+        {
+            for (int i = 0; i < burst; ++i)
+                pool->append_p(ready[i]);
+        }
+        handoff_ns += now_ns() - t;
+        while (g_done.load() < burst)
+            ;
+        /* 两批之间留出空档，工作线程自旋完后重新休眠 */
+        usleep(200);
+    }
+    double cost = (now_ns() - begin) / 1e9;
+
+    static const char *names[] = {"central", "steal-rr", "steal-hash", "affinity"};
+    printf("%-11s %-9s burst=%4d handoff=%8.2fus/batch wakeups=%6.2f/batch %9.0f req/s\n", names[mode],
+           batch ? "batch" : "one-by-one", burst, handoff_ns / 1e3 / rounds,
+           (double)(pool->wakeups() - wakes) / rounds, (double)rounds * burst / cost);
+
+    /* 工作线程是分离的且从不退出，线程池和请求数组都不能安全释放，测试进程结束时一并回收 */
+}
+
+int main(int argc, char *argv[])
+{
+    int threads = argc > 1 ? atoi(argv[1]) : 8;
+    int rounds = argc > 2 ? atoi(argv[2]) : 2000;
+    int work_us = argc > 3 ? atoi(argv[3]) : 5;
+
+    printf("threads=%d rounds=%d work=%dus\n", threads, rounds, work_us);
+    int bursts[] = {1, 16, 128, 1000};
+    int modes[] = {threadpool<fake_job>::SCHED_CENTRAL, threadpool<fake_job>::SCHED_AFFINITY};
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m)
+    {
+        for (size_t b = 0; b < sizeof(bursts) / sizeof(bursts[0]); ++b)
+        {
+            run(modes[m], false, threads, rounds, bursts[b], work_us);
+            run(modes[m], true, threads, rounds, bursts[b], work_us);
+        }
+    }
+    return 0;
+}
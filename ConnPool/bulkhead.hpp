@@ -0,0 +1,261 @@
+#ifndef BULKHEAD_H
+#define BULKHEAD_H
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "threadpool.hpp"
+
+/* 请求的工作类别，在分派前根据请求行确定 */
+enum WORK_CLASS
+{
+    WORK_STATIC = 0, //静态文件
+    WORK_DB,         //需要访问用户存储(登录、注册)
+    WORK_ADMIN,      //管理接口(/admin开头的路径)
+    WORK_CLASS_NUM
+};
+
+/**
+ * @brief 舱壁隔离：每个工作类别一个独立的线程池，各自有队列上限和线程数(即并发上限)，
+ *        数据库变慢时阻塞的只是数据库类别的线程，静态请求不会排在它们后面。
+ *        未配置时所有类别共用一个线程池，行为与单个threadpool相同。
+ */
+template <typename T>
+class bulkhead
+{
+public:
+    /* 一个类别的线程数与队列上限 */
+    struct lane_conf
+    {
+        int threads;
+        int depth;
+    };
+
+    /**
+     * @brief 解析舱壁配置"static,db,admin"，每项为"线程数[/队列上限]"，如"6,4/2000,1/100"，队列上限默认10000
+     * @return 格式错误或某项线程数不为正时返回false
+     */
+    static bool parse(const string &spec, lane_conf confs[WORK_CLASS_NUM]);
+
+    /**
+     * @param confs 为NULL时所有类别共用一个线程池，参数含义同threadpool；
+     *              否则按类别创建线程池，线程数固定不扩缩容，各线程池依次使用cpus中的CPU
+     */
+    bulkhead(int actor_model, connection_pool *connPool, int thread_number, int max_requests, int sched_mode,
+             int max_threads, const vector<int> &cpus, const lane_conf *confs);
+    ~bulkhead();
+
+    bool append(T *request, int state, int cls);
+    bool append_p(T *request, int cls);
+
+    /**
+     * @brief 批量添加，classes[i]为requests[i]的类别；按类别分组后每个线程池调用一次append_batch
+     * @param rejected 队列已满未能入队的请求依次写入其中，容量至少为n；它们计入所属类别的rejected
+     * @return 未能入队的个数
+     */
+    int append_batch(T **requests, const int *classes, int n, T **rejected);
+
+    /* 类别cls所在线程池当前的积压、队列上限与最近的排队时间 */
+    size_t queued(int cls) const { return m_lanes[cls]->queued(); }
+    int depth(int cls) const { return m_depth[cls]; }
+    uint64_t recent_wait_us(int cls) const { return m_lanes[cls]->recent_wait_us(); }
+
+    /* 各线程池积压达到backlog时按截止时间最早优先取任务，见threadpool::set_edf */
+    void set_edf(size_t backlog);
+
+    /* 是否按类别隔离 */
+    bool split() const { return m_lanes[WORK_STATIC] != m_lanes[WORK_DB]; }
+
+    /**
+     * @brief 将每个类别的入队、拒绝计数以及各线程池的统计写入日志
+     */
+    void report();
+
+    void placement();
+
+private:
+    threadpool<T> *m_lanes[WORK_CLASS_NUM];
+    int m_depth[WORK_CLASS_NUM];                    //各类别的队列上限
+    std::atomic<uint64_t> m_accepted[WORK_CLASS_NUM]; //入队成功的任务数
+    std::atomic<uint64_t> m_rejected[WORK_CLASS_NUM]; //队列已满被拒绝的任务数
+    std::vector<T *> m_group[WORK_CLASS_NUM];         //append_batch按类别分组，只由主线程访问
+};
+
+static const char *const WORK_CLASS_NAME[WORK_CLASS_NUM] = {"static", "db", "admin"};
+
+template <typename T>
+bool bulkhead<T>::parse(const string &spec, lane_conf confs[WORK_CLASS_NUM])
+{
+    const char *p = spec.c_str();
+    for (int i = 0; i < WORK_CLASS_NUM; ++i)
+    {
+        char *end;
+        confs[i].threads = strtol(p, &end, 10);
+        confs[i].depth = 10000;
+        if (end == p || confs[i].threads <= 0)
+            return false;
+        p = end;
+        if ('/' == *p)
+        {
+            confs[i].depth = strtol(p + 1, &end, 10);
+            if (end == p + 1 || confs[i].depth <= 0)
+                return false;
+            p = end;
+        }
+        if (i + 1 < WORK_CLASS_NUM)
+        {
+            if (',' != *p)
+                return false;
+            ++p;
+        }
+    }
+    return '\0' == *p;
+}
+
+template <typename T>
+bulkhead<T>::bulkhead(int actor_model, connection_pool *connPool, int thread_number, int max_requests,
+                      int sched_mode, int max_threads, const vector<int> &cpus, const lane_conf *confs)
+{
+    for (int i = 0; i < WORK_CLASS_NUM; ++i)
+    {
+        m_accepted[i] = 0;
+        m_rejected[i] = 0;
+    }
+    if (!confs)
+    {
+        threadpool<T> *pool = new threadpool<T>(actor_model, connPool, thread_number, max_requests, sched_mode,
+                                                max_threads, cpus);
+        for (int i = 0; i < WORK_CLASS_NUM; ++i)
+        {
+            m_lanes[i] = pool;
+            m_depth[i] = max_requests;
+        }
+        return;
+    }
+
+    size_t offset = 0;
+    for (int i = 0; i < WORK_CLASS_NUM; ++i)
+    {
+        /* proactor模式下请求在分派前已读入，类别是准确的，静态类别的线程不必占用数据库连接；
+           reactor模式下由工作线程读取请求，类别沿用该连接上一个请求的，每个类别都要能访问数据库 */
+        connection_pool *pool = (WORK_STATIC == i && 0 == actor_model) ? NULL : connPool;
+
+        /* 各线程池依次使用CPU列表，而不是都从第一个CPU开始 */
+        vector<int> lane_cpus;
+        for (int j = 0; j < confs[i].threads && !cpus.empty(); ++j)
+            lane_cpus.push_back(cpus[(offset + j) % cpus.size()]);
+        offset += confs[i].threads;
+
+        m_lanes[i] = new threadpool<T>(actor_model, pool, confs[i].threads, confs[i].depth, sched_mode, 0,
+                                       lane_cpus);
+        m_lanes[i]->set_name(WORK_CLASS_NAME[i]);
+        m_depth[i] = confs[i].depth;
+    }
+}
+
+template <typename T>
+bulkhead<T>::~bulkhead()
+{
+    if (!split())
+    {
+        delete m_lanes[0];
+        return;
+    }
+    for (int i = 0; i < WORK_CLASS_NUM; ++i)
+        delete m_lanes[i];
+}
+
+template <typename T>
+bool bulkhead<T>::append(T *request, int state, int cls)
+{
+    if (m_lanes[cls]->append(request, state))
+    {
+        m_accepted[cls].fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    m_rejected[cls].fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+template <typename T>
+bool bulkhead<T>::append_p(T *request, int cls)
+{
+    if (m_lanes[cls]->append_p(request))
+    {
+        m_accepted[cls].fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    m_rejected[cls].fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+template <typename T>
+int bulkhead<T>::append_batch(T **requests, const int *classes, int n, T **rejected)
+{
+    int failed = 0;
+    if (!split())
+    {
+        int done = m_lanes[0]->append_batch(requests, n);
+        for (int i = 0; i < n; ++i)
+        {
+            if (i < done)
+            {
+                m_accepted[classes[i]].fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                m_rejected[classes[i]].fetch_add(1, std::memory_order_relaxed);
+                rejected[failed++] = requests[i];
+            }
+        }
+        return failed;
+    }
+
+    for (int i = 0; i < n; ++i)
+        m_group[classes[i]].push_back(requests[i]);
+    for (int c = 0; c < WORK_CLASS_NUM; ++c)
+    {
+        std::vector<T *> &group = m_group[c];
+        if (group.empty())
+            continue;
+        int done = m_lanes[c]->append_batch(group.data(), group.size());
+        m_accepted[c].fetch_add(done, std::memory_order_relaxed);
+        m_rejected[c].fetch_add(group.size() - done, std::memory_order_relaxed);
+        for (size_t i = done; i < group.size(); ++i)
+            rejected[failed++] = group[i];
+        group.clear();
+    }
+    return failed;
+}
+
+template <typename T>
+void bulkhead<T>::set_edf(size_t backlog)
+{
+    for (int i = 0; i < WORK_CLASS_NUM; ++i)
+        m_lanes[i]->set_edf(backlog);
+}
+
+template <typename T>
+void bulkhead<T>::report()
+{
+    for (int i = 0; i < WORK_CLASS_NUM; ++i)
+    {
+        LOG_INFO("bulkhead %s: accepted=%llu rejected=%llu depth=%llu/%d", WORK_CLASS_NAME[i],
+                 (unsigned long long)m_accepted[i].load(), (unsigned long long)m_rejected[i].load(),
+                 (unsigned long long)m_lanes[i]->queued(), m_depth[i]);
+        if (split() || 0 == i)
+            m_lanes[i]->report();
+    }
+}
+
+template <typename T>
+void bulkhead<T>::placement()
+{
+    for (int i = 0; i < WORK_CLASS_NUM; ++i)
+    {
+        if (split() || 0 == i)
+            m_lanes[i]->placement();
+    }
+}
+
+#endif
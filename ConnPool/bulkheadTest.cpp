@@ -0,0 +1,111 @@
+/*
+ * 舱壁隔离的效果：数据库请求逐步变慢时，静态请求的延迟
+ *   ./bulkheadTest [threads] [jobs] [db_every] [static_us]
+ * 共用线程池与按类别隔离(静态、数据库各占一半线程，另有一个管理线程)两种方式对比，
+ * 主线程按固定间隔提交请求，每db_every个请求中有一个数据库请求，数据库请求阻塞db_ms毫秒(模拟MySQL变慢)。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include "bulkhead.hpp"
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void busy_us(int us)
+{
+    uint64_t end = now_ns() + us * 1000ull;
+    while (now_ns() < end)
+        ;
+}
+
+static std::atomic<int> g_done(0);
+
+/* 满足threadpool<T>接口的模拟请求，actor_model为0时只调用process() */
+struct fake_job
+{
+    int m_state;
+    uint64_t m_enqueue_ns;
+    uint64_t m_deadline_ns;
+    int improv;
+    int timer_flag;
+    MYSQL *mysql;
+
+    int cls;
+    int work_us;
+    uint64_t submit_ns;
+    uint64_t latency_ns;
+
+    bool read_once() { return true; }
+    bool write() { return true; }
+    void drop() {}
+    void process()
+    {
+        if (WORK_DB == cls)
+            usleep(work_us); //等待数据库，不占CPU
+        else
+            busy_us(work_us);
+        latency_ns = now_ns() - submit_ns;
+        g_done++;
+    }
+};
+
+static void run(bool split, int threads, int jobs, int db_every, int static_us, int db_ms)
+{
+    std::vector<fake_job> reqs(jobs);
+    int half = threads / 2 > 0 ? threads / 2 : 1;
+    bulkhead<fake_job>::lane_conf confs[WORK_CLASS_NUM] = {{half, 10000}, {half, 10000}, {1, 100}};
+    bulkhead<fake_job> *pool =
+        new bulkhead<fake_job>(0, NULL, threads, 10000, 0, 0, vector<int>(), split ? confs : NULL);
+    g_done = 0;
+
+    for (int i = 0; i < jobs; ++i)
+    {
+        fake_job &job = reqs[i];
+        job.mysql = NULL;
+        job.cls = db_every > 0 && i % db_every == 0 ? WORK_DB : WORK_STATIC;
+        job.work_us = WORK_DB == job.cls ? db_ms * 1000 : static_us;
+        job.submit_ns = now_ns();
+        while (!pool->append_p(&job, job.cls))
+            usleep(10);
+        /* 静态请求的到达速率约为静态线程处理能力的一半 */
+        busy_us(static_us * 4 / threads);
+    }
+    while (g_done.load() < jobs)
+        usleep(1000);
+
+    std::vector<uint64_t> lat;
+    for (int i = 0; i < jobs; ++i)
+        if (WORK_STATIC == reqs[i].cls)
+            lat.push_back(reqs[i].latency_ns);
+    std::sort(lat.begin(), lat.end());
+    printf("%-8s db=%4dms static p50=%9.1fus p99=%10.1fus max=%10.1fus\n", split ? "split" : "shared", db_ms,
+           lat[lat.size() / 2] / 1e3, lat[lat.size() * 99 / 100] / 1e3, lat.back() / 1e3);
+
+    /* 工作线程是分离的且从不退出，线程池不能安全析构，测试进程结束时一并回收 */
+}
+
+int main(int argc, char *argv[])
+{
+    int threads = argc > 1 ? atoi(argv[1]) : 8;
+    int jobs = argc > 2 ? atoi(argv[2]) : 20000;
+    int db_every = argc > 3 ? atoi(argv[3]) : 10;
+    int static_us = argc > 4 ? atoi(argv[4]) : 50;
+
+    printf("threads=%d jobs=%d one db request per %d, static requests %dus\n", threads, jobs, db_every, static_us);
+    int db_ms[] = {0, 2, 10, 50};
+    for (size_t i = 0; i < sizeof(db_ms) / sizeof(db_ms[0]); ++i)
+    {
+        run(false, threads, jobs, db_every, static_us, db_ms[i]);
+        run(true, threads, jobs, db_every, static_us, db_ms[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * 过载时排队截止时间的效果：提交速率高于线程池处理能力，请求在队列中越积越多
+ *   ./deadlineTest [threads] [jobs] [work_us] [overload%]
+ * 每4个请求中有1个截止时间很短(模拟连接定时器快到期的请求)，其余截止时间较长。
+ * 对比不设截止时间、先进先出并丢弃过期请求、积压时按截止时间最早优先三种方式：
+ * 按时完成的请求数(有效吞吐)、超时才完成的请求数、被丢弃的请求数以及按时完成请求的延迟。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include "threadpool.hpp"
+
+static const int TIGHT_US = 2000;  //短截止时间
+static const int LOOSE_US = 50000; //长截止时间
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void busy_us(int us)
+{
+    uint64_t end = now_ns() + us * 1000ull;
+    while (now_ns() < end)
+        ;
+}
+
+static std::atomic<int> g_done(0);
+
+/* 满足threadpool<T>接口的模拟请求，actor_model为0时只调用process()，过期时调用drop() */
+struct fake_job
+{
+    int m_state;
+    uint64_t m_enqueue_ns;
+    uint64_t m_deadline_ns;
+    int improv;
+    int timer_flag;
+    MYSQL *mysql;
+
+    int work_us;
+    uint64_t submit_ns;
+    uint64_t due_ns;    //该请求的截止时间，不设截止时间时也用它判断是否超时
+    uint64_t latency_ns;
+    bool dropped;
+
+    bool read_once() { return true; }
+    bool write() { return true; }
+    void drop()
+    {
+        dropped = true;
+        g_done++;
+    }
+    void process()
+    {
+        busy_us(work_us);
+        latency_ns = now_ns() - submit_ns;
+        g_done++;
+    }
+};
+
+static void run(const char *name, bool deadline, size_t edf, int threads, int jobs, int work_us, int overload)
+{
+    std::vector<fake_job> reqs(jobs);
+    threadpool<fake_job> *pool = new threadpool<fake_job>(0, NULL, threads, 100000);
+    pool->set_edf(edf);
+    g_done = 0;
+
+    /* 处理能力为threads / work_us，提交间隔按过载比例缩短；每毫秒提交一批后休眠，不与工作线程争抢CPU */
+    double gap_ns = work_us * 1000.0 / threads * 100 / overload;
+    uint64_t begin = now_ns();
+    for (int i = 0; i < jobs; ++i)
+    {
+        fake_job &job = reqs[i];
+        uint64_t at = begin + (uint64_t)(i * gap_ns);
+        /* 只读一次时钟：两次读取之间越过at时无符号的差值会回绕成极长的休眠 */
+        uint64_t now = now_ns();
+        if (now < at)
+            usleep((at - now) / 1000 + 1000);
+        job.mysql = NULL;
+        job.work_us = work_us;
+        job.submit_ns = now_ns();
+        job.due_ns = job.submit_ns + (i % 4 == 0 ? TIGHT_US : LOOSE_US) * 1000ull;
+        job.m_deadline_ns = deadline ? job.due_ns : 0;
+        while (!pool->append_p(&job))
+            ;
+    }
+    while (g_done.load() < jobs)
+        usleep(100);
+    double cost = (now_ns() - begin) / 1e9;
+
+    int on_time = 0, late = 0, dropped = 0, tight = 0;
+    std::vector<uint64_t> lat;
+    for (int i = 0; i < jobs; ++i)
+    {
+        if (reqs[i].dropped)
+        {
+            ++dropped;
+            continue;
+        }
+        if (reqs[i].submit_ns + reqs[i].latency_ns <= reqs[i].due_ns)
+        {
+            ++on_time;
+            tight += i % 4 == 0;
+            lat.push_back(reqs[i].latency_ns);
+        }
+        else
+        {
+            ++late;
+        }
+    }
+    std::sort(lat.begin(), lat.end());
+    printf("%-9s goodput=%8.0f req/s on-time=%6d (tight %5d) late=%6d dropped=%6d p50=%8.1fus p99=%8.1fus\n", name,
+           on_time / cost, on_time, tight, late, dropped, lat.empty() ? 0 : lat[lat.size() / 2] / 1e3,
+           lat.empty() ? 0 : lat[lat.size() * 99 / 100] / 1e3);
+
+    /* 工作线程是分离的且从不退出，线程池不能安全析构，测试进程结束时一并回收 */
+}
+
+int main(int argc, char *argv[])
+{
+    int threads = argc > 1 ? atoi(argv[1]) : 4;
+    int jobs = argc > 2 ? atoi(argv[2]) : 40000;
+    int work_us = argc > 3 ? atoi(argv[3]) : 100;
+    int overload = argc > 4 ? atoi(argv[4]) : 150;
+
+    printf("threads=%d jobs=%d work=%dus offered load=%d%% deadlines: 1/4 %dus, 3/4 %dus\n", threads, jobs, work_us,
+           overload, TIGHT_US, LOOSE_US);
+    run("none", false, 0, threads, jobs, work_us, overload);
+    run("fifo", true, 0, threads, jobs, work_us, overload);
+    run("edf", true, threads * 4, threads, jobs, work_us, overload);
+    return 0;
+}
@@ -0,0 +1,189 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <new>
+#include <atomic>
+#include <exception>
+
+#define CACHE_LINE 64
+
+/* 自旋等待时提示CPU降低功耗、让出流水线给同核的超线程 */
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define CPU_RELAX() __asm__ __volatile__("yield")
+#else
+#define CPU_RELAX() do {} while (0)
+#endif
+
+/**
+ * @brief 有界多生产者多消费者无锁队列(Vyukov)。
+ *        每个槽带一个序号：序号等于入队位置时可写，等于位置+1时可读，读完后置为位置+容量供下一轮使用。
+ *        生产者、消费者只在各自的位置计数器上做CAS，槽和两个计数器各占一个缓存行，互不干扰。
+ *        队列满时push直接返回false，容量即为允许等待的最大元素数。
+ */
+template <typename T>
+class mpmc_queue
+{
+public:
+    explicit mpmc_queue(size_t capacity);
+    ~mpmc_queue();
+
+    bool push(const T &item);
+    bool pop(T &item);
+
+    /**
+     * @brief 批量入队：一次CAS占下连续的多个槽，再逐个写入并发布
+     * @return 入队的个数，即items的前若干个；队列剩余空间不足时少于n
+     */
+    size_t push_bulk(const T *items, size_t n);
+
+    /* 并发修改时只是近似值，用于统计 */
+    size_t size() const;
+    size_t capacity() const { return m_capacity; }
+
+private:
+    struct alignas(CACHE_LINE) cell
+    {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    /* 下面两个函数，禁止对象拷贝、赋值 */
+    mpmc_queue(const mpmc_queue &);
+    mpmc_queue &operator=(const mpmc_queue &);
+
+    cell *m_buffer;
+    size_t m_capacity;
+    alignas(CACHE_LINE) std::atomic<size_t> m_enqueue_pos;
+    alignas(CACHE_LINE) std::atomic<size_t> m_dequeue_pos;
+    char m_pad[CACHE_LINE - sizeof(std::atomic<size_t>)];
+};
+
+template <typename T>
+mpmc_queue<T>::mpmc_queue(size_t capacity) : m_buffer(NULL), m_capacity(capacity), m_enqueue_pos(0), m_dequeue_pos(0)
+{
+    if (0 == capacity)
+        throw std::exception();
+    void *mem = NULL;
+    if (posix_memalign(&mem, CACHE_LINE, sizeof(cell) * capacity) != 0)
+        throw std::bad_alloc();
+    m_buffer = (cell *)mem;
+    for (size_t i = 0; i < capacity; ++i)
+    {
+        new (&m_buffer[i]) cell;
+        m_buffer[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+template <typename T>
+mpmc_queue<T>::~mpmc_queue()
+{
+    for (size_t i = 0; i < m_capacity; ++i)
+        m_buffer[i].~cell();
+    free(m_buffer);
+}
+
+template <typename T>
+bool mpmc_queue<T>::push(const T &item)
+{
+    size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    cell *c;
+    while (true)
+    {
+        c = &m_buffer[pos % m_capacity];
+        size_t seq = c->seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (0 == diff)
+        {
+            if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+            return false; //队列已满：该槽上一轮的元素还没被取走
+        else
+            pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    }
+    c->data = item;
+    c->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+size_t mpmc_queue<T>::push_bulk(const T *items, size_t n)
+{
+    size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    size_t k;
+    while (true)
+    {
+        /* 从pos起数出连续可写的槽；某个槽已被本轮写过说明pos过时了，重新读取 */
+        bool stale = false;
+        for (k = 0; k < n; ++k)
+        {
+            size_t seq = m_buffer[(pos + k) % m_capacity].seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + k);
+            if (diff < 0)
+                break; //后面的槽上一轮的元素还没被取走
+            if (diff > 0)
+            {
+                stale = true;
+                break;
+            }
+        }
+        if (stale)
+        {
+            pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            continue;
+        }
+        if (0 == k)
+            return 0;
+        /* 槽的序号等于位置时只有占下该位置的生产者能修改它，CAS成功后这k个槽都属于本线程 */
+        if (m_enqueue_pos.compare_exchange_weak(pos, pos + k, std::memory_order_relaxed))
+            break;
+    }
+    for (size_t i = 0; i < k; ++i)
+    {
+        cell *c = &m_buffer[(pos + i) % m_capacity];
+        c->data = items[i];
+        c->seq.store(pos + i + 1, std::memory_order_release);
+    }
+    return k;
+}
+
+template <typename T>
+bool mpmc_queue<T>::pop(T &item)
+{
+    size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+    cell *c;
+    while (true)
+    {
+        c = &m_buffer[pos % m_capacity];
+        size_t seq = c->seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (0 == diff)
+        {
+            if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+            return false; //队列为空
+        else
+            pos = m_dequeue_pos.load(std::memory_order_relaxed);
+    }
+    item = c->data;
+    c->seq.store(pos + m_capacity, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+size_t mpmc_queue<T>::size() const
+{
+    size_t tail = m_enqueue_pos.load(std::memory_order_relaxed);
+    size_t head = m_dequeue_pos.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ * 工作线程绑核与不绑核的对比：每个任务读写所属连接的读写缓冲区(模拟解析请求、生成响应)
+ *   ./pinTest [threads] [jobs] [conns] [cpus]
+ * cpus为绑核时使用的CPU列表(格式同taskset -c)，默认使用所有在线CPU，第i个线程绑定第i个CPU。
+ * 统计吞吐、任务延迟分位数，以及工作线程在两次任务之间换了CPU的次数(迁移)。
+ */
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include "threadpool.hpp"
+
+static const int BUF_SIZE = 3072; //与http_conn的读缓冲区加写缓冲区相当
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static std::atomic<int> g_done(0);
+static std::atomic<uint64_t> g_migrations(0);
+static __thread int t_last_cpu = -1;
+
+struct fake_conn
+{
+    char buf[BUF_SIZE];
+};
+
+/* 满足threadpool<T>接口的模拟请求，actor_model为0时只调用process() */
+struct fake_job
+{
+    int m_state;
+    uint64_t m_enqueue_ns;
+    uint64_t m_deadline_ns;
+    int improv;
+    int timer_flag;
+    MYSQL *mysql;
+
+    fake_conn *conn;
+    uint64_t submit_ns;
+    uint64_t latency_ns;
+    unsigned sum;
+
+    bool read_once() { return true; }
+    bool write() { return true; }
+    void drop() {}
+    void process()
+    {
+        int cpu = sched_getcpu();
+        if (t_last_cpu >= 0 && cpu != t_last_cpu)
+            g_migrations++;
+        t_last_cpu = cpu;
+
+        /* 前一半当作收到的请求读一遍，后一半当作响应写一遍 */
+        unsigned s = 0;
+        for (int i = 0; i < BUF_SIZE / 2; ++i)
+            s = s * 31 + conn->buf[i];
+        memset(conn->buf + BUF_SIZE / 2, s & 0xff, BUF_SIZE / 2);
+        sum = s;
+        latency_ns = now_ns() - submit_ns;
+        g_done++;
+    }
+};
+
+static void run(const char *name, int threads, int jobs, std::vector<fake_conn> &conns, const vector<int> &cpus)
+{
+    std::vector<fake_job> reqs(jobs);
+    threadpool<fake_job> *pool = new threadpool<fake_job>(0, NULL, threads, 10000, 0, 0, cpus);
+    g_done = 0;
+    g_migrations = 0;
+
+    uint64_t begin = now_ns();
+    for (int i = 0; i < jobs; ++i)
+    {
+        fake_job &job = reqs[i];
+        job.mysql = NULL;
+        job.conn = &conns[i % conns.size()];
+        job.submit_ns = now_ns();
+        while (!pool->append_p(&job))
+            sched_yield();
+    }
+    while (g_done.load() < jobs)
+        usleep(100);
+    double cost = (now_ns() - begin) / 1e9;
+
+    std::vector<uint64_t> lat;
+    for (int i = 0; i < jobs; ++i)
+        lat.push_back(reqs[i].latency_ns);
+    std::sort(lat.begin(), lat.end());
+    printf("%-9s %10.0f jobs/s p50=%8.1fus p99=%9.1fus migrations=%llu\n", name, jobs / cost,
+           lat[lat.size() / 2] / 1e3, lat[lat.size() * 99 / 100] / 1e3, (unsigned long long)g_migrations.load());
+
+    /* 工作线程是分离的且从不退出，线程池不能安全析构，测试进程结束时一并回收 */
+}
+
+int main(int argc, char *argv[])
+{
+    int threads = argc > 1 ? atoi(argv[1]) : 8;
+    int jobs = argc > 2 ? atoi(argv[2]) : 500000;
+    int nconn = argc > 3 ? atoi(argv[3]) : 4096;
+
+    vector<int> cpus;
+    if (argc > 4)
+    {
+        if (!cpu_affinity::parse(argv[4], cpus))
+        {
+            printf("invalid cpu list: %s\n", argv[4]);
+            return 1;
+        }
+    }
+    else
+    {
+        cpu_affinity::allowed(pthread_self(), cpus);
+    }
+
+    std::vector<fake_conn> conns(nconn);
+    for (int i = 0; i < nconn; ++i)
+        memset(conns[i].buf, i, BUF_SIZE);
+
+    printf("threads=%d jobs=%d conns=%d (%d KB) cpus=%s nodes=%d\n", threads, jobs, nconn,
+           nconn * BUF_SIZE / 1024, cpu_affinity::format(cpus).c_str(), cpu_affinity::node_count());
+    run("unpinned", threads, jobs, conns, vector<int>());
+    run("pinned", threads, jobs, conns, cpus);
+    return 0;
+}
@@ -0,0 +1,180 @@
+/*
+ * 线程池任务队列的微基准：对比原来的 std::list + locker + sem 与无锁环形队列 + futex事件计数
+ *   ./queueTest [items_per_producer] [capacity]
+ * 生产者、消费者线程数同为n，n取1到64；队列满时生产者让出CPU后重试，与append失败后的重试行为一致。
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <atomic>
+#include <list>
+#include <vector>
+#include "../Lock/locker.hpp"
+#include "../Lock/event_count.hpp"
+#include "mpmc_queue.hpp"
+
+/* 原实现：链表 + 互斥锁 + 信号量 */
+class list_queue
+{
+public:
+    explicit list_queue(size_t capacity) : m_capacity(capacity) {}
+
+    bool push(long item)
+    {
+        m_lock.lock();
+        if (m_list.size() >= m_capacity)
+        {
+            m_lock.unlock();
+            return false;
+        }
+        m_list.push_back(item);
+        m_lock.unlock();
+        m_stat.post();
+        return true;
+    }
+
+    long take()
+    {
+        while (true)
+        {
+            m_stat.wait();
+            m_lock.lock();
+            if (m_list.empty())
+            {
+                m_lock.unlock();
+                continue;
+            }
+            long item = m_list.front();
+            m_list.pop_front();
+            m_lock.unlock();
+            return item;
+        }
+    }
+
+private:
+    size_t m_capacity;
+    std::list<long> m_list;
+    locker m_lock;
+    sem m_stat;
+};
+
+/* 新实现：与threadpool<T>::take相同的自旋 + 休眠策略 */
+class ring_queue
+{
+public:
+    explicit ring_queue(size_t capacity) : m_queue(capacity) {}
+
+    bool push(long item)
+    {
+        if (!m_queue.push(item))
+            return false;
+        m_idle.notify_one();
+        return true;
+    }
+
+    long take()
+    {
+        long item;
+        while (true)
+        {
+            for (int i = 0; i < 64; ++i)
+            {
+                if (m_queue.pop(item))
+                    return item;
+                CPU_RELAX();
+            }
+            uint32_t key = m_idle.prepare_wait();
+            if (m_queue.pop(item))
+            {
+                m_idle.cancel_wait();
+                return item;
+            }
+            m_idle.wait(key);
+        }
+    }
+
+private:
+    mpmc_queue<long> m_queue;
+    event_count m_idle;
+};
+
+template <typename Q>
+struct bench_ctx
+{
+    Q *queue;
+    long items;
+    std::atomic<long> sum;
+};
+
+template <typename Q>
+static void *producer(void *arg)
+{
+    bench_ctx<Q> *ctx = (bench_ctx<Q> *)arg;
+    for (long i = 1; i <= ctx->items; ++i)
+        while (!ctx->queue->push(i))
+            sched_yield();
+    /* 结束标记，每个消费者取到一个0后退出 */
+    while (!ctx->queue->push(0))
+        sched_yield();
+    return NULL;
+}
+
+template <typename Q>
+static void *consumer(void *arg)
+{
+    bench_ctx<Q> *ctx = (bench_ctx<Q> *)arg;
+    long local = 0, item;
+    while ((item = ctx->queue->take()) != 0)
+        local += item;
+    ctx->sum += local;
+    return NULL;
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+template <typename Q>
+static double run(int threads, long items, size_t capacity)
+{
+    Q queue(capacity);
+    bench_ctx<Q> ctx;
+    ctx.queue = &queue;
+    ctx.items = items;
+    ctx.sum = 0;
+
+    std::vector<pthread_t> tids(2 * threads);
+    double begin = now_sec();
+    for (int i = 0; i < threads; ++i)
+        pthread_create(&tids[i], NULL, consumer<Q>, &ctx);
+    for (int i = 0; i < threads; ++i)
+        pthread_create(&tids[threads + i], NULL, producer<Q>, &ctx);
+    for (int i = 0; i < 2 * threads; ++i)
+        pthread_join(tids[i], NULL);
+    double cost = now_sec() - begin;
+
+    long expect = threads * (items * (items + 1) / 2);
+    if (ctx.sum.load() != expect)
+        printf("checksum mismatch: %ld != %ld\n", ctx.sum.load(), expect);
+    return threads * items / cost;
+}
+
+int main(int argc, char *argv[])
+{
+    long items = argc > 1 ? atol(argv[1]) : 200000;
+    size_t capacity = argc > 2 ? atol(argv[2]) : 10000;
+
+    printf("%-8s %-16s %-16s %s\n", "threads", "list+sem ops/s", "mpmc ops/s", "speedup");
+    for (int n = 1; n <= 64; n *= 2)
+    {
+        double a = run<list_queue>(n, items, capacity);
+        double b = run<ring_queue>(n, items, capacity);
+        printf("%-8d %-16.0f %-16.0f %.2fx\n", n, a, b, b / a);
+    }
+    return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * 线程池分派方式在倾斜负载下的延迟对比：每N个任务中有一个慢任务(模拟一次慢的数据库请求)
+ *   ./schedTest [threads] [jobs] [slow_every] [slow_us] [fast_us]
+ * 主线程按固定间隔提交任务，统计快任务从提交到完成的延迟分位数。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include "threadpool.hpp"
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void busy_us(int us)
+{
+    uint64_t end = now_ns() + us * 1000ull;
+    while (now_ns() < end)
+        ;
+}
+
+static std::atomic<int> g_done(0);
+
+/* 满足threadpool<T>接口的模拟请求，actor_model为0时只调用process() */
+struct fake_job
+{
+    int m_state;
+    uint64_t m_enqueue_ns;
+    uint64_t m_deadline_ns;
+    int improv;
+    int timer_flag;
+    MYSQL *mysql;
+
+    bool slow;
+    int slow_us;
+    int fast_us;
+    uint64_t submit_ns;
+    uint64_t latency_ns;
+
+    bool read_once() { return true; }
+    bool write() { return true; }
+    void drop() {}
+    void process()
+    {
+        if (slow)
+            usleep(slow_us); //慢任务阻塞在I/O上，不占CPU
+        else
+            busy_us(fast_us);
+        latency_ns = now_ns() - submit_ns;
+        g_done++;
+    }
+};
+
+static void run(int mode, int threads, int jobs, int slow_every, int slow_us, int fast_us)
+{
+    std::vector<fake_job> reqs(jobs);
+    threadpool<fake_job> *pool = new threadpool<fake_job>(0, NULL, threads, 10000, mode);
+    g_done = 0;
+
+    /* 提交间隔让平均负载约为线程数的一半 */
+    double avg_us = fast_us + (double)slow_us / slow_every;
+    int gap_us = (int)(avg_us / threads * 2);
+
+    for (int i = 0; i < jobs; ++i)
+    {
+        fake_job &job = reqs[i];
+        job.mysql = NULL;
+        job.slow = slow_every > 0 && i % slow_every == 0;
+        job.slow_us = slow_us;
+        job.fast_us = fast_us;
+        job.submit_ns = now_ns();
+        while (!pool->append_p(&job))
+            usleep(10);
+        busy_us(gap_us);
+    }
+    while (g_done.load() < jobs)
+        usleep(1000);
+
+    std::vector<uint64_t> lat;
+    for (int i = 0; i < jobs; ++i)
+        if (!reqs[i].slow)
+            lat.push_back(reqs[i].latency_ns);
+    std::sort(lat.begin(), lat.end());
+
+    static const char *names[] = {"central", "steal-rr", "steal-hash", "affinity"};
+    printf("%-11s p50=%7.1fus p99=%8.1fus p999=%8.1fus max=%8.1fus\n", names[mode], lat[lat.size() / 2] / 1e3,
+           lat[lat.size() * 99 / 100] / 1e3, lat[lat.size() * 999 / 1000] / 1e3, lat.back() / 1e3);
+
+    /* 工作线程是分离的且从不退出，线程池不能安全析构，测试进程结束时一并回收 */
+}
+
+int main(int argc, char *argv[])
+{
+    int threads = argc > 1 ? atoi(argv[1]) : 8;
+    int jobs = argc > 2 ? atoi(argv[2]) : 20000;
+    int slow_every = argc > 3 ? atoi(argv[3]) : 50;
+    int slow_us = argc > 4 ? atoi(argv[4]) : 5000;
+    int fast_us = argc > 5 ? atoi(argv[5]) : 20;
+
+    printf("threads=%d jobs=%d one slow (%dus) job per %d, fast jobs %dus\n", threads, jobs, slow_us, slow_every,
+           fast_us);
+    for (int mode = 0; mode < 4; ++mode)
+        run(mode, threads, jobs, slow_every, slow_us, fast_us);
+    return 0;
+}
@@ -0,0 +1,300 @@
+#include <mysql/mysql.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <algorithm>
+#include "shard_map.hpp"
+
+/* init_worker的参数：一个分片的连接池及其建连参数 */
+struct shard_init_arg
+{
+	connection_pool *pool;
+	shard_addr addr;
+	string user, passwd, dbname;
+	int max_conn;
+	int close_log;
+};
+
+static void *init_worker(void *arg)
+{
+	shard_init_arg *task = (shard_init_arg *)arg;
+	task->pool->init(task->addr.host, task->user, task->passwd, task->dbname, task->addr.port, task->max_conn, task->close_log);
+	return NULL;
+}
+
+/* load_worker的参数：负责加载的分片以及合并结果的目标 */
+struct shard_load_arg
+{
+	shard_map *shards;
+	int idx;
+	map<string, string> *users;
+	locker *lock;
+};
+
+/* scan_worker的参数 */
+struct shard_scan_arg
+{
+	shard_map *shards;
+	int idx;
+	const char *sql;
+	shard_map::row_func func;
+	void *arg;
+	bool ok;
+};
+
+shard_map *shard_map::GetInstance()
+{
+	static shard_map shards;
+	return &shards;
+}
+
+shard_map::~shard_map()
+{
+	/* 第0个分片是connection_pool的单例，由其自身析构 */
+	for (size_t i = 1; i < m_pools.size(); ++i)
+		delete m_pools[i];
+	for (size_t i = 0; i < m_metrics.size(); ++i)
+		delete m_metrics[i];
+}
+
+bool shard_map::parse(const string &spec, vector<shard_addr> &out)
+{
+	size_t start = 0;
+	while (start <= spec.size())
+	{
+		size_t end = spec.find(',', start);
+		if (end == string::npos)
+			end = spec.size();
+		string item = spec.substr(start, end - start);
+		if (!item.empty())
+		{
+			shard_addr addr;
+			size_t colon = item.rfind(':');
+			if (colon == string::npos)
+			{
+				addr.host = item;
+				addr.port = 3306;
+			}
+			else
+			{
+				addr.host = item.substr(0, colon);
+				addr.port = atoi(item.c_str() + colon + 1);
+			}
+			if (addr.host.empty() || addr.port <= 0)
+				return false;
+			out.push_back(addr);
+		}
+		start = end + 1;
+	}
+	return !out.empty();
+}
+
+/* FNV-1a，结果与平台和标准库实现无关，保证不同实例对同一用户名的路由一致 */
+uint32_t shard_map::hash(const char *data, size_t len)
+{
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < len; ++i)
+	{
+		h ^= (unsigned char)data[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+void shard_map::init(const vector<shard_addr> &addrs, string User, string PassWord, string DBName, int MaxConn, int close_log)
+{
+	m_addrs = addrs;
+	m_close_log = close_log;
+
+	int n = (int)m_addrs.size();
+	vector<pthread_t> tids(n);
+	vector<shard_init_arg> tasks(n);
+	for (int i = 0; i < n; ++i)
+	{
+		connection_pool *pool = (0 == i) ? connection_pool::GetInstance() : new connection_pool();
+		m_pools.push_back(pool);
+		m_metrics.push_back(new shard_metrics());
+
+		/* 虚拟节点的名字为 host:port#n */
+		char vnode[300];
+		for (int v = 0; v < SHARD_VNODES; ++v)
+		{
+			int len = snprintf(vnode, sizeof(vnode), "%s:%d#%d", m_addrs[i].host.c_str(), m_addrs[i].port, v);
+			m_ring.push_back(make_pair(hash(vnode, len), i));
+		}
+	}
+	sort(m_ring.begin(), m_ring.end());
+
+	/* 各分片的连接池互不相关，同时建连 */
+	for (int i = 0; i < n; ++i)
+	{
+		tasks[i].pool = m_pools[i];
+		tasks[i].addr = m_addrs[i];
+		tasks[i].user = User;
+		tasks[i].passwd = PassWord;
+		tasks[i].dbname = DBName;
+		tasks[i].max_conn = MaxConn;
+		tasks[i].close_log = close_log;
+		if (pthread_create(&tids[i], NULL, init_worker, &tasks[i]) != 0)
+		{
+			init_worker(&tasks[i]);
+			tids[i] = 0;
+		}
+	}
+	for (int i = 0; i < n; ++i)
+	{
+		if (tids[i])
+			pthread_join(tids[i], NULL);
+	}
+
+	LOG_INFO("shard map ready: %d shard(s), %d vnodes", size(), (int)m_ring.size());
+}
+
+int shard_map::shard_of(const string &name) const
+{
+	if (m_ring.size() <= SHARD_VNODES)
+		return 0;
+
+	/* 顺时针找到第一个哈希值不小于key的虚拟节点，越过环尾则回到环首 */
+	uint32_t h = hash(name.data(), name.size());
+	vector<pair<uint32_t, int> >::const_iterator it = lower_bound(m_ring.begin(), m_ring.end(), make_pair(h, -1));
+	if (it == m_ring.end())
+		it = m_ring.begin();
+	return it->second;
+}
+
+void *shard_map::load_worker(void *arg)
+{
+	shard_load_arg *load = (shard_load_arg *)arg;
+	shard_map *shards = load->shards;
+	shard_metrics &stat = shards->metrics(load->idx);
+
+	struct timeval begin, end;
+	gettimeofday(&begin, NULL);
+
+	MYSQL *mysql = NULL;
+	connectionRAII mysqlcon(&mysql, shards->GetPool(load->idx));
+
+	//在user表中检索username，passwd数据
+	if (!mysql || mysql_query(mysql, "SELECT username,passwd FROM user"))
+	{
+		LOG_ERROR("shard %d SELECT error:%s", load->idx, mysql ? mysql_error(mysql) : "no connection");
+		return NULL;
+	}
+
+	MYSQL_RES *result = mysql_store_result(mysql);
+	if (!result)
+		return NULL;
+
+	/* 先写入线程私有的map，最后一次性合并，避免每一行都去争抢全局锁 */
+	map<string, string> local;
+	while (MYSQL_ROW row = mysql_fetch_row(result))
+		local[row[0]] = row[1];
+	mysql_free_result(result);
+
+	load->lock->lock();
+	load->users->insert(local.begin(), local.end());
+	load->lock->unlock();
+
+	gettimeofday(&end, NULL);
+	stat.rows_loaded += local.size();
+	stat.load_ms += (end.tv_sec - begin.tv_sec) * 1000 + (end.tv_usec - begin.tv_usec) / 1000;
+	return NULL;
+}
+
+void shard_map::load_users(map<string, string> &users, locker &lock)
+{
+	int n = size();
+	vector<pthread_t> tids(n);
+	vector<shard_load_arg> args(n);
+
+	/* 每个分片一个加载线程，总耗时取决于最慢的分片而不是所有分片之和 */
+	for (int i = 0; i < n; ++i)
+	{
+		args[i].shards = this;
+		args[i].idx = i;
+		args[i].users = &users;
+		args[i].lock = &lock;
+		if (pthread_create(&tids[i], NULL, load_worker, &args[i]) != 0)
+		{
+			LOG_ERROR("create load thread for shard %d failed", i);
+			load_worker(&args[i]);
+			tids[i] = 0;
+		}
+	}
+	for (int i = 0; i < n; ++i)
+	{
+		if (tids[i])
+			pthread_join(tids[i], NULL);
+	}
+}
+
+void *shard_map::scan_worker(void *arg)
+{
+	shard_scan_arg *scan = (shard_scan_arg *)arg;
+
+	scan->ok = false;
+
+	MYSQL *mysql = NULL;
+	connectionRAII mysqlcon(&mysql, scan->shards->GetPool(scan->idx));
+	if (!mysql || mysql_query(mysql, scan->sql))
+	{
+		LOG_ERROR("shard %d query error:%s", scan->idx, mysql ? mysql_error(mysql) : "no connection");
+		return NULL;
+	}
+
+	MYSQL_RES *result = mysql_use_result(mysql);
+	if (!result)
+		return NULL;
+	while (MYSQL_ROW row = mysql_fetch_row(result))
+		scan->func(scan->idx, row, scan->arg);
+	mysql_free_result(result);
+	scan->ok = true;
+	return NULL;
+}
+
+bool shard_map::scan(const char *sql, row_func func, void *arg)
+{
+	return scan(vector<string>(size(), sql), func, arg);
+}
+
+bool shard_map::scan(const vector<string> &sqls, row_func func, void *arg)
+{
+	int n = size();
+	vector<pthread_t> tids(n);
+	vector<shard_scan_arg> args(n);
+
+	for (int i = 0; i < n; ++i)
+	{
+		args[i].shards = this;
+		args[i].idx = i;
+		args[i].sql = sqls[i].c_str();
+		args[i].func = func;
+		args[i].arg = arg;
+		if (pthread_create(&tids[i], NULL, scan_worker, &args[i]) != 0)
+		{
+			scan_worker(&args[i]);
+			tids[i] = 0;
+		}
+	}
+	bool ok = true;
+	for (int i = 0; i < n; ++i)
+	{
+		if (tids[i])
+			pthread_join(tids[i], NULL);
+		ok = ok && args[i].ok;
+	}
+	return ok;
+}
+
+void shard_map::report()
+{
+	for (int i = 0; i < size(); ++i)
+	{
+		shard_metrics &stat = metrics(i);
+		LOG_INFO("shard %d(%s:%d): free_conn=%d reads=%llu writes=%llu write_errors=%llu rows_loaded=%llu load_ms=%llu",
+				 i, m_addrs[i].host.c_str(), m_addrs[i].port, m_pools[i]->GetFreeConn(),
+				 (unsigned long long)stat.reads.load(), (unsigned long long)stat.writes.load(),
+				 (unsigned long long)stat.write_errors.load(), (unsigned long long)stat.rows_loaded.load(),
+				 (unsigned long long)stat.load_ms.load());
+	}
+}
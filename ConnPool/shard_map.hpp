@@ -0,0 +1,107 @@
+#ifndef _SHARD_MAP_
+#define _SHARD_MAP_
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <atomic>
+#include "sql_connection_pool.hpp"
+#include "../Lock/locker.hpp"
+
+using namespace std;
+
+/* 一个分片对应的mysqld实例地址 */
+struct shard_addr
+{
+	string host;
+	int port;
+};
+
+/* 分片级别的统计信息，由工作线程并发更新，所以使用原子变量 */
+struct shard_metrics
+{
+	shard_metrics() : reads(0), writes(0), write_errors(0), rows_loaded(0), load_ms(0) {}
+
+	atomic<uint64_t> reads;		   //路由到本分片的读(登录校验)次数
+	atomic<uint64_t> writes;	   //路由到本分片的写(注册)次数
+	atomic<uint64_t> write_errors; //写失败次数
+	atomic<uint64_t> rows_loaded;  //启动时从本分片加载的行数
+	atomic<uint64_t> load_ms;	   //启动时加载本分片耗时(毫秒)
+};
+
+/**
+ * @brief 用户表的分片映射：按用户名做一致性哈希，把读写路由到N个connection_pool之一。
+ *        每个分片在哈希环上放置SHARD_VNODES个虚拟节点，增删分片时只迁移相邻区间的用户。
+ */
+class shard_map
+{
+public:
+	static const int SHARD_VNODES = 160; //每个分片的虚拟节点数
+
+	//单例模式
+	static shard_map *GetInstance();
+
+	/**
+	 * @brief 解析分片配置，格式为 host:port[,host:port...]，端口缺省为3306
+	 * @return 配置是否合法
+	 */
+	static bool parse(const string &spec, vector<shard_addr> &out);
+
+	/**
+	 * @brief 为每个分片建立一个连接池，第0个分片使用connection_pool的默认单例
+	 */
+	void init(const vector<shard_addr> &addrs, string User, string PassWord, string DataBaseName, int MaxConn, int close_log);
+
+	int size() const { return (int)m_pools.size(); }
+
+	/**
+	 * @brief 按用户名计算所属分片的下标
+	 */
+	int shard_of(const string &name) const;
+
+	connection_pool *GetPool(int idx) { return m_pools[idx]; }
+	connection_pool *GetPool(const string &name) { return m_pools[shard_of(name)]; }
+
+	shard_metrics &metrics(int idx) { return *m_metrics[idx]; }
+
+	/**
+	 * @brief 启动时并行地从所有分片加载user表，每个分片一个线程，结果合并进users
+	 */
+	void load_users(map<string, string> &users, locker &lock);
+
+	/* scan的逐行回调，在各分片的加载线程中被并发调用 */
+	typedef void (*row_func)(int shard, MYSQL_ROW row, void *arg);
+
+	/**
+	 * @brief 在所有分片上并行执行同一条查询，并以流式方式(mysql_use_result)逐行回调，不缓存整个结果集
+	 * @return 所有分片的查询是否都成功
+	 */
+	bool scan(const char *sql, row_func func, void *arg);
+
+	/**
+	 * @brief 同上，但每个分片执行各自的查询，sqls[i]对应第i个分片
+	 */
+	bool scan(const vector<string> &sqls, row_func func, void *arg);
+
+	/**
+	 * @brief 将各分片的统计信息写入日志
+	 */
+	void report();
+
+private:
+	shard_map() {}
+	~shard_map();
+
+	static void *load_worker(void *arg);
+	static void *scan_worker(void *arg);
+	static uint32_t hash(const char *data, size_t len);
+
+	vector<shard_addr> m_addrs;
+	vector<connection_pool *> m_pools;
+	vector<shard_metrics *> m_metrics;
+	vector<pair<uint32_t, int> > m_ring; //哈希环：(虚拟节点哈希值, 分片下标)，按哈希值升序
+	int m_close_log;
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <list>
+#include <vector>
 #include <pthread.h>
 #include <iostream>
 #include "sql_connection_pool.hpp"
@@ -22,36 +23,83 @@ connection_pool *connection_pool::GetInstance()
 	return &connPool;
 }
 
+/* connect_worker的参数：需要建立的连接数和失败计数 */
+struct connect_arg
+{
+	connection_pool *pool;
+	int count;
+	int failed;
+};
+
+void *connection_pool::connect_worker(void *arg)
+{
+	connect_arg *task = (connect_arg *)arg;
+	connection_pool *pool = task->pool;
+
+	for (int i = 0; i < task->count; i++)
+	{
+		MYSQL *con = NULL;
+		con = mysql_init(con);
+		if (con != NULL)
+			con = mysql_real_connect(con, pool->m_url.c_str(), pool->m_User.c_str(), pool->m_PassWord.c_str(),
+									 pool->m_DatabaseName.c_str(), pool->m_port, NULL, 0);
+		if (con == NULL)
+		{
+			task->failed++;
+			continue;
+		}
+
+		pool->lock.lock();
+		pool->connList.push_back(con);
+		++pool->m_FreeConn;
+		pool->lock.unlock();
+	}
+	mysql_thread_end();
+	return NULL;
+}
+
 //构造初始化
 void connection_pool::init(string url, string User, string PassWord, string DBName, int Port, int MaxConn, int close_log)
 {
 	m_url = url;
 	m_Port = Port;
+	m_port = Port;
 	m_User = User;
 	m_PassWord = PassWord;
 	m_DatabaseName = DBName;
 	m_close_log = close_log;
 
-	/* 创建MaxConn条连接放入连接list中 */
-	for (int i = 0; i < MaxConn; i++)
-	{
-		MYSQL *con = NULL;
-		con = mysql_init(con);
+	/* 多线程使用客户端库之前必须先初始化，重复调用是安全的 */
+	mysql_library_init(0, NULL, NULL);
 
-		if (con == NULL)
+	/* 把MaxConn条连接分给若干个线程并行建立，建连耗时主要是网络往返和认证，串行建立时会线性累加 */
+	int nthreads = MaxConn < CONNECT_THREADS ? MaxConn : CONNECT_THREADS;
+	vector<pthread_t> tids(nthreads);
+	vector<connect_arg> tasks(nthreads);
+	for (int i = 0; i < nthreads; i++)
+	{
+		tasks[i].pool = this;
+		tasks[i].count = MaxConn / nthreads + (i < MaxConn % nthreads ? 1 : 0);
+		tasks[i].failed = 0;
+		if (pthread_create(&tids[i], NULL, connect_worker, &tasks[i]) != 0)
 		{
-			LOG_ERROR("MySQL Error");
-			exit(1);
+			connect_worker(&tasks[i]);
+			tids[i] = 0;
 		}
-		con = mysql_real_connect(con, url.c_str(), User.c_str(), PassWord.c_str(), DBName.c_str(), Port, NULL, 0);
+	}
 
-		if (con == NULL)
-		{
-			LOG_ERROR("MySQL Error");
-			exit(1);
-		}
-		connList.push_back(con);
-		++m_FreeConn;
+	int failed = 0;
+	for (int i = 0; i < nthreads; i++)
+	{
+		if (tids[i])
+			pthread_join(tids[i], NULL);
+		failed += tasks[i].failed;
+	}
+
+	if (failed > 0)
+	{
+		LOG_ERROR("MySQL Error: %d of %d connections to %s:%d failed", failed, MaxConn, url.c_str(), Port);
+		exit(1);
 	}
 
 	reserve = sem(m_FreeConn);
@@ -132,12 +180,18 @@ connection_pool::~connection_pool()
 }
 
 connectionRAII::connectionRAII(MYSQL **SQL, connection_pool *connPool){
+	conRAII = NULL;
+	poolRAII = connPool;
+
+	/* 连接池为空时不做任何事，*SQL保持调用方原有的值 */
+	if (NULL == connPool)
+		return;
+
 	*SQL = connPool->GetConnection();
-	
 	conRAII = *SQL;
-	poolRAII = connPool;
 }
 
 connectionRAII::~connectionRAII(){
-	poolRAII->ReleaseConnection(conRAII);
+	if (poolRAII)
+		poolRAII->ReleaseConnection(conRAII);
 }
\ No newline at end of file
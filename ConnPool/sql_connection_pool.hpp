@@ -26,10 +26,16 @@ public:
 
 	void init(string url, string User, string PassWord, string DataBaseName, int Port, int MaxConn, int close_log); 
 
-private:
+	/* 分片场景下每个mysqld实例各自持有一个连接池，所以构造函数对外开放；默认实例仍通过GetInstance获取 */
 	connection_pool();
 	~connection_pool();
 
+private:
+	/* 建连线程的入口，每个线程负责建立若干条连接 */
+	static void *connect_worker(void *arg);
+
+	static const int CONNECT_THREADS = 8; //并行建连的最大线程数
+
 	int m_MaxConn;  //最大连接数
 	int m_CurConn;  //当前已使用的连接数
 	int m_FreeConn; //当前空闲的连接数
@@ -44,6 +50,7 @@ public:
 	string m_PassWord;	 //登陆数据库密码
 	string m_DatabaseName; //使用数据库名
 	int m_close_log;	//日志开关
+	int m_port;			//数据库端口号(数值形式，供建连线程使用)
 };
 
 class connectionRAII{
@@ -1,64 +1,297 @@
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
 
-#include <list>
 #include <cstdio>
 #include <exception>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
 #include <pthread.h>
+#include <queue>
+#include <vector>
 #include "../Lock/locker.hpp"
+#include "../Lock/event_count.hpp"
+#include "mpmc_queue.hpp"
+#include "ws_deque.hpp"
 #include "sql_connection_pool.hpp"
 
+/* 工作线程发现队列为空后先自旋重试的次数，短暂的空档不必进入内核休眠 */
+#define WORKER_SPIN 64
+
+/* 亲和分派：连接所属线程的队列达到该深度才溢出到其他线程，其他线程也只窃取达到该深度的队列 */
+#define AFFINITY_MAX_DEPTH 4
+
+/* 自适应扩缩容：每个周期统计排队等待时间和线程利用率 */
+#define SCALE_TICK_MS 100        //统计周期
+#define SCALE_WAIT_HIGH_US 2000  //平均排队超过该值视为过载
+#define SCALE_UTIL_HIGH 0.85     //利用率超过该值视为过载
+#define SCALE_UP_TICKS 2         //连续过载的周期数达到该值才扩容
+#define SCALE_WAIT_LOW_US 200    //平均排队低于该值且
+#define SCALE_UTIL_LOW 0.40      //利用率低于该值视为空闲
+#define SCALE_DOWN_TICKS 50      //连续空闲的周期数达到该值才缩容，扩容快、缩容慢
+
+/* 排队时间直方图的桶数：第0个桶为不到1us，第i个桶为[2^(i-1), 2^i)us，最后一个桶包含更长的 */
+#define WAIT_BUCKETS 20
+
 template <typename T>
 class threadpool
 {
 public:
+    /* 任务分派方式 */
+    enum SCHED_MODE
+    {
+        SCHED_CENTRAL = 0, //所有工作线程共享一个无锁队列
+        SCHED_STEAL_RR,    //每个工作线程一个工作窃取队列，轮流分派，空闲线程随机窃取
+        SCHED_STEAL_HASH,  //同上，但按连接哈希分派，同一连接的请求优先落在同一线程
+        SCHED_AFFINITY     //按连接哈希分派且只由所属线程处理，队列过深时才溢出或被窃取，连接状态留在同一个核的缓存中
+    };
+
     /*thread_number是线程池中线程的数量，max_requests是请求队列中最多允许的、等待处理的请求的数量*/
-    threadpool(int actor_model, connection_pool *connPool, int thread_number = 8, int max_request = 10000);
+    /*max_threads大于thread_number时启用自适应扩缩容，线程数在[thread_number, max_threads]之间调整*/
+    /*cpus非空时第i个工作线程绑定到cpus[i % cpus.size()]，它的队列缓冲区分配在该CPU所在的节点上*/
+    threadpool(int actor_model, connection_pool *connPool, int thread_number = 8, int max_request = 10000,
+               int sched_mode = SCHED_CENTRAL, int max_threads = 0, const vector<int> &cpus = vector<int>());
     ~threadpool();
+
+    /* 工作窃取模式下队列的拥有者是调用append的线程，只能由主线程调用 */
     bool append(T *request, int state);
     bool append_p(T *request);
 
+    /**
+     * @brief 批量添加一次epoll_wait中就绪的请求(语义同append_p)：共享队列只做一次入队操作，
+     *        按任务数唤醒空闲线程，而不是每个请求唤醒一次
+     * @return 入队的个数，即requests的前若干个；队列满时少于n
+     */
+    int append_batch(T **requests, int n);
+
+    /* 唤醒工作线程进入内核的次数 */
+    uint64_t wakeups() const;
+
+    /**
+     * @brief 将线程数、扩缩容统计以及每个工作线程的分派、窃取、执行计数写入日志
+     */
+    void report();
+
+    /**
+     * @brief 将每个工作线程绑定的CPU、所在节点以及实际允许运行的CPU写入日志
+     */
+    void placement();
+
+    /* 日志中区分多个线程池时使用的名字 */
+    void set_name(const char *name) { m_name = name; }
+
+    /* 当前积压的任务数 */
+    size_t queued() const { return backlog(); }
+
+    /**
+     * @brief 共享队列模式下积压达到backlog时改为按截止时间最早优先取任务，0表示始终先进先出；
+     *        须在添加任务之前调用
+     */
+    void set_edf(size_t backlog) { m_edf_backlog = backlog; }
+
+    /* 超过截止时间而未处理、直接丢弃的任务数 */
+    uint64_t dropped() const;
+
+    /* 最近取到的任务的排队时间(各运行线程的指数滑动平均再取平均)，供准入控制判断队列是否过载 */
+    uint64_t recent_wait_us() const;
+
 private:
+    struct worker_slot;
+
     /*工作线程运行的函数，它不断从工作队列中取出任务并执行之*/
     static void *worker(void *arg);
-    void run();
+    void run(worker_slot &slot);
+
+    /* 管理者线程：按周期统计负载并调整线程数 */
+    static void *manager(void *arg);
+    void scale();
+
+    /* 启动下标为idx的工作线程 */
+    bool spawn(int idx);
+
+    static uint64_t now_ns();
+
+    /* 当前积压的任务数 */
+    size_t backlog() const;
+
+    /* 按分派方式放入队列 */
+    bool dispatch(T *request);
+
+    /* 入队并唤醒处理它的线程 */
+    bool enqueue(T *request);
+
+    /* 取出一个任务，队列为空时休眠直到有新任务；该线程需要退出时返回NULL */
+    T *take(int idx, unsigned &seed);
+
+    /* 不阻塞地取一个任务：先取自己的队列，再从随机的其他线程窃取 */
+    bool try_take(int idx, unsigned &seed, T *&request);
+
+    /* 过载时把共享队列中的任务移入按截止时间排序的堆，取截止时间最早的 */
+    bool take_edf(T *&request);
+
+    /* 任务已过截止时间：不再读取、解析和访问数据库，交给连接快速失败 */
+    void expire(T *request);
+
+    /* 亲和分派：放入连接所属线程的队列，过深时放入最空闲的线程；返回放入的线程下标，失败返回-1 */
+    int dispatch_affine(T *request);
+
+    /* 线程idx休眠所用的事件计数：亲和模式下每个线程一个，分派时只唤醒目标线程 */
+    event_count &idle_of(int idx) { return SCHED_AFFINITY == m_sched_mode ? m_slots[idx].park : m_idle; }
+
+    /* 唤醒所有休眠的线程 */
+    void wake_all();
+
+    struct alignas(CACHE_LINE) worker_slot
+    {
+        threadpool *pool;
+        int idx;
+        int cpu;                          //绑定的CPU，-1表示不绑定
+        ws_deque<T *> deque;
+        event_count park;                 //亲和模式下该线程在此休眠
+        std::atomic<uint64_t> submitted;  //分派到该线程队列的任务数
+        std::atomic<uint64_t> stolen;     //该线程从其他线程队列窃取的任务数
+        std::atomic<uint64_t> executed;   //该线程执行的任务数
+        std::atomic<uint64_t> wait_ns;    //取到的任务累计排队时间
+        std::atomic<uint64_t> busy_ns;    //已完成任务的累计处理时间
+        std::atomic<uint64_t> busy_since; //正在处理的任务的开始时间，空闲时为0
+        std::atomic<uint64_t> dropped;    //取到时已过截止时间而丢弃的任务数
+        std::atomic<uint64_t> wait_hist[WAIT_BUCKETS]; //取到的任务的排队时间分布
+        std::atomic<uint64_t> recent_wait_ns; //排队时间的指数滑动平均，只由该线程写
+    };
+
+    /* 截止时间晚的排在堆的下面，没有截止时间(0)的排在最后 */
+    struct edf_later
+    {
+        bool operator()(const T *a, const T *b) const
+        {
+            return a->m_deadline_ns - 1 > b->m_deadline_ns - 1;
+        }
+    };
+
+    /* 扩缩容周期之间的累计值 */
+    struct scale_sample
+    {
+        uint64_t at_ns;
+        uint64_t executed;
+        uint64_t wait_ns;
+        uint64_t busy_ns;
+    };
+    scale_sample sample();
 
 private:
-    int m_thread_number;        //线程池中的线程数
+    int m_thread_number;        //线程池中的线程数(扩缩容时为下限)
+    int m_max_threads;          //扩缩容的上限，等于m_thread_number时线程数固定
     int m_max_requests;         //请求队列中允许的最大请求数
-    pthread_t *m_threads;       //描述线程池的数组，其大小为m_thread_number
-    std::list<T *> m_workqueue; //任务队列
-    locker m_queuelocker;       //保护请求队列的互斥锁
-    sem m_queuestat;            //是否有任务需要处理
+    pthread_t *m_threads;       //描述线程池的数组，其大小为m_max_threads
+    mpmc_queue<T *> m_workqueue; //任务队列，容量为m_max_requests
+    event_count m_idle;          //空闲工作线程在此休眠
     connection_pool *m_connPool;  //数据库
     int m_actor_model;          //模型切换
+    int m_sched_mode;           //任务分派方式
+    worker_slot *m_slots;       //每个工作线程的队列和计数
+    unsigned m_next;            //轮流分派的下一个线程，只由主线程访问
+    bool m_pinned;              //工作线程是否绑核
+    std::atomic<uint64_t> m_overflows; //亲和模式下因所属线程队列过深而放到其他线程的任务数
+    std::vector<int> m_batch_hits; //append_batch中每个线程分到的任务数，只由主线程访问
+    const char *m_name;         //线程池的名字
+
+    /* 按截止时间最早优先：只在共享队列模式下、积压达到m_edf_backlog后使用 */
+    size_t m_edf_backlog;
+    locker m_edf_lock;
+    std::priority_queue<T *, std::vector<T *>, edf_later> m_edf_heap;
+    std::atomic<size_t> m_edf_size; //堆中的任务数，不加锁即可判断堆是否为空
+
+    /* 下标小于m_target的线程应当运行；缩容时调小m_target，下标越界的线程处理完手头的任务后退出 */
+    std::atomic<int> m_target;
+    std::atomic<int> m_live; //实际运行的工作线程数
+    pthread_t m_manager;
+    locker m_manager_lock;
+    cond m_manager_cond; //析构时唤醒管理者线程
+    bool m_manager_stop; //由m_manager_lock保护
+
+    /* 扩缩容决策，供report输出 */
+    std::atomic<uint64_t> m_grows;
+    std::atomic<uint64_t> m_shrinks;
+    std::atomic<uint64_t> m_last_wait_us; //最近一个周期的平均排队时间
+    std::atomic<int> m_last_util;         //最近一个周期的利用率(百分比)
 };
 
 template <typename T>
-threadpool<T>::threadpool( int actor_model, connection_pool *connPool, int thread_number, int max_requests) : m_actor_model(actor_model),m_thread_number(thread_number), m_max_requests(max_requests), m_threads(NULL),m_connPool(connPool)
+threadpool<T>::threadpool( int actor_model, connection_pool *connPool, int thread_number, int max_requests, int sched_mode, int max_threads, const vector<int> &cpus) : m_actor_model(actor_model),m_thread_number(thread_number), m_max_threads(max_threads > thread_number ? max_threads : thread_number), m_max_requests(max_requests), m_threads(NULL), m_workqueue(max_requests > 0 ? max_requests : 1), m_connPool(connPool), m_sched_mode(sched_mode), m_slots(NULL), m_next(0), m_pinned(!cpus.empty()), m_overflows(0), m_name("threadpool"), m_edf_backlog(0), m_edf_size(0), m_target(0), m_live(0), m_manager_stop(false), m_grows(0), m_shrinks(0), m_last_wait_us(0), m_last_util(0)
 {
     if (thread_number <= 0 || max_requests <= 0)
         throw std::exception();
-    m_threads = new pthread_t[m_thread_number]; // 创建大小位m_thread_number的工作线程数组
+    if (sched_mode < SCHED_CENTRAL || sched_mode > SCHED_AFFINITY)
+        m_sched_mode = SCHED_CENTRAL;
+    m_slots = new worker_slot[m_max_threads];
+    m_batch_hits.assign(m_max_threads, 0);
+    for (int i = 0; i < m_max_threads; ++i)
+    {
+        m_slots[i].cpu = m_pinned ? cpus[i % cpus.size()] : -1;
+        /* 总的积压上限仍是m_max_requests，平均分给每个可能存在的线程的队列 */
+        if (SCHED_CENTRAL != m_sched_mode)
+            m_slots[i].deque.init((max_requests + m_max_threads - 1) / m_max_threads,
+                                  m_pinned ? cpu_affinity::node_of(m_slots[i].cpu) : -1);
+        m_slots[i].pool = this;
+        m_slots[i].idx = i;
+        m_slots[i].submitted = 0;
+        m_slots[i].stolen = 0;
+        m_slots[i].executed = 0;
+        m_slots[i].wait_ns = 0;
+        m_slots[i].busy_ns = 0;
+        m_slots[i].busy_since = 0;
+        m_slots[i].dropped = 0;
+        m_slots[i].recent_wait_ns = 0;
+        for (int b = 0; b < WAIT_BUCKETS; ++b)
+            m_slots[i].wait_hist[b] = 0;
+    }
+    m_threads = new pthread_t[m_max_threads]; // 创建大小位m_max_threads的工作线程数组
     if (!m_threads)
         throw std::exception();
     for (int i = 0; i < thread_number; ++i)
     {
         // 创建工作线程
-        if (pthread_create(m_threads + i, NULL, worker, this) != 0)
+        if (!spawn(i))
         {
             delete[] m_threads;
             throw std::exception();
         }
-        // 线程分离，后续子线程可以自行退出并释放资源
-        if (pthread_detach(m_threads[i]))
-        {
-            delete[] m_threads;
+    }
+
+    if (m_max_threads > m_thread_number)
+    {
+        /* 管理者线程读取m_slots等成员，不能分离，析构时要等它退出 */
+        if (pthread_create(&m_manager, NULL, manager, this) != 0)
             throw std::exception();
-        }
     }
 }
 
+/**
+ * @brief 启动下标为idx的工作线程
+ */
+template <typename T>
+bool threadpool<T>::spawn(int idx)
+{
+    m_target = idx + 1;
+    m_live++;
+    /* 在创建时就绑核，线程从第一条指令起就在目标CPU上运行，栈页面分配在本地节点 */
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (m_pinned)
+        cpu_affinity::pin_attr(&attr, vector<int>(1, m_slots[idx].cpu));
+    int ret = pthread_create(m_threads + idx, &attr, worker, m_slots + idx);
+    pthread_attr_destroy(&attr);
+    if (ret != 0)
+    {
+        m_live--;
+        m_target = idx;
+        return false;
+    }
+    // 线程分离，后续子线程可以自行退出并释放资源
+    pthread_detach(m_threads[idx]);
+    return true;
+}
+
 
 /**
  * @brief 析构函数，释放所有的线程
@@ -66,7 +299,106 @@ threadpool<T>::threadpool( int actor_model, connection_pool *connPool, int threa
 template <typename T>
 threadpool<T>::~threadpool()
 {
+    if (m_max_threads > m_thread_number)
+    {
+        m_manager_lock.lock();
+        m_manager_stop = true;
+        m_manager_cond.signal();
+        m_manager_lock.unlock();
+        pthread_join(m_manager, NULL);
+    }
     delete[] m_threads;
+    delete[] m_slots;
+}
+
+/**
+ * @brief 工作窃取模式下先放入选中线程的队列，满了依次尝试后面的线程，全满才算失败
+ * @param request 需要添加的任务
+ */
+template <typename T>
+bool threadpool<T>::dispatch(T *request)
+{
+    if (SCHED_CENTRAL == m_sched_mode)
+    {
+        /* EDF堆中有积压时共享队列腾出的位置不算空位，堆和队列合起来不超过m_max_requests */
+        if (m_edf_size.load(std::memory_order_relaxed) && backlog() >= (size_t)m_max_requests)
+            return false;
+        return m_workqueue.push(request);
+    }
+    /* 首选在运行的线程；溢出时可以放进已退出线程的队列，运行中的线程会把它们窃取走 */
+    int target = m_target.load(std::memory_order_relaxed);
+    int start;
+    if (SCHED_STEAL_HASH == m_sched_mode)
+        start = ((uintptr_t)request / sizeof(T)) % target; //请求对象与连接一一对应，相当于按fd哈希
+    else
+        start = m_next++ % target;
+
+    for (int i = 0; i < m_max_threads; ++i)
+    {
+        worker_slot &slot = m_slots[(start + i) % m_max_threads];
+        if (slot.deque.push(request))
+        {
+            slot.submitted.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename T>
+int threadpool<T>::dispatch_affine(T *request)
+{
+    int target = m_target.load(std::memory_order_relaxed);
+    int home = ((uintptr_t)request / sizeof(T)) % target;
+    int idx = home;
+    if (m_slots[home].deque.size() >= AFFINITY_MAX_DEPTH)
+    {
+        /* 所属线程积压过多，放到最空闲的线程，宁可让连接状态换一次核也不排在长队后面 */
+        size_t best = m_slots[home].deque.size();
+        for (int i = 0; i < target; ++i)
+        {
+            size_t depth = m_slots[i].deque.size();
+            if (depth < best)
+            {
+                best = depth;
+                idx = i;
+            }
+        }
+    }
+    if (!m_slots[idx].deque.push(request))
+    {
+        /* 在运行的线程都满了，放进已退出线程的队列，由运行中的线程窃取 */
+        for (idx = target; idx < m_max_threads && !m_slots[idx].deque.push(request); ++idx)
+            ;
+        if (idx == m_max_threads)
+            return -1;
+    }
+    if (idx != home)
+        m_overflows.fetch_add(1, std::memory_order_relaxed);
+    m_slots[idx].submitted.fetch_add(1, std::memory_order_relaxed);
+    return idx;
+}
+
+/**
+ * @brief 记录入队时间，放入队列后唤醒一个线程；亲和模式下唤醒的是任务所在队列的线程
+ */
+template <typename T>
+bool threadpool<T>::enqueue(T *request)
+{
+    request->m_enqueue_ns = now_ns();
+    if (SCHED_AFFINITY == m_sched_mode)
+    {
+        int idx = dispatch_affine(request);
+        if (idx < 0)
+            return false;
+        /* 放进已退出线程的队列时，唤醒0号线程来窃取 */
+        m_slots[idx < m_target.load(std::memory_order_relaxed) ? idx : 0].park.notify_one();
+        return true;
+    }
+    if (!dispatch(request))
+        return false;
+    m_idle.notify_one();
+    return true;
 }
 
 /**
@@ -77,17 +409,9 @@ threadpool<T>::~threadpool()
 template <typename T>
 bool threadpool<T>::append(T *request, int state)
 {
-    m_queuelocker.lock();
-    if (m_workqueue.size() >= m_max_requests)
-    {
-        m_queuelocker.unlock();
-        return false;
-    }
+    /* 入队失败说明已有m_max_requests个请求在等待；m_state只在入队成功后才被工作线程读取 */
     request->m_state = state;
-    m_workqueue.push_back(request);
-    m_queuelocker.unlock();
-    m_queuestat.post();
-    return true;
+    return enqueue(request);
 }
 
 /**
@@ -97,51 +421,431 @@ bool threadpool<T>::append(T *request, int state)
 template <typename T>
 bool threadpool<T>::append_p(T *request)
 {
-    m_queuelocker.lock();
-    if (m_workqueue.size() >= m_max_requests)
+    return enqueue(request);
+}
+
+template <typename T>
+int threadpool<T>::append_batch(T **requests, int n)
+{
+    uint64_t now = now_ns();
+    for (int i = 0; i < n; ++i)
+        requests[i]->m_enqueue_ns = now;
+
+    int done = 0;
+    if (SCHED_CENTRAL == m_sched_mode)
     {
-        m_queuelocker.unlock();
-        return false;
+        /* 与dispatch相同，EDF堆中有积压时按堆和队列的总数限制 */
+        if (m_edf_size.load(std::memory_order_relaxed))
+        {
+            size_t queued = backlog();
+            size_t room = queued < (size_t)m_max_requests ? m_max_requests - queued : 0;
+            if ((size_t)n > room)
+                n = room;
+        }
+        done = n > 0 ? m_workqueue.push_bulk(requests, n) : 0;
+        m_idle.notify(done);
     }
-    m_workqueue.push_back(request);
-    m_queuelocker.unlock();
-    m_queuestat.post();
-    return true;
+    else if (SCHED_AFFINITY == m_sched_mode)
+    {
+        /* 每个分到任务的线程只唤醒一次 */
+        int target = m_target.load(std::memory_order_relaxed);
+        for (; done < n; ++done)
+        {
+            int idx = dispatch_affine(requests[done]);
+            if (idx < 0)
+                break;
+            m_batch_hits[idx < target ? idx : 0]++;
+        }
+        for (int i = 0; i < m_max_threads; ++i)
+        {
+            if (m_batch_hits[i])
+            {
+                m_slots[i].park.notify_one();
+                m_batch_hits[i] = 0;
+            }
+        }
+    }
+    else
+    {
+        /* 工作窃取队列的push只由主线程调用，本身没有原子读改写，只需合并唤醒 */
+        while (done < n && dispatch(requests[done]))
+            ++done;
+        m_idle.notify(done);
+    }
+    return done;
+}
+
+template <typename T>
+uint64_t threadpool<T>::wakeups() const
+{
+    uint64_t n = m_idle.wakes();
+    if (SCHED_AFFINITY == m_sched_mode)
+    {
+        for (int i = 0; i < m_max_threads; ++i)
+            n += m_slots[i].park.wakes();
+    }
+    return n;
+}
+
+template <typename T>
+uint64_t threadpool<T>::dropped() const
+{
+    uint64_t n = 0;
+    for (int i = 0; i < m_max_threads; ++i)
+        n += m_slots[i].dropped.load(std::memory_order_relaxed);
+    return n;
+}
+
+template <typename T>
+uint64_t threadpool<T>::recent_wait_us() const
+{
+    int target = m_target.load(std::memory_order_relaxed);
+    uint64_t sum = 0;
+    for (int i = 0; i < target; ++i)
+        sum += m_slots[i].recent_wait_ns.load(std::memory_order_relaxed);
+    return target ? sum / target / 1000 : 0;
+}
+
+template <typename T>
+uint64_t threadpool<T>::now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
 }
 
 /**
  * @brief 工作函数
- * @param arg 线程池指针
+ * @param arg 工作线程的槽位
  */
 template <typename T>
 void *threadpool<T>::worker(void *arg)
 {
-    threadpool *pool = (threadpool *)arg;
-    pool->run();
-    return pool;
+    worker_slot *slot = (worker_slot *)arg;
+    slot->pool->run(*slot);
+    return slot->pool;
+}
+
+template <typename T>
+bool threadpool<T>::try_take(int idx, unsigned &seed, T *&request)
+{
+    if (SCHED_CENTRAL == m_sched_mode)
+    {
+        /* 堆中还有任务时先取完，它们比共享队列中的任务入队早 */
+        if (m_edf_backlog && (m_edf_size.load(std::memory_order_relaxed) || m_workqueue.size() >= m_edf_backlog))
+            return take_edf(request);
+        return m_workqueue.pop(request);
+    }
+
+    if (m_slots[idx].deque.steal(request))
+        return true;
+
+    if (SCHED_AFFINITY == m_sched_mode)
+    {
+        /* 只窃取积压过深的队列和已退出线程留下的队列，其余任务留给连接所属的线程 */
+        int target = m_target.load(std::memory_order_relaxed);
+        for (int victim = 0; victim < m_max_threads; ++victim)
+        {
+            if (victim == idx)
+                continue;
+            if (victim < target && m_slots[victim].deque.size() < AFFINITY_MAX_DEPTH)
+                continue;
+            if (m_slots[victim].deque.steal(request))
+            {
+                m_slots[idx].stolen.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* 从随机位置开始扫描其他线程的队列(包括已退出线程留下的)，避免空闲线程总是挤在同一个受害者上 */
+    seed = seed * 1103515245 + 12345;
+    int victim = (seed >> 16) % m_max_threads;
+    for (int i = 0; i < m_max_threads; ++i, victim = (victim + 1) % m_max_threads)
+    {
+        if (victim != idx && m_slots[victim].deque.steal(request))
+        {
+            m_slots[idx].stolen.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
 }
 
 /**
- * @brief 取出任务并执行
+ * @brief 过载时排在后面的请求可能截止时间更早(例如连接定时器快到期)，先进先出会让它们等到过期；
+ *        此时把共享队列中的任务全部移入堆，按截止时间最早优先处理，已过期的也会先被取出并丢弃
+ */
+template <typename T>
+bool threadpool<T>::take_edf(T *&request)
+{
+    m_edf_lock.lock();
+    T *r;
+    /* 堆的大小也以m_max_requests为限；堆不空时dispatch和append_batch按堆和队列的总数拒绝新任务，
+       共享队列腾出的位置不会让总积压超过上限 */
+    while (m_edf_heap.size() < (size_t)m_max_requests && m_workqueue.pop(r))
+        m_edf_heap.push(r);
+    bool ok = !m_edf_heap.empty();
+    if (ok)
+    {
+        request = m_edf_heap.top();
+        m_edf_heap.pop();
+    }
+    m_edf_size.store(m_edf_heap.size(), std::memory_order_relaxed);
+    m_edf_lock.unlock();
+    return ok;
+}
+
+/**
+ * @brief 取出任务：先自旋重试，仍为空再登记为空闲并休眠，只有存在空闲线程时生产者才需要唤醒
+ */
+template <typename T>
+T *threadpool<T>::take(int idx, unsigned &seed)
+{
+    T *request = NULL;
+    while (idx < m_target.load(std::memory_order_relaxed))
+    {
+        for (int i = 0; i < WORKER_SPIN; ++i)
+        {
+            if (try_take(idx, seed, request))
+                return request;
+            CPU_RELAX();
+        }
+
+        event_count &idle = idle_of(idx);
+        uint32_t key = idle.prepare_wait();
+        if (try_take(idx, seed, request))
+        {
+            idle.cancel_wait();
+            return request;
+        }
+        idle.wait(key);
+    }
+    return NULL;
+}
+
+template <typename T>
+void threadpool<T>::wake_all()
+{
+    m_idle.notify_all();
+    if (SCHED_AFFINITY == m_sched_mode)
+    {
+        for (int i = 0; i < m_max_threads; ++i)
+            m_slots[i].park.notify_all();
+    }
+}
+
+template <typename T>
+size_t threadpool<T>::backlog() const
+{
+    if (SCHED_CENTRAL == m_sched_mode)
+        return m_workqueue.size() + m_edf_size.load(std::memory_order_relaxed);
+    size_t n = 0;
+    for (int i = 0; i < m_max_threads; ++i)
+        n += m_slots[i].deque.size();
+    return n;
+}
+
+template <typename T>
+typename threadpool<T>::scale_sample threadpool<T>::sample()
+{
+    scale_sample s;
+    s.at_ns = now_ns();
+    s.executed = s.wait_ns = s.busy_ns = 0;
+    for (int i = 0; i < m_max_threads; ++i)
+    {
+        worker_slot &slot = m_slots[i];
+        s.executed += slot.executed.load(std::memory_order_relaxed);
+        s.wait_ns += slot.wait_ns.load(std::memory_order_relaxed);
+        s.busy_ns += slot.busy_ns.load(std::memory_order_relaxed);
+        /* 正在处理的任务也计入忙碌时间，否则一批长时间阻塞的请求在完成前看起来都是空闲 */
+        uint64_t since = slot.busy_since.load(std::memory_order_relaxed);
+        if (since && since < s.at_ns)
+            s.busy_ns += s.at_ns - since;
+    }
+    return s;
+}
+
+template <typename T>
+void *threadpool<T>::manager(void *arg)
+{
+    ((threadpool *)arg)->scale();
+    return arg;
+}
+
+/**
+ * @brief 每个周期计算平均排队时间与利用率：连续过载若干周期则按当前线程数的1/4扩容，
+ *        连续空闲更多周期才缩掉一个线程；两个阈值之间留有间隔，避免在边界上来回抖动
  */
 template <typename T>
-void threadpool<T>::run()
+void threadpool<T>::scale()
 {
+    scale_sample last = sample();
+    int hot_ticks = 0, cold_ticks = 0;
     while (true)
     {
-        m_queuestat.wait();
-        m_queuelocker.lock();
-        if (m_workqueue.empty())
+        /* 等待一个周期，析构时被提前唤醒则退出 */
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += SCALE_TICK_MS / 1000;
+        deadline.tv_nsec += (SCALE_TICK_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
         {
-            m_queuelocker.unlock();
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        m_manager_lock.lock();
+        while (!m_manager_stop && m_manager_cond.timewait(m_manager_lock.get(), deadline))
+            ;
+        bool stop = m_manager_stop;
+        m_manager_lock.unlock();
+        if (stop)
+            break;
+
+        scale_sample cur = sample();
+        uint64_t done = cur.executed - last.executed;
+        uint64_t wait_us = done ? (cur.wait_ns - last.wait_ns) / done / 1000 : 0;
+        int live = m_live.load();
+        double util = (double)(cur.busy_ns - last.busy_ns) / ((cur.at_ns - last.at_ns) * (double)(live ? live : 1));
+        if (util > 1.0)
+            util = 1.0;
+        last = cur;
+        m_last_wait_us = wait_us;
+        m_last_util = (int)(util * 100);
+
+        bool hot = wait_us > SCALE_WAIT_HIGH_US || util > SCALE_UTIL_HIGH;
+        bool cold = wait_us < SCALE_WAIT_LOW_US && util < SCALE_UTIL_LOW;
+        hot_ticks = hot ? hot_ticks + 1 : 0;
+        cold_ticks = cold ? cold_ticks + 1 : 0;
+
+        /* 上一次缩容的线程还没退出时不做新的决定 */
+        int target = m_target.load();
+        if (live != target)
             continue;
+
+        if (hot_ticks >= SCALE_UP_TICKS && live < m_max_threads)
+        {
+            int add = live / 4 > 1 ? live / 4 : 1;
+            if (live + add > m_max_threads)
+                add = m_max_threads - live;
+            int added = 0;
+            while (added < add && spawn(live + added))
+                ++added;
+            m_grows++;
+            hot_ticks = cold_ticks = 0;
+            LOG_INFO("%s grow %d -> %d: wait=%lluus util=%d%% backlog=%llu", m_name, live, live + added,
+                     (unsigned long long)wait_us, (int)(util * 100), (unsigned long long)backlog());
+        }
+        else if (cold_ticks >= SCALE_DOWN_TICKS && live > m_thread_number)
+        {
+            m_target = live - 1;
+            wake_all(); //让休眠中的待退出线程醒来检查自己的下标
+            m_shrinks++;
+            hot_ticks = cold_ticks = 0;
+            LOG_INFO("%s shrink %d -> %d: wait=%lluus util=%d%%", m_name, live, live - 1,
+                     (unsigned long long)wait_us, (int)(util * 100));
         }
-        // 取出任务，并从任务队列中弹出
-        T *request = m_workqueue.front();
-        m_workqueue.pop_front();
-        m_queuelocker.unlock();
+    }
+}
+
+template <typename T>
+void threadpool<T>::report()
+{
+    static const char *modes[] = {"central", "steal-rr", "steal-hash", "affinity"};
+    LOG_INFO("%s (%s): threads=%d [%d, %d] backlog=%llu wait=%lluus util=%d%% grows=%llu shrinks=%llu overflows=%llu wakeups=%llu dropped=%llu",
+             m_name, modes[m_sched_mode], m_live.load(), m_thread_number, m_max_threads, (unsigned long long)backlog(),
+             (unsigned long long)m_last_wait_us.load(), m_last_util.load(), (unsigned long long)m_grows.load(),
+             (unsigned long long)m_shrinks.load(), (unsigned long long)m_overflows.load(),
+             (unsigned long long)wakeups(), (unsigned long long)dropped());
+
+    /* 排队时间直方图，只输出非空的桶 */
+    char hist[WAIT_BUCKETS * 32];
+    int len = 0;
+    for (int b = 0; b < WAIT_BUCKETS; ++b)
+    {
+        uint64_t n = 0;
+        for (int i = 0; i < m_max_threads; ++i)
+            n += m_slots[i].wait_hist[b].load(std::memory_order_relaxed);
+        if (n)
+            len += snprintf(hist + len, sizeof(hist) - len, " %s%lluus=%llu", b + 1 < WAIT_BUCKETS ? "<" : ">=",
+                            b + 1 < WAIT_BUCKETS ? 1ull << b : 1ull << (b - 1), (unsigned long long)n);
+    }
+    LOG_INFO("%s wait histogram:%s", m_name, len ? hist : " empty");
+    for (int i = 0; i < m_max_threads; ++i)
+    {
+        if (0 == m_slots[i].executed.load() && i >= m_target.load())
+            continue;
+        LOG_INFO("%s worker %d: submitted=%llu stolen=%llu executed=%llu dropped=%llu queued=%llu", m_name, i,
+                 (unsigned long long)m_slots[i].submitted.load(), (unsigned long long)m_slots[i].stolen.load(),
+                 (unsigned long long)m_slots[i].executed.load(), (unsigned long long)m_slots[i].dropped.load(),
+                 (unsigned long long)m_slots[i].deque.size());
+    }
+}
+
+template <typename T>
+void threadpool<T>::placement()
+{
+    if (!m_pinned)
+    {
+        LOG_INFO("%s placement: %d workers not pinned", m_name, m_live.load());
+        return;
+    }
+    int target = m_target.load();
+    for (int i = 0; i < target; ++i)
+    {
+        vector<int> cpus;
+        cpu_affinity::allowed(m_threads[i], cpus);
+        LOG_INFO("%s worker %d: cpu=%d node=%d allowed=%s", m_name, i, m_slots[i].cpu, cpu_affinity::node_of(m_slots[i].cpu),
+                 cpu_affinity::format(cpus).c_str());
+    }
+}
+
+template <typename T>
+void threadpool<T>::expire(T *request)
+{
+    if (1 == m_actor_model)
+    {
+        /* 按读写失败处理，主线程随后关闭连接 */
+        request->improv = 1;
+        request->timer_flag = 1;
+    }
+    else
+    {
+        request->drop();
+    }
+}
+
+/**
+ * @brief 取出任务并执行
+ */
+template <typename T>
+void threadpool<T>::run(worker_slot &slot)
+{
+    int idx = slot.idx;
+    unsigned seed = idx + 1;
+    while (true)
+    {
+        // 取出任务，并从任务队列中弹出；返回NULL表示该线程被缩容
+        T *request = take(idx, seed);
         if (!request)
+            break;
+        uint64_t start = now_ns();
+        uint64_t wait = start - request->m_enqueue_ns;
+        uint64_t wait_us = wait / 1000;
+        int bucket = wait_us ? 64 - __builtin_clzll(wait_us) : 0;
+        slot.wait_hist[bucket < WAIT_BUCKETS ? bucket : WAIT_BUCKETS - 1].fetch_add(1, std::memory_order_relaxed);
+        uint64_t recent = slot.recent_wait_ns.load(std::memory_order_relaxed);
+        slot.recent_wait_ns.store(recent - recent / 8 + wait / 8, std::memory_order_relaxed);
+        if (request->m_deadline_ns && start > request->m_deadline_ns)
+        {
+            /* 客户端多半已经放弃，连接定时器也快到期，不值得再解析请求和查询数据库 */
+            expire(request);
+            slot.dropped.fetch_add(1, std::memory_order_relaxed);
             continue;
+        }
+        slot.wait_ns.fetch_add(wait, std::memory_order_relaxed);
+        slot.busy_since.store(start, std::memory_order_relaxed);
         if (1 == m_actor_model){
             /* 默认m_actor_model为1，即为proactor模式 */
             if (0 == request->m_state)
@@ -151,7 +855,10 @@ void threadpool<T>::run()
                 {
                     /* 如果数据读取完毕 */
                     request->improv = 1;
-                    /* 获取一个mysql句柄放入request->mysql*/
+                    /* 获取一个mysql句柄放入request->mysql；没有连接池的线程池清空句柄，
+                       不让请求用上连接在之前请求中借用、已经归还的连接 */
+                    if (!m_connPool)
+                        request->mysql = NULL;
                     connectionRAII mysqlcon(&request->mysql, m_connPool);
                     request->process();
                 }
@@ -177,9 +884,17 @@ void threadpool<T>::run()
         }
         else
         {
+            if (!m_connPool)
+                request->mysql = NULL;
             connectionRAII mysqlcon(&request->mysql, m_connPool);
             request->process();
         }
+        slot.busy_ns.fetch_add(now_ns() - start, std::memory_order_relaxed);
+        slot.busy_since.store(0, std::memory_order_relaxed);
+        slot.executed.fetch_add(1, std::memory_order_relaxed);
     }
+    m_live--;
+    /* 自己队列里剩下的任务要由其他线程窃取，唤醒它们 */
+    wake_all();
 }
 #endif
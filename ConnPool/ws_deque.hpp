@@ -0,0 +1,94 @@
+#ifndef WS_DEQUE_H
+#define WS_DEQUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <exception>
+#include <stdlib.h>
+#include "mpmc_queue.hpp"
+#include "../Server/cpu_affinity.hpp"
+
+/**
+ * @brief 固定容量的Chase-Lev工作窃取双端队列。
+ *        拥有者从底部push，窃取者在顶部用CAS竞争取走元素。
+ *        线程池中拥有者是主线程(事件循环)：它只负责分派，不从队列中取任务，
+ *        因此所属工作线程与其他空闲线程都通过steal从顶部取，所属线程取到的顺序就是提交顺序。
+ */
+template <typename T>
+class ws_deque
+{
+public:
+    ws_deque() : m_top(0), m_bottom(0), m_buffer(NULL), m_mask(0), m_limit(0) {}
+    ~ws_deque() { free(m_buffer); }
+
+    /**
+     * @param limit 允许同时存在的最大元素数
+     * @param node 缓冲区所在的NUMA节点，-1表示由首次访问的线程决定
+     */
+    void init(size_t limit, int node = -1)
+    {
+        if (0 == limit)
+            throw std::exception();
+        size_t cap = 1;
+        while (cap < limit)
+            cap <<= 1;
+        /* 缓冲区按页对齐且在设置内存策略前不访问，页面在首次写入时直接分配在指定节点上 */
+        m_buffer = (std::atomic<T> *)cpu_affinity::alloc_pages(cap * sizeof(std::atomic<T>));
+        if (!m_buffer)
+            throw std::exception();
+        if (node >= 0)
+            cpu_affinity::bind(m_buffer, cap * sizeof(std::atomic<T>), node);
+        m_mask = cap - 1;
+        m_limit = limit;
+    }
+
+    /* 只能由拥有者调用 */
+    bool push(const T &item)
+    {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        if (b - t >= (int64_t)m_limit)
+            return false;
+        m_buffer[b & m_mask].store(item, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /* 任意线程可调用，CAS失败说明被别的线程抢先，重新读取后再试 */
+    bool steal(T &item)
+    {
+        while (true)
+        {
+            int64_t t = m_top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = m_bottom.load(std::memory_order_acquire);
+            if (t >= b)
+                return false;
+            item = m_buffer[t & m_mask].load(std::memory_order_relaxed);
+            if (m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                return true;
+        }
+    }
+
+    size_t size() const
+    {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        return b > t ? b - t : 0;
+    }
+
+private:
+    /* 下面两个函数，禁止对象拷贝、赋值 */
+    ws_deque(const ws_deque &);
+    ws_deque &operator=(const ws_deque &);
+
+    alignas(CACHE_LINE) std::atomic<int64_t> m_top;
+    alignas(CACHE_LINE) std::atomic<int64_t> m_bottom;
+    std::atomic<T> *m_buffer;
+    size_t m_mask;
+    size_t m_limit;
+};
+
+#endif
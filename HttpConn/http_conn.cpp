@@ -14,41 +14,11 @@ const char *error_404_form = "The requested file was not found on this server.\n
 const char *error_500_title = "Internal Error";
 const char *error_500_form = "There was an unusual problem serving the request file.\n";
 
-locker m_lock;
-map<string, string> users;
-
-/**
- * @brief 将数据库中所有的用户名和密码都放入哈希表user中
- * @return null
- */
-void http_conn::initmysql_result(connection_pool *connPool)
+static uint64_t mono_ns()
 {
-    //先从连接池中取一个连接
-    MYSQL *mysql = NULL;
-    connectionRAII mysqlcon(&mysql, connPool);
-
-    //在user表中检索username，passwd数据，浏览器端输入
-    if (mysql_query(mysql, "SELECT username,passwd FROM user"))
-    {
-        LOG_ERROR("SELECT error:%s\n", mysql_error(mysql));
-    }
-
-    //从表中检索完整的结果集
-    MYSQL_RES *result = mysql_store_result(mysql);
-
-    //返回结果集中的列数
-    int num_fields = mysql_num_fields(result);
-
-    //返回所有字段结构的数组
-    MYSQL_FIELD *fields = mysql_fetch_fields(result);
-
-    //从结果集中获取下一行，将对应的用户名和密码，存入map中
-    while (MYSQL_ROW row = mysql_fetch_row(result))
-    {
-        string temp1(row[0]);
-        string temp2(row[1]);
-        users[temp1] = temp2;
-    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
 }
 
 /**
@@ -139,6 +109,7 @@ void http_conn::init(int sockfd, const sockaddr_in &addr, char *root, int TRIGMo
     strcpy(sql_passwd, passwd.c_str());
     strcpy(sql_name, sqlname.c_str());
 
+    m_class = WORK_STATIC;
     init();
 }
 
@@ -162,6 +133,18 @@ void http_conn::init()
     m_state = 0;
     timer_flag = 0;
     improv = 0;
+    m_deadline_ns = 0;
+    m_dropped = false;
+    m_agent = 0;
+    m_referer = 0;
+    m_path[0] = '\0';
+    m_status = 0;
+    m_first_ns = 0;
+    m_handle_ns = 0;
+    m_done_ns = 0;
+    m_queue_ns = 0;
+    m_parse_ns = 0;
+    m_handler_ns = 0;
 
     memset(m_read_buf, '\0', READ_BUFFER_SIZE);
     memset(m_write_buf, '\0', WRITE_BUFFER_SIZE);
@@ -229,6 +212,8 @@ bool http_conn::read_once()
         {
             return false;
         }
+        if (!m_first_ns)
+            m_first_ns = mono_ns();
 
         return true;
     }
@@ -251,6 +236,8 @@ bool http_conn::read_once()
                 return false;
             }
             m_read_idx += bytes_read;
+            if (!m_first_ns)
+                m_first_ns = mono_ns();
         }
         return true;
     }
@@ -348,9 +335,19 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text)
         text += strspn(text, " \t");
         m_host = text;
     }
+    else if (strncasecmp(text, "User-Agent:", 11) == 0)
+    {
+        text += 11;
+        m_agent = text + strspn(text, " \t");
+    }
+    else if (strncasecmp(text, "Referer:", 8) == 0)
+    {
+        text += 8;
+        m_referer = text + strspn(text, " \t");
+    }
     else
     {
-        LOG_INFO("oop!unknow header: %s", text);
+        LOG_EVERY_MS(INFO, 1000, "oop!unknow header: %s", text);
     }
     return NO_REQUEST;
 }
@@ -379,7 +376,8 @@ http_conn::HTTP_CODE http_conn::process_read()
     {
         text = get_line();
         m_start_line = m_checked_idx;
-        LOG_INFO("%s", text);
+        //每个请求的每一行都会经过这里，每秒最多记一行
+        LOG_EVERY_MS(INFO, 1000, "%s", text);
         switch (m_check_state)
         {
         case CHECK_STATE_REQUESTLINE: /*第一个状态，分析请求行*/
@@ -417,6 +415,9 @@ http_conn::HTTP_CODE http_conn::process_read()
 
 http_conn::HTTP_CODE http_conn::do_request()
 {
+    m_handle_ns = mono_ns();
+    if (access_log::ins()->on())
+        snprintf(m_path, sizeof(m_path), "%s", m_url);
     /* 先给m_real_file加上根地址 */
     strcpy(m_real_file, doc_root);
     int len = strlen(doc_root);
@@ -451,38 +452,19 @@ http_conn::HTTP_CODE http_conn::do_request()
 
         if (*(p + 1) == '3')
         {
-            /* 如果是注册，先检测数据库中是否有重名的，没有重名的，进行增加数据 */
-            char *sql_insert = (char *)malloc(sizeof(char) * 200);
-            strcpy(sql_insert, "INSERT INTO user(username, passwd) VALUES(");
-            strcat(sql_insert, "'");
-            strcat(sql_insert, name);
-            strcat(sql_insert, "', '");
-            strcat(sql_insert, password);
-            strcat(sql_insert, "')");
-
-            if (users.find(name) == users.end())
-            {
-                m_lock.lock();
-                int res = mysql_query(mysql, sql_insert);
-                users.insert(pair<string, string>(name, password));
-                m_lock.unlock();
-
-                if (!res) {
-                    strcpy(m_url, "/log.html");
-                } else {
-                    /* 注册失败显示错误页面 */
-                    strcpy(m_url, "/registerError.html");
-                }
-                    
-            }
+            /* 如果是注册，先检测是否有重名的，没有重名的，进行增加数据 */
+            if (user_store::INSERT_OK == user_store::GetInstance()->insert(name, password, mysql))
+                strcpy(m_url, "/log.html");
             else
+                /* 注册失败显示错误页面 */
                 strcpy(m_url, "/registerError.html");
         }
         //如果是登录，直接判断
         //若浏览器端输入的用户名和密码在表中可以查找到，返回1，否则返回0
         else if (*(p + 1) == '2')
         {
-            if (users.find(name) != users.end() && users[name] == password) {
+            string stored;
+            if (user_store::GetInstance()->find(name, stored, mysql) && stored == password) {
                 strcpy(m_url, "/welcome.html");
             } else {
                 /* 注册失败显示错误页面 */
@@ -559,15 +541,25 @@ void http_conn::unmap()
     }
 }
 
+void http_conn::drop()
+{
+    m_dropped = true;
+    modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+}
+
 bool http_conn::write()
 {
     int temp = 0;
 
+    if (m_dropped)
+        return false;
+
     // 如果没有任何需要传输的树，就直接重置链接。
     if (bytes_to_send == 0)
     {
         // 将m_sockfd设置成EPOLLOUT，表示当前文件描述符可读，后续websever会跳转到读
         modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
+        log_access();
         init();
         return true;
     }
@@ -587,6 +579,8 @@ bool http_conn::write()
                 modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
                 return true;
             }
+            /* 发送出错时也记录，字节数为实际发出的部分 */
+            log_access();
             unmap();
             return false;
         }
@@ -608,6 +602,7 @@ bool http_conn::write()
         // 发送完毕
         if (bytes_to_send <= 0)
         {
+            log_access();
             unmap();
             modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
 
@@ -640,19 +635,26 @@ bool http_conn::add_response(const char *format, ...)
     m_write_idx += len;
     va_end(arg_list);
 
-    LOG_INFO("request:%s", m_write_buf);
+    LOG_EVERY_MS(INFO, 1000, "request:%s", m_write_buf);
 
     return true;
 }
 bool http_conn::add_status_line(int status, const char *title)
 {
+    m_status = status;
     return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
 }
 bool http_conn::add_headers(int content_len)
 {
-    return add_content_length(content_len) && add_linger() &&
+    return add_date() && add_content_length(content_len) && add_linger() &&
            add_blank_line();
 }
+bool http_conn::add_date()
+{
+    clock_snapshot now;
+    coarse_clock::ins()->read(&now);
+    return add_response("Date:%s\r\n", now.http_date);
+}
 bool http_conn::add_content_length(int content_len)
 {
     return add_response("Content-Length:%d\r\n", content_len);
@@ -737,18 +739,127 @@ bool http_conn::process_write(HTTP_CODE ret)
     return true;
 }
 
+int http_conn::classify(const char *buf, int len)
+{
+    /* 解析过的请求行中空白会被改写成'\0'，一并视为分隔符 */
+    const char *end = buf + len;
+    const char *p = buf;
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\0')
+        ++p;
+    if (p == end)
+        return -1;
+    bool post;
+    if (p - buf == 3 && strncasecmp(buf, "GET", 3) == 0)
+        post = false;
+    else if (p - buf == 4 && strncasecmp(buf, "POST", 4) == 0)
+        post = true;
+    else
+        return -1;
+
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\0'))
+        ++p;
+    const char *url = p;
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\0' && *p != '\r' && *p != '\n')
+        ++p;
+    if (p == end)
+        return -1;
+    const char *url_end = p;
+    if (url_end - url > 7 && strncasecmp(url, "http://", 7) == 0)
+        url = (const char *)memchr(url + 7, '/', url_end - url - 7);
+    else if (url_end - url > 8 && strncasecmp(url, "https://", 8) == 0)
+        url = (const char *)memchr(url + 8, '/', url_end - url - 8);
+    if (!url)
+        return WORK_STATIC;
+
+    if (url_end - url >= 6 && strncmp(url, "/admin", 6) == 0)
+        return WORK_ADMIN;
+
+    /* do_request：POST且最后一段以2(登录)或3(注册)开头时访问用户存储 */
+    const char *last = url;
+    for (const char *q = url; q < url_end; ++q)
+        if (*q == '/')
+            last = q;
+    if (post && last + 1 < url_end && (last[1] == '2' || last[1] == '3'))
+        return WORK_DB;
+    return WORK_STATIC;
+}
+
+int http_conn::work_class()
+{
+    int cls = classify(m_read_buf, m_read_idx);
+    if (cls >= 0)
+        m_class = cls;
+    return m_class;
+}
+
+int http_conn::phase() const
+{
+    if (bytes_to_send > 0)
+        return PHASE_WRITE;
+    if (CHECK_STATE_CONTENT == m_check_state)
+        return PHASE_BODY;
+    return m_read_idx > 0 ? PHASE_HEADER : PHASE_IDLE;
+}
+
 void http_conn::process()
 {
+    /* 请求可能分几次读完，排队和解析的时间逐次累加 */
+    uint64_t begin = mono_ns();
+    if (m_enqueue_ns && m_enqueue_ns < begin)
+    {
+        m_queue_ns += begin - m_enqueue_ns;
+        /* reactor模式下先排队再读，总耗时从入队算起 */
+        if (!m_first_ns || m_enqueue_ns < m_first_ns)
+            m_first_ns = m_enqueue_ns;
+    }
+    m_handle_ns = 0;
+
+    /* reactor模式下请求由工作线程读入，记录类别供该连接下一次分派使用 */
+    work_class();
     HTTP_CODE read_ret = process_read();
+    uint64_t parsed = m_handle_ns ? m_handle_ns : mono_ns();
+    m_parse_ns += parsed - begin;
     if (read_ret == NO_REQUEST)
     {
         modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
         return;
     }
     bool write_ret = process_write(read_ret);
+    m_done_ns = mono_ns();
+    m_handler_ns = m_done_ns - parsed;
     if (!write_ret)
     {
         close_conn();
     }
     modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
 }
+
+void http_conn::log_access()
+{
+    /* 只记录生成过响应的请求，每个请求只记录一次 */
+    access_log *log = access_log::ins();
+    if (!log->on() || !m_done_ns)
+        return;
+
+    uint64_t now = mono_ns();
+    clock_snapshot clk;
+    coarse_clock::ins()->read(&clk);
+
+    access_record rec;
+    rec.real_ms = clk.real_ms;
+    rec.addr = m_address.sin_addr.s_addr;
+    rec.method = POST == m_method ? "POST" : "GET";
+    rec.status = m_status;
+    rec.keep_alive = m_linger;
+    rec.bytes = bytes_have_send;
+    rec.queue_us = m_queue_ns / 1000;
+    rec.parse_us = m_parse_ns / 1000;
+    rec.handler_us = m_handler_ns / 1000;
+    rec.write_us = m_done_ns ? (now - m_done_ns) / 1000 : 0;
+    rec.total_us = m_first_ns ? (now - m_first_ns) / 1000 : 0;
+    snprintf(rec.path, sizeof(rec.path), "%s", m_path[0] ? m_path : "-");
+    snprintf(rec.referer, sizeof(rec.referer), "%s", m_referer ? m_referer : "");
+    snprintf(rec.agent, sizeof(rec.agent), "%s", m_agent ? m_agent : "");
+    log->record(rec);
+    m_done_ns = 0;
+}
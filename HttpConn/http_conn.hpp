@@ -23,8 +23,11 @@
 
 #include "../Lock/locker.hpp"
 #include "../ConnPool/sql_connection_pool.hpp"
+#include "../ConnPool/bulkhead.hpp"
+#include "../UserStore/user_store.hpp"
 #include "../Timer/timer.hpp"
 #include "../Log/log.hpp"
+#include "../Log/access_log.hpp"
 
 class http_conn
 {
@@ -74,6 +77,15 @@ public:
         LINE_BAD,
         LINE_OPEN
     };
+    /*连接所处的阶段，各阶段有各自的超时时间*/
+    enum CONN_PHASE
+    {
+        PHASE_IDLE = 0, //keep-alive空闲，还没有收到下一个请求的数据
+        PHASE_HEADER,   //正在接收请求行和头部
+        PHASE_BODY,     //头部已解析完，正在接收请求体
+        PHASE_WRITE,    //正在发送响应
+        PHASE_NUM
+    };
 
 public:
     http_conn() {}
@@ -111,11 +123,28 @@ public:
      *        使用writev函数同时发送应答报文的首部字段和请求内容
      */
     bool write();
+
+    /**
+     * @brief 请求在队列中等到超过截止时间，不再处理：重新注册EPOLLOUT让主线程醒来，
+     *        随后的write()返回失败，由主线程按写失败关闭连接(proactor模式下使用)
+     */
+    void drop();
     sockaddr_in *get_address()
     {
         return &m_address;
     }
-    void initmysql_result(connection_pool *connPool);
+
+    /**
+     * @brief 根据读缓冲区中的请求行判断请求的工作类别(见WORK_CLASS)，规则与do_request一致；
+     *        缓冲区中还没有可识别的请求行时沿用该连接上一个请求的类别
+     */
+    int work_class();
+
+    /**
+     * @brief 根据读写缓冲区和解析状态判断连接所处的阶段(见CONN_PHASE)；
+     *        由主线程在该连接的事件中调用，此时没有工作线程在处理它
+     */
+    int phase() const;
     int timer_flag; // 这是个什么b玩意
     int improv;     // 这是个什么b玩意
 
@@ -132,6 +161,12 @@ private:
      */
     HTTP_CODE process_read();
 
+    /**
+     * @brief 只扫描请求行的方法和URL来判断工作类别，不修改缓冲区
+     * @return 缓冲区开头不是可识别的请求行时返回-1
+     */
+    static int classify(const char *buf, int len);
+
     /**
      * @brief 处理服务器将http应答报文发送给客户端的过程
      * @return 请求结果
@@ -192,10 +227,16 @@ private:
     bool add_status_line(int status, const char *title);
     bool add_headers(int content_length);
     bool add_content_type();
+    bool add_date();
     bool add_content_length(int content_length);
     bool add_linger();
     bool add_blank_line();
 
+    /**
+     * @brief 响应发送完毕或发送出错时，提交这个请求的访问记录
+     */
+    void log_access();
+
 public:
     /*所有socket上的事件都被注册到同一个epoll内核事件表中，所以将epoll文件描述符设置为静态的*/
     static int m_epollfd;
@@ -205,10 +246,18 @@ public:
     MYSQL *mysql;
     /* 读为0, 写为1 */
     int m_state; 
+    /* 放入线程池队列的时间，用于统计排队时间 */
+    uint64_t m_enqueue_ns;
+    /* 排队的截止时间(CLOCK_MONOTONIC纳秒)，工作线程取到时已超过则直接丢弃，0表示不限 */
+    uint64_t m_deadline_ns;
+    /* 该连接最近一个请求的工作类别 */
+    int m_class;
 
 private:
     /*该HTTP连接的socket和对方的socket地址*/    
     int m_sockfd;
+    /*当前请求已因超过截止时间被丢弃*/
+    bool m_dropped;
     sockaddr_in m_address;
     /*读缓冲区*/
     char m_read_buf[READ_BUFFER_SIZE];
@@ -263,6 +312,18 @@ private:
     /* 标志位：是否关闭日志 */
     int m_close_log;
 
+    /* 访问日志用到的请求信息和各阶段耗时(CLOCK_MONOTONIC纳秒) */
+    char* m_agent;          /* User-Agent，指向读缓冲区 */
+    char* m_referer;        /* Referer，指向读缓冲区 */
+    char m_path[128];       /* 请求的路径，do_request会改写m_url，先留一份 */
+    int m_status;           /* 响应的状态码 */
+    uint64_t m_first_ns;    /* 读到请求第一个字节的时间 */
+    uint64_t m_handle_ns;   /* 请求解析完、开始处理的时间 */
+    uint64_t m_done_ns;     /* 响应生成完、开始发送的时间 */
+    uint64_t m_queue_ns;
+    uint64_t m_parse_ns;
+    uint64_t m_handler_ns;
+
     char sql_user[100];
     char sql_passwd[100];
     char sql_name[100];
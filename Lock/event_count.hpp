@@ -0,0 +1,84 @@
+#ifndef EVENT_COUNT_H
+#define EVENT_COUNT_H
+
+#include <stdint.h>
+#include <unistd.h>
+#include <limits.h>
+#include <atomic>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/**
+ * @brief 基于futex的事件计数，配合无锁队列让空闲线程休眠。
+ *        消费者：key = prepare_wait(); 再检查一次队列；仍为空则wait(key)，否则cancel_wait()。
+ *        生产者：入队后调用notify_one()，没有线程在休眠时只有一次原子读，不进入内核。
+ */
+class event_count
+{
+public:
+    event_count() : m_epoch(0), m_waiters(0), m_wakes(0) {}
+
+    uint32_t prepare_wait()
+    {
+        m_waiters.fetch_add(1);
+        /* 与notify中的屏障配对：要么消费者看到新入队的元素，要么生产者看到等待者 */
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return m_epoch.load(std::memory_order_acquire);
+    }
+
+    void cancel_wait()
+    {
+        m_waiters.fetch_sub(1);
+    }
+
+    /* epoch在prepare_wait之后已经变化时futex立即返回，不会错过唤醒 */
+    void wait(uint32_t key)
+    {
+        if (m_epoch.load(std::memory_order_acquire) == key)
+            syscall(SYS_futex, &m_epoch, FUTEX_WAIT_PRIVATE, key, NULL, NULL, 0);
+        m_waiters.fetch_sub(1);
+    }
+
+    void notify_one()
+    {
+        notify(1);
+    }
+
+    void notify_all()
+    {
+        notify(INT_MAX);
+    }
+
+    /* 唤醒最多n个线程：批量入队n个元素后调用一次，而不是调用n次notify_one */
+    void notify(int n)
+    {
+        if (n <= 0)
+            return;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (0 == m_waiters.load(std::memory_order_relaxed))
+            return;
+        m_epoch.fetch_add(1, std::memory_order_release);
+        syscall(SYS_futex, &m_epoch, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+        m_wakes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    int waiters() const
+    {
+        return m_waiters.load(std::memory_order_relaxed);
+    }
+
+    /* 进入内核的唤醒次数 */
+    uint64_t wakes() const
+    {
+        return m_wakes.load(std::memory_order_relaxed);
+    }
+
+private:
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be 32 bits");
+
+    std::atomic<uint32_t> m_epoch; //futex字，每次唤醒加1
+    std::atomic<int> m_waiters;    //正在或准备休眠的线程数
+    std::atomic<uint64_t> m_wakes; //futex唤醒的系统调用次数
+};
+
+#endif
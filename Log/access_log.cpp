@@ -0,0 +1,208 @@
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include "access_log.hpp"
+#include "log.hpp"
+
+#define ACCESS_QUEUE_LEN 8192   // 队列最多积压的记录数
+#define ACCESS_WAIT_MS 200      // 后台线程没有被唤醒时，最多等这么久写一次
+
+static void* access_thdo(void* args)
+{
+    access_log::ins()->persist();
+    return NULL;
+}
+
+access_log::access_log()
+    : m_format(ACCESS_OFF), m_queue(NULL), m_pending(0), m_written(0), m_dropped(0), m_efd(-1),
+      m_fp(NULL), m_year(0), m_mon(0), m_day(0), m_sec(-1)
+{
+    m_dir[0] = '\0';
+    m_date[0] = '\0';
+}
+
+access_log* access_log::ins()
+{
+    static access_log log;
+    return &log;
+}
+
+void access_log::init(const char* log_dir, int format)
+{
+    if (format <= ACCESS_OFF || format > ACCESS_JSON)
+        return;
+    m_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_efd < 0)
+    {
+        LOG_ERROR("access log eventfd error: %s", strerror(errno));
+        return;
+    }
+    strncpy(m_dir, log_dir, sizeof(m_dir) - 1);
+    mkdir(m_dir, 0777);
+    m_queue = new mpmc_queue<access_record>(ACCESS_QUEUE_LEN);
+    m_format = format;
+
+    pthread_t tid;
+    pthread_create(&tid, NULL, access_thdo, NULL);
+    pthread_detach(tid);
+}
+
+void access_log::record(const access_record& rec)
+{
+    if (!m_queue->push(rec))
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    /* 积压到队列的1/4时提前唤醒后台线程，否则由它按ACCESS_WAIT_MS自己醒来 */
+    if (m_pending.fetch_add(1, std::memory_order_relaxed) + 1 == ACCESS_QUEUE_LEN / 4)
+    {
+        uint64_t one = 1;
+        ssize_t ret = write(m_efd, &one, sizeof(one));
+        (void)ret;
+    }
+}
+
+void access_log::persist()
+{
+    struct pollfd pfd;
+    pfd.fd = m_efd;
+    pfd.events = POLLIN;
+    access_record rec;
+    char line[4096];
+    while (true)
+    {
+        if (poll(&pfd, 1, ACCESS_WAIT_MS) > 0)
+        {
+            uint64_t cnt;
+            while (read(m_efd, &cnt, sizeof(cnt)) > 0)
+            {
+            }
+        }
+        m_pending.store(0, std::memory_order_relaxed);
+
+        clock_snapshot now;
+        coarse_clock::ins()->read(&now);
+        if (!decis_file(now.year, now.mon, now.day))
+            continue;
+        uint64_t n = 0;
+        while (m_queue->pop(rec))
+        {
+            fwrite(line, 1, format(rec, line, sizeof(line)), m_fp);
+            ++n;
+        }
+        if (n)
+        {
+            fflush(m_fp);
+            m_written.fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+}
+
+void access_log::report()
+{
+    if (!on())
+        return;
+    LOG_INFO("access log: written=%llu dropped=%llu queued=%zu",
+             (unsigned long long)m_written.load(std::memory_order_relaxed),
+             (unsigned long long)m_dropped.load(std::memory_order_relaxed), m_queue->size());
+}
+
+bool access_log::decis_file(int year, int mon, int day)
+{
+    if (m_fp && m_day == day && m_mon == mon && m_year == year)
+        return true;
+    if (m_fp)
+        fclose(m_fp);
+    char path[768];
+    snprintf(path, sizeof(path), "%s/access.%d%02d%02d.%u.log", m_dir, year, mon, day, (unsigned)getpid());
+    m_fp = fopen(path, "a");
+    m_year = year, m_mon = mon, m_day = day;
+    return m_fp != NULL;
+}
+
+/* 把字符串写成引号内的内容：JSON按JSON的规则转义，其余格式与Apache一样把引号、反斜杠和控制字符写成\xHH */
+static char* put_escaped(char* p, char* end, const char* s, bool json)
+{
+    for (; *s && end - p > 6; ++s)
+    {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+        {
+            if (json)
+            {
+                *p++ = '\\';
+                *p++ = c;
+            }
+            else
+                p += sprintf(p, "\\x%02x", c);
+        }
+        else if (c < 0x20 || c == 0x7f)
+            p += sprintf(p, json ? "\\u%04x" : "\\x%02x", c);
+        else
+            *p++ = c;
+    }
+    return p;
+}
+
+int access_log::format(const access_record& rec, char* buf, int len)
+{
+    time_t sec = rec.real_ms / 1000;
+    if (sec != m_sec)
+    {
+        struct tm tm;
+        localtime_r(&sec, &tm);
+        if (ACCESS_JSON == m_format)
+        {
+            /* RFC 3339，时区写成+08:00，毫秒在格式化记录时插入 */
+            char zone[8];
+            strftime(zone, sizeof(zone), "%z", &tm);
+            int n = strftime(m_date, sizeof(m_date), "%Y-%m-%dT%H:%M:%S", &tm);
+            snprintf(m_date + n, sizeof(m_date) - n, "%.3s:%.2s", zone, zone + 3);
+        }
+        else
+            strftime(m_date, sizeof(m_date), "%d/%b/%Y:%H:%M:%S %z", &tm);
+        m_sec = sec;
+    }
+
+    char ip[INET_ADDRSTRLEN];
+    struct in_addr addr;
+    addr.s_addr = rec.addr;
+    inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+
+    char* p = buf;
+    char* end = buf + len - 256; /* 留出各字符串字段之后定长字段的空间 */
+    if (ACCESS_JSON == m_format)
+    {
+        p += sprintf(p, "{\"time\":\"%.19s.%03d%s\",\"client\":\"%s\",\"method\":\"%s\",\"path\":\"", m_date,
+                     (int)(rec.real_ms % 1000), m_date + 19, ip, rec.method);
+        p = put_escaped(p, end, rec.path, true);
+        p += sprintf(p, "\",\"status\":%d,\"bytes\":%llu,\"keep_alive\":%s,\"referer\":\"", rec.status,
+                     (unsigned long long)rec.bytes, rec.keep_alive ? "true" : "false");
+        p = put_escaped(p, end, rec.referer, true);
+        p += sprintf(p, "\",\"user_agent\":\"");
+        p = put_escaped(p, end, rec.agent, true);
+        p += sprintf(p, "\",\"queue_us\":%u,\"parse_us\":%u,\"handler_us\":%u,\"write_us\":%u,\"total_us\":%u}\n",
+                     rec.queue_us, rec.parse_us, rec.handler_us, rec.write_us, rec.total_us);
+        return p - buf;
+    }
+
+    p += sprintf(p, "%s - - [%s] \"%s ", ip, m_date, rec.method);
+    p = put_escaped(p, end, rec.path, false);
+    p += sprintf(p, " HTTP/1.1\" %d %llu", rec.status, (unsigned long long)rec.bytes);
+    if (ACCESS_COMBINED == m_format)
+    {
+        p += sprintf(p, " \"");
+        p = put_escaped(p, end, rec.referer[0] ? rec.referer : "-", false);
+        p += sprintf(p, "\" \"");
+        p = put_escaped(p, end, rec.agent[0] ? rec.agent : "-", false);
+        *p++ = '"';
+    }
+    p += sprintf(p, " keepalive=%d queue=%uus parse=%uus handler=%uus write=%uus total=%uus\n", rec.keep_alive,
+                 rec.queue_us, rec.parse_us, rec.handler_us, rec.write_us, rec.total_us);
+    return p - buf;
+}
@@ -0,0 +1,102 @@
+#ifndef __ACCESS_LOG_H__
+#define __ACCESS_LOG_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <atomic>
+#include "../ConnPool/mpmc_queue.hpp"
+
+/* 访问日志的格式 */
+enum ACCESS_FORMAT
+{
+    ACCESS_OFF = 0,
+    ACCESS_COMMON,      /* Common Log Format，后面追加keep-alive和各阶段耗时 */
+    ACCESS_COMBINED,    /* Combined Log Format(多Referer和User-Agent)，后面追加keep-alive和各阶段耗时 */
+    ACCESS_JSON         /* 每行一个JSON对象 */
+};
+
+/* 一个请求的访问记录，请求完成时由处理它的线程填好，格式化留给后台线程 */
+struct access_record
+{
+    int64_t real_ms;        /* 请求完成的时间 */
+    uint32_t addr;          /* 客户端地址，网络字节序 */
+    const char* method;     /* 请求方法，指向字符串常量 */
+    int status;
+    int keep_alive;
+    uint64_t bytes;         /* 响应的字节数，含首部 */
+    uint32_t queue_us;      /* 在线程池队列中等待 */
+    uint32_t parse_us;      /* 解析请求 */
+    uint32_t handler_us;    /* 处理请求并生成响应 */
+    uint32_t write_us;      /* 发送响应 */
+    uint32_t total_us;      /* 从读到请求的第一个字节到响应发送完 */
+    char path[128];
+    char referer[128];
+    char agent[160];
+};
+
+/**
+ * @brief 访问日志：每个完成的请求一条记录，与调试日志(ring_log)分开写到access.yyyymmdd.pid.log。
+ *        请求线程只把定长的原始字段放入无锁队列，格式化和写文件都在后台线程；
+ *        队列满时丢弃记录并计数，不阻塞请求。
+ */
+class access_log
+{
+public:
+    static access_log* ins();
+
+    /**
+     * @brief 打开日志文件并启动后台线程
+     * @param format 见ACCESS_FORMAT，ACCESS_OFF时什么也不做
+     */
+    void init(const char* log_dir, int format);
+
+    bool on() const { return m_format != ACCESS_OFF; }
+
+    /**
+     * @brief 提交一条记录，由请求线程调用
+     */
+    void record(const access_record& rec);
+
+    /**
+     * @brief 把队列中的记录格式化写入文件，由后台线程循环调用
+     */
+    void persist();
+
+    /**
+     * @brief 写出的和丢弃的记录数写入调试日志，由主线程定时调用
+     */
+    void report();
+
+private:
+    access_log();
+
+    access_log(const access_log&);
+    access_log& operator=(const access_log&);
+
+    /**
+     * @brief 格式化一条记录
+     * @return 写入buf的长度
+     */
+    int format(const access_record& rec, char* buf, int len);
+
+    /**
+     * @brief 按天切换日志文件
+     */
+    bool decis_file(int year, int mon, int day);
+
+    int m_format;
+    mpmc_queue<access_record>* m_queue; /* 开启访问日志时才在init中分配 */
+    std::atomic<uint32_t> m_pending;    /* 上次唤醒后台线程以来提交的记录数 */
+    std::atomic<uint64_t> m_written;
+    std::atomic<uint64_t> m_dropped;
+    int m_efd;                          /* 积压较多时唤醒后台线程 */
+
+    FILE* m_fp;
+    char m_dir[512];
+    int m_year, m_mon, m_day;
+    time_t m_sec;                       /* m_date对应的秒 */
+    char m_date[64];                    /* 当前秒的时间字符串，格式随m_format */
+};
+
+#endif
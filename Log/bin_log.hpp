@@ -0,0 +1,148 @@
+#ifndef __BIN_LOG_H__
+#define __BIN_LOG_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <type_traits>
+
+/*
+ * 二进制日志：调用处的级别、文件、行号、函数和格式串放在一个静态的格式描述里，每次调用只把描述的编号和
+ * 原始参数拷进缓冲区，不做格式化；后台线程把描述和记录写进.blog文件，由logDecode离线还原成文本日志。
+ *
+ * 缓冲区中的记录(log_record之后)：uint32 描述编号 | int64 real_ms | 参数...
+ * 每个参数按类型编码，类型在登记描述时记下：
+ *   'i' 整数、枚举、bool、char   int64
+ *   'f' 浮点                     double
+ *   'p' 其他指针                 uint64
+ *   's' 字符串                   uint32 长度 | 字节(不含'\0')
+ *
+ * .blog文件：magic "RINGBLG1" | uint32 pid，之后是一条条记录，每条以一个字节的类型开头：
+ *   'D' 格式描述  uint32 编号 | uint32 行号 | 级别、文件、函数、格式串、参数类型，各为 uint16 长度 | 字节
+ *   'L' 一条日志  uint32 线程id | uint32 长度 | 缓冲区中的记录
+ *   'T' 文本日志  uint32 长度 | 已格式化的文本
+ * 同一个文件里描述总是先于用到它的日志写入。
+ */
+
+#define BIN_LOG_MAGIC "RINGBLG1"
+
+enum BIN_LOG_KIND
+{
+    BIN_DESC = 'D',
+    BIN_LINE = 'L',
+    BIN_TEXT = 'T'
+};
+
+/* 一个调用处的静态格式描述，常量初始化，第一次调用时登记得到编号 */
+struct log_desc
+{
+    constexpr log_desc(const char* l, const char* f, int n, const char* fn, const char* s)
+        : lvl(l), file(f), line(n), func(fn), fmt(s), tags(NULL), id(0) {}
+
+    const char* lvl;
+    const char* file;
+    int line;
+    const char* func;
+    const char* fmt;
+    const char* tags;           /* 各参数的类型 */
+    std::atomic<uint32_t> id;   /* 从1开始，0表示尚未登记 */
+};
+
+/* 按类型写入一个参数，空间不够时字符串被截断，其他参数不再写入 */
+template <typename T, typename Enable = void>
+struct bin_arg;
+
+template <typename T>
+struct bin_arg<T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type>
+{
+    static const char tag = 'i';
+    static char* put(char* p, char* end, T v)
+    {
+        int64_t x = (int64_t)v;
+        if (end - p < (long)sizeof(x))
+            return end;
+        memcpy(p, &x, sizeof(x));
+        return p + sizeof(x);
+    }
+};
+
+template <typename T>
+struct bin_arg<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+    static const char tag = 'f';
+    static char* put(char* p, char* end, T v)
+    {
+        double x = v;
+        if (end - p < (long)sizeof(x))
+            return end;
+        memcpy(p, &x, sizeof(x));
+        return p + sizeof(x);
+    }
+};
+
+inline char* bin_put_str(char* p, char* end, const char* s, size_t n)
+{
+    if (end - p < (long)sizeof(uint32_t))
+        return end;
+    if (n > (size_t)(end - p) - sizeof(uint32_t))
+        n = (end - p) - sizeof(uint32_t);
+    uint32_t len = n;
+    memcpy(p, &len, sizeof(len));
+    memcpy(p + sizeof(len), s, n);
+    return p + sizeof(len) + n;
+}
+
+template <typename T>
+struct bin_arg<T*, typename std::enable_if<std::is_same<typename std::remove_cv<T>::type, char>::value>::type>
+{
+    static const char tag = 's';
+    static char* put(char* p, char* end, T* s)
+    {
+        if (!s)
+            return bin_put_str(p, end, "(null)", 6);
+        return bin_put_str(p, end, s, strlen(s));
+    }
+};
+
+template <typename T>
+struct bin_arg<T*, typename std::enable_if<!std::is_same<typename std::remove_cv<T>::type, char>::value>::type>
+{
+    static const char tag = 'p';
+    static char* put(char* p, char* end, T* v)
+    {
+        uint64_t x = (uintptr_t)v;
+        if (end - p < (long)sizeof(x))
+            return end;
+        memcpy(p, &x, sizeof(x));
+        return p + sizeof(x);
+    }
+};
+
+template <>
+struct bin_arg<std::string>
+{
+    static const char tag = 's';
+    static char* put(char* p, char* end, const std::string& s) { return bin_put_str(p, end, s.data(), s.size()); }
+};
+
+/* 参数类型串，每个调用处的参数类型组合一份 */
+template <typename... Args>
+struct bin_tags
+{
+    static constexpr char str[] = {bin_arg<Args>::tag..., '\0'};
+};
+
+template <typename... Args>
+constexpr char bin_tags<Args...>::str[];
+
+inline char* bin_put_args(char* p, char* /*end*/) { return p; }
+
+template <typename T, typename... Args>
+inline char* bin_put_args(char* p, char* end, const T& v, const Args&... args)
+{
+    p = bin_arg<T>::put(p, end, v);
+    return bin_put_args(p, end, args...);
+}
+
+#endif
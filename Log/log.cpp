@@ -2,53 +2,71 @@
 
 #include <assert.h>  //assert
 #include <errno.h>
+#include <poll.h>         //poll
 #include <stdarg.h>       //va_list
+#include <stddef.h>       //offsetof
+#include <sys/eventfd.h>  //eventfd
 #include <sys/stat.h>     //mkdir
 #include <sys/syscall.h>  //system call
 #include <unistd.h>       //access, getpid
 
-#define MEM_USE_LIMIT (3u * 1024 * 1024 * 1024)  // 3GB, 所有日志加起来最多MEM_USE_LIMIT字节
+#define LOG_MEM_DEFAULT (64ull * 1024 * 1024)    // 64MB, 所有线程的缓冲区加起来默认最多占用的内存
+#define LOG_MEM_MIN (4ull * 1024 * 1024)         // 4MB, 内存预算的下限
+#define LOG_MEM_MAX (3ull * 1024 * 1024 * 1024)  // 3GB, 内存预算的上限
+#define LOG_BUFF_MIN (64 * 1024)                 // 64KB, 缓冲区初始的大小
+#define LOG_BUFF_MAX (1024 * 1024)               // 1MB, 后台线程跟不上时新开的缓冲区逐次翻倍，最大到这里
+#define LOG_IDLE_MS 10000                        // 线程这么久没换过缓冲区就释放其多余的缓冲区
 #define LOG_USE_LIMIT (1u * 1024 * 1024 * 1024)  // 1GB, 一个日志文件最多LOG_USE_LIMIT字节
 #define LOG_LEN_LIMIT (4 * 1024)                 // 4K, 一行日志最多LOG_LEN_LIMIT字节
-#define RELOG_THRESOLD 5
+#define LOG_RESUME_MS 1000                       // 缓冲区这么久没有再用尽，认为溢出结束
+#define LOG_BLOCK_MS 10                          // OVERFLOW_BLOCK默认最多等待的毫秒数
+#define LOG_BLOCK_US 200                         // OVERFLOW_BLOCK等待时每次睡眠的微秒数
+#define LOG_SAMPLE_N 100                         // OVERFLOW_SAMPLE默认每100条尝试写1条
 #define BUFF_WAIT_TIME 1
+#define THREAD_BUFF_CNT 2                        // 每个线程初始的缓冲区个数
+#define DRAIN_LIMIT (8 * 1024 * 1024)            // 8MB, 后台线程一轮最多写出的字节数，之后换文件、回收、再继续
+
+static const char* overflow_names[] = {"drop", "block", "level", "sample"};
+
+/* 线程id在线程内不变，缓存起来，写日志时不必每次都发起系统调用 */
+static __thread pid_t t_tid = 0;
+/* 当前线程的缓冲区环 */
+static __thread log_ring* t_ring = NULL;
 
 pid_t gettid() {
-    return syscall(__NR_gettid);
+    if (!t_tid)
+        t_tid = syscall(__NR_gettid);
+    return t_tid;
 }
 
 pthread_mutex_t ring_log::_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t ring_log::_cond = PTHREAD_COND_INITIALIZER;
+pthread_key_t ring_log::_ring_key;
+std::atomic<int> ring_log::_level(INFO);
 
 ring_log* ring_log::_ins = NULL;
 pthread_once_t ring_log::_once = PTHREAD_ONCE_INIT;
-uint32_t ring_log::_one_buff_len = 30 * 1024 * 1024;  // 30MB
 
-/* 初始化，以及建立双向链表 */
-ring_log::ring_log()
-    : _buff_cnt(3),
-      _curr_buf(NULL),
-      _prst_buf(NULL),
-      _fp(NULL),
-      _log_cnt(0),
-      _env_ok(false),
-      _level(INFO),
-      _lst_lts(0),
-      _tm() {
-    /* 创建双向循环链表 */
-    cell_buffer* head = new cell_buffer(_one_buff_len);
-    if (!head) {
-        fprintf(stderr, "no space to allocate cell_buffer\n");
-        exit(1);
-    }
-    cell_buffer* current;
+/* 建立buff_cnt个缓冲区组成的双向循环链表 */
+log_ring::log_ring(pid_t t, uint32_t buff_len, int cnt)
+    : curr(NULL),
+      prst(NULL),
+      head(NULL),
+      buff_cnt(cnt),
+      bytes((uint64_t)buff_len * cnt),
+      grow_len(buff_len),
+      switch_ms(0),
+      full_ms(0),
+      drop_ms(0),
+      sample(0),
+      failed(false),
+      tid(t),
+      dead(false) {
+    pthread_mutex_init(&mutex, NULL);
+    memset(drops, 0, sizeof(drops));
+    head = new cell_buffer(buff_len);
     cell_buffer* prev = head;
-    for (int i = 1; i < _buff_cnt; ++i) {
-        current = new cell_buffer(_one_buff_len);
-        if (!current) {
-            fprintf(stderr, "no space to allocate cell_buffer\n");
-            exit(1);
-        }
+    for (int i = 1; i < cnt; ++i) {
+        cell_buffer* current = new cell_buffer(buff_len);
         current->prev = prev;
         prev->next = current;
         prev = current;
@@ -56,10 +74,47 @@ ring_log::ring_log()
     prev->next = head;
     head->prev = prev;
 
-    _curr_buf = head;
-    _prst_buf = head;
+    curr = head;
+    prst = head;
+    file.tid = t;
+}
+
+log_ring::~log_ring() {
+    cell_buffer* buf = head;
+    int cnt = buff_cnt.load(std::memory_order_relaxed);
+    for (int i = 0; i < cnt; ++i) {
+        cell_buffer* next = buf->next;
+        delete buf;
+        buf = next;
+    }
+    if (file.fp)
+        fclose(file.fp);
+    pthread_mutex_destroy(&mutex);
+}
 
-    /* cell buffer双线链表创建完毕之后，获取当前进程的id */
+/* 初始化；缓冲区在各线程第一次写日志时才分配 */
+ring_log::ring_log()
+    : _mem_used(0),
+      _mem_peak(0),
+      _mem_limit(LOG_MEM_DEFAULT),
+      _grows(0),
+      _shrinks(0),
+      _overflow(OVERFLOW_DROP),
+      _overflow_arg(LOG_BLOCK_MS),
+      _split(false),
+      _binary(false),
+      _env_ok(false),
+      _has_writer(false) {
+    for (int i = 0; i <= TRACE; ++i)
+        _dropped[i].store(0, std::memory_order_relaxed);
+    pthread_key_create(&_ring_key, ring_log::release_ring);
+    _efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_efd < 0) {
+        fprintf(stderr, "eventfd error: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    /* 获取当前进程的id */
     _pid = getpid();
 }
 
@@ -88,146 +143,639 @@ void ring_log::init_path(const char* log_dir,
         level = TRACE;
     if (level < FATAL)
         level = FATAL;
-    _level = level;
+    _level.store(level, std::memory_order_relaxed);
 
     pthread_mutex_unlock(&_mutex);
 }
 
+log_ring* ring_log::thread_ring() {
+    if (t_ring)
+        return t_ring;
+    /* 每个线程最初的几个小缓冲区不受预算限制，否则预算用尽后新线程一条日志也写不了 */
+    log_ring* ring = new log_ring(gettid(), LOG_BUFF_MIN, THREAD_BUFF_CNT);
+    mem_add(ring->bytes.load(std::memory_order_relaxed));
+
+    pthread_mutex_lock(&_mutex);
+    _rings.push_back(ring);
+    pthread_mutex_unlock(&_mutex);
+
+    t_ring = ring;
+    pthread_setspecific(_ring_key, ring);
+    return ring;
+}
+
+void ring_log::release_ring(void* ring) {
+    /* 缓冲区里可能还有没写到文件的日志，由后台线程读完后回收 */
+    t_ring = NULL;
+    ((log_ring*)ring)->dead.store(true, std::memory_order_release);
+}
+
+bool ring_log::peek(log_ring* ring, log_record* rec, const char** text) {
+    cell_buffer* buf = ring->prst;
+    while (true) {
+        if (buf->read_len < buf->used_len()) {
+            memcpy(rec, buf->data() + buf->read_len, sizeof(*rec));
+            *text = buf->data() + buf->read_len + sizeof(*rec);
+            return true;
+        }
+        /* 生产者还在这个缓冲区上，已写入的都读完了 */
+        if (buf->status.load(std::memory_order_acquire) != cell_buffer::FULL)
+            return false;
+        /* 生产者置FULL之前的写入都已发布，再看一次长度 */
+        if (buf->read_len < buf->used_len())
+            continue;
+        cell_buffer* next = buf->next;
+        buf->clear();
+        ring->prst = buf = next;
+    }
+}
+
 /**
- * @brief 持久化，从文件中向缓冲区中追加内容到文件(磁盘)，该函数是给消费者使用的。
- * 信号量超时时间为1s，超过一秒即便该缓冲区仍然未满：消费者将此cell_buffer标记为FULL强行持久化
+ * @brief 持久化，把各线程缓冲区中的日志写入文件(磁盘)，该函数是给消费者使用的。
+ * 生产者换缓冲区时通过eventfd唤醒消费者；最多等待1s，即便没有缓冲区写满，也把已写入的日志持久化
  */
 void ring_log::persist() {
+    struct pollfd pfd;
+    pfd.fd = _efd;
+    pfd.events = POLLIN;
+    bool more = false;
     while (true) {
-        /* 检查 _prst_buf 是否需要持久化 */
-        pthread_mutex_lock(&_mutex);
-        if (_prst_buf->status == cell_buffer::FREE) {
-            /* 如果持久化缓存仍然可追加日志，那就阻塞当前线程 */
-            struct timespec tsp;
-            struct timeval now;
-            gettimeofday(&now, NULL);
-            tsp.tv_sec = now.tv_sec;
-            tsp.tv_nsec = now.tv_usec * 1000;  
-            tsp.tv_sec += BUFF_WAIT_TIME;       /* 设置超时事件为1s */
-            /* 超过一秒即便该缓冲区仍然未满：也要解除阻塞 */
-            pthread_cond_timedwait(&_cond, &_mutex, &tsp);
+        /* 上一轮没写完就不等待 */
+        if (!more && poll(&pfd, 1, BUFF_WAIT_TIME * 1000) > 0) {
+            uint64_t cnt;
+            while (read(_efd, &cnt, sizeof(cnt)) > 0) {
+            }
         }
+        more = drain();
+    }
+}
 
-        if (_prst_buf->empty()) {
-            /* 如果持久化内存为空，则放弃，进入下一个循环 */
-            pthread_mutex_unlock(&_mutex);
-            continue;
-        }
+bool ring_log::drain() {
+    pthread_mutex_lock(&_mutex);
+    _draining = _rings;
+    pthread_mutex_unlock(&_mutex);
 
-        if (_prst_buf->status == cell_buffer::FREE) {
-            /* 接触信号量阻塞之后再次检测，如果缓存依旧可追加，说明当前生产者还在该buffer */
-            assert(_curr_buf == _prst_buf); 
-            /* 即便生产者仍然在向buffer写入，但是消费者也要强制持久化了 */
-            _curr_buf->status = cell_buffer::FULL;
-            /* 让生产者去下一个buffer生产 */
-            _curr_buf = _curr_buf->next;
+    /* 时钟只在写日志时推进，没有线程写日志时由后台线程推进，否则空闲判断永远不成立 */
+    clock_snapshot now;
+    coarse_clock* clk = coarse_clock::ins();
+    clk->update();
+    clk->read(&now);
+
+    // decision which file to write
+    FILE* fp = NULL;
+    if (!_split && decis_file(&_file, now.year, now.mon, now.day))
+        fp = _file.fp;
+
+    log_record rec;
+    const char* text;
+    uint64_t written = 0;
+    if (_split) {
+        /* 每个线程写各自的文件，线程内的日志本来就是按时间顺序的 */
+        for (size_t i = 0; i < _draining.size(); ++i) {
+            log_ring* ring = _draining[i];
+            if (!peek(ring, &rec, &text))
+                continue;
+            fp = decis_file(&ring->file, now.year, now.mon, now.day) ? ring->file.fp : NULL;
+            do {
+                if (fp)
+                    write_record(&ring->file, ring->tid, rec, text);
+                ring->prst->read_len += sizeof(rec) + rec.len;
+                written += rec.len;
+            } while (written < DRAIN_LIMIT && peek(ring, &rec, &text));
+            if (fp)
+                fflush(fp);
         }
+    } else {
+        /* 多路归并：每次取各线程下一条日志中时间最早的一条；
+           只在本轮已经写入缓冲区的日志之间排序，写入得晚的线程的日志可能排在下一轮 */
+        while (written < DRAIN_LIMIT) {
+            log_ring* best = NULL;
+            log_record best_rec;
+            const char* best_text = NULL;
+            for (size_t i = 0; i < _draining.size(); ++i) {
+                if (peek(_draining[i], &rec, &text) && (!best || rec.ts < best_rec.ts)) {
+                    best = _draining[i];
+                    best_rec = rec;
+                    best_text = text;
+                }
+            }
+            if (!best)
+                break;
+            if (fp)
+                write_record(&_file, best->tid, best_rec, best_text);
+            best->prst->read_len += sizeof(best_rec) + best_rec.len;
+            written += best_rec.len;
+        }
+        if (fp)
+            fflush(fp);
+    }
 
-        int year = _tm.year, mon = _tm.mon, day = _tm.day;
-        pthread_mutex_unlock(&_mutex);
-
-        // decision which file to write
-        if (!decis_file(year, mon, day))
+    /* 线程溢出后退出了，或者LOG_RESUME_MS内没再写日志，由后台线程代写丢弃的汇总；
+       仍在写日志的线程由自己在溢出结束后写 */
+    for (size_t i = 0; i < _draining.size(); ++i) {
+        log_ring* ring = _draining[i];
+        if (!ring->drop_ms.load(std::memory_order_relaxed))
             continue;
-        
-        /* 持久化：将缓冲区内容写入到文件 */
-        _prst_buf->persist(_fp);
-        // fflush(_fp);
+        log_file* file = NULL;
+        if (!_split)
+            file = fp ? &_file : NULL;
+        else if (decis_file(&ring->file, now.year, now.mon, now.day))
+            file = &ring->file;
+        write_drops(file, ring, now);
+        if (file)
+            fflush(file->fp);
+    }
 
+    /* 释放空闲线程多余的缓冲区；线程刚写过、或只有最初大小的缓冲区时不加锁就跳过。
+       在回收之前做，已退出的线程留给下面整个回收 */
+    for (size_t i = 0; i < _draining.size(); ++i) {
+        log_ring* ring = _draining[i];
+        if (!ring->dead.load(std::memory_order_acquire) &&
+            ring->bytes.load(std::memory_order_relaxed) > (uint64_t)LOG_BUFF_MIN * THREAD_BUFF_CNT &&
+            now.mono_ms - ring->switch_ms.load(std::memory_order_relaxed) >= LOG_IDLE_MS)
+            shrink(ring, now.mono_ms);
+    }
+
+    /* 回收已退出且日志都已写出的线程的缓冲区环 */
+    for (size_t i = 0; i < _draining.size(); ++i) {
+        log_ring* ring = _draining[i];
+        if (!ring->dead.load(std::memory_order_acquire) || peek(ring, &rec, &text))
+            continue;
         pthread_mutex_lock(&_mutex);
-        _prst_buf->clear();
-        _prst_buf = _prst_buf->next;
+        for (size_t j = 0; j < _rings.size(); ++j) {
+            if (_rings[j] == ring) {
+                _rings.erase(_rings.begin() + j);
+                break;
+            }
+        }
         pthread_mutex_unlock(&_mutex);
+        mem_sub(ring->bytes.load(std::memory_order_relaxed));
+        delete ring;
     }
+    return written >= DRAIN_LIMIT;
+}
+
+void ring_log::shrink(log_ring* ring, int64_t now_ms) {
+    cell_buffer* freed = NULL;
+    uint64_t freed_len = 0;
+    int freed_cnt = 0;
+
+    pthread_mutex_lock(&ring->mutex);
+    cell_buffer* curr = ring->curr;
+    /* 还有没写出的日志时环中有FULL的缓冲区，等写完了再收缩；
+       写完了则curr之外的缓冲区都是空闲的，持有锁时生产者不会换过去 */
+    if (ring->prst != curr) {
+        pthread_mutex_unlock(&ring->mutex);
+        return;
+    }
+    cell_buffer* spare = NULL;
+    for (cell_buffer* buf = curr->next; buf != curr;) {
+        cell_buffer* next = buf->next;
+        if (!spare && buf->total_len() == LOG_BUFF_MIN) {
+            spare = buf;
+        } else {
+            /* 用next把摘下的缓冲区串起来，解锁后再释放 */
+            buf->next = freed;
+            freed = buf;
+            freed_len += buf->total_len();
+            ++freed_cnt;
+        }
+        buf = next;
+    }
+    if (!spare) {
+        spare = new cell_buffer(LOG_BUFF_MIN);
+        mem_add(LOG_BUFF_MIN);
+    }
+    curr->next = curr->prev = spare;
+    spare->next = spare->prev = curr;
+    ring->head = curr;
+    ring->buff_cnt.store(THREAD_BUFF_CNT, std::memory_order_relaxed);
+    ring->bytes.store((uint64_t)curr->total_len() + LOG_BUFF_MIN, std::memory_order_relaxed);
+    ring->grow_len = LOG_BUFF_MIN;
+    /* 当前缓冲区一直没写满时不必每轮都来检查 */
+    ring->switch_ms.store(now_ms, std::memory_order_relaxed);
+    pthread_mutex_unlock(&ring->mutex);
+
+    while (freed) {
+        cell_buffer* next = freed->next;
+        delete freed;
+        freed = next;
+    }
+    mem_sub(freed_len);
+    _shrinks.fetch_add(freed_cnt, std::memory_order_relaxed);
+}
+
+cell_buffer* ring_log::grow(log_ring* ring, uint64_t limit) {
+    /* 先在预算里预留，多个线程同时新开缓冲区时也不会超出预算；预算不够时尽量开小一些 */
+    uint64_t len;
+    uint64_t used = _mem_used.load(std::memory_order_relaxed);
+    do {
+        len = ring->grow_len;
+        /* OVERFLOW_LEVEL留给ERROR的部分每次只开最小的缓冲区，让更多线程分得到 */
+        if (OVERFLOW_LEVEL == _overflow && used + len > _mem_limit - _mem_limit / 8)
+            len = LOG_BUFF_MIN;
+        if (used + len > limit)
+            len = used < limit ? (limit - used) & ~(uint64_t)(LOG_BUFF_MIN - 1) : 0;
+        if (len < LOG_BUFF_MIN)
+            return NULL;
+    } while (!_mem_used.compare_exchange_weak(used, used + len, std::memory_order_relaxed));
+    uint64_t peak = _mem_peak.load(std::memory_order_relaxed);
+    while (used + len > peak && !_mem_peak.compare_exchange_weak(peak, used + len, std::memory_order_relaxed)) {
+    }
+
+    if (ring->grow_len < LOG_BUFF_MAX)
+        ring->grow_len *= 2;
+    ring->buff_cnt.fetch_add(1, std::memory_order_relaxed);
+    ring->bytes.fetch_add(len, std::memory_order_relaxed);
+    _grows.fetch_add(1, std::memory_order_relaxed);
+    return new cell_buffer(len);
+}
+
+void ring_log::mem_add(uint64_t len) {
+    uint64_t used = _mem_used.fetch_add(len, std::memory_order_relaxed) + len;
+    uint64_t peak = _mem_peak.load(std::memory_order_relaxed);
+    while (used > peak && !_mem_peak.compare_exchange_weak(peak, used, std::memory_order_relaxed)) {
+    }
+}
+
+void ring_log::mem_sub(uint64_t len) {
+    _mem_used.fetch_sub(len, std::memory_order_relaxed);
+}
+
+void ring_log::set_overflow(int policy, int arg) {
+    if (policy < OVERFLOW_DROP || policy > OVERFLOW_SAMPLE)
+        policy = OVERFLOW_DROP;
+    if (arg <= 0)
+        arg = OVERFLOW_SAMPLE == policy ? LOG_SAMPLE_N : LOG_BLOCK_MS;
+    _overflow = policy;
+    _overflow_arg = arg;
+}
+
+void ring_log::set_mem_limit(uint64_t bytes) {
+    if (bytes < LOG_MEM_MIN)
+        bytes = LOG_MEM_MIN;
+    else if (bytes > LOG_MEM_MAX)
+        bytes = LOG_MEM_MAX;
+    _mem_limit = bytes;
+}
+
+uint64_t ring_log::buffers(size_t* threads) {
+    uint64_t cnt = 0;
+    pthread_mutex_lock(&_mutex);
+    if (threads)
+        *threads = _rings.size();
+    for (size_t i = 0; i < _rings.size(); ++i)
+        cnt += _rings[i]->buff_cnt.load(std::memory_order_relaxed);
+    pthread_mutex_unlock(&_mutex);
+    return cnt;
+}
+
+void ring_log::report() {
+    size_t threads;
+    uint64_t buffers = this->buffers(&threads);
+    LOG_INFO("log buffers: threads=%zu buffers=%llu used=%llu peak=%llu limit=%llu grows=%llu shrinks=%llu",
+             threads, (unsigned long long)buffers,
+             (unsigned long long)mem_used(), (unsigned long long)mem_peak(), (unsigned long long)_mem_limit,
+             (unsigned long long)_grows.load(std::memory_order_relaxed),
+             (unsigned long long)_shrinks.load(std::memory_order_relaxed));
+    LOG_INFO("log drops: policy=%s fatal=%llu error=%llu warn=%llu info=%llu debug=%llu trace=%llu",
+             overflow_names[_overflow], (unsigned long long)dropped(FATAL), (unsigned long long)dropped(ERROR),
+             (unsigned long long)dropped(WARN), (unsigned long long)dropped(INFO), (unsigned long long)dropped(DEBUG),
+             (unsigned long long)dropped(TRACE));
+}
+
+uint64_t ring_log::prefault() {
+    /* 持有各环的锁遍历，期间环中的缓冲区不会增减 */
+    uint64_t total = 0;
+    pthread_mutex_lock(&_mutex);
+    for (size_t i = 0; i < _rings.size(); ++i) {
+        log_ring* ring = _rings[i];
+        pthread_mutex_lock(&ring->mutex);
+        cell_buffer* buf = ring->head;
+        do {
+            total += buf->prefault();
+            buf = buf->next;
+        } while (buf != ring->head);
+        pthread_mutex_unlock(&ring->mutex);
+    }
+    pthread_mutex_unlock(&_mutex);
+    return total;
 }
 
 /**
- * @brief 将一条日志加入到环形缓冲区中，如果当前缓冲区已满，则将日志写入下一个缓冲区
- * @param lvl：日志等级
+ * @brief 将一条日志加入到当前线程的缓冲区环中，如果当前缓冲区不够写入，则将日志写入下一个缓冲区
+ * @param level：日志级别
+ * @param lvl：日志等级名
  * @param format：日志格式
  * @param ...：变长参数列表，对应于日志格式字符串中的占位符
  */
-void ring_log::try_append(const char* lvl, const char* format, ...) {
-    int ms;
-    uint64_t curr_sec = _tm.get_curr_time(&ms);
-
-    /* 如果距离上一次日志写入的时间小于阈值 RELOG_THRESOLD，则不写入 */
-    if (_lst_lts && curr_sec - _lst_lts < RELOG_THRESOLD)
+void ring_log::try_append(int level, const char* lvl, const char* format, ...) {
+    /* 时间戳取自时钟服务发布的字符串，不调用gettimeofday，也不再每个线程各自格式化 */
+    clock_snapshot now;
+    coarse_clock* clk = coarse_clock::ins();
+    clk->update();
+    clk->read(&now);
+
+    cell_buffer* buf = reserve(thread_ring(), now, level);
+    if (!buf)
         return;
 
-    char log_line[LOG_LEN_LIMIT];
-    /* 格式化时间戳，将等级和时间戳拼接到 log_line 中 */
-    int prev_len = snprintf(log_line, LOG_LEN_LIMIT, "%s[%s.%03d]", lvl, _tm.utc_fmt, ms);
-
     va_list arg_ptr;
     va_start(arg_ptr, format);
+    put_text(buf, now, lvl, format, arg_ptr);
+    va_end(arg_ptr);
+}
 
-    /* 格式化变长参数列表中的日志信息，并将结果拼接到 log_line 的后面 */
-    int main_len = vsnprintf(log_line + prev_len, LOG_LEN_LIMIT - prev_len,
-                             format, arg_ptr);
+void ring_log::put_text(cell_buffer* buf, const clock_snapshot& now, const char* lvl, const char* format,
+                        va_list args) {
+    /* 记录头和日志文本连续存放，文本写完后再填记录头、发布长度 */
+    char* line = buf->tail();
+    char* text = line + sizeof(log_record);
+    const int text_limit = LOG_LEN_LIMIT - sizeof(log_record);
 
-    va_end(arg_ptr);
+    /* 格式化时间戳，将等级和时间戳拼接到 text 中 */
+    int prev_len = snprintf(text, text_limit, "%s[%s.%03d]", lvl, now.log_fmt, (int)(now.real_ms % 1000));
 
+    /* 格式化变长参数列表中的日志信息，并将结果拼接到 text 的后面 */
+    int main_len = vsnprintf(text + prev_len, text_limit - prev_len, format, args);
+
+    if (main_len < 0)
+        return;
+    /* 超长的日志被截断 */
     uint32_t len = prev_len + main_len;
+    if (len >= (uint32_t)text_limit)
+        len = text_limit - 1;
+
+    log_record rec;
+    rec.ts = now.mono_ms;
+    rec.len = len;
+    rec.kind = 0;
+    memcpy(line, &rec, sizeof(rec));
+    buf->commit(sizeof(rec) + len);
+}
 
-    _lst_lts = 0;
-    bool tell_back = false;
+void ring_log::put_line(cell_buffer* buf, const clock_snapshot& now, const char* lvl, const char* format, ...) {
+    va_list arg_ptr;
+    va_start(arg_ptr, format);
+    put_text(buf, now, lvl, format, arg_ptr);
+    va_end(arg_ptr);
+}
 
+uint32_t ring_log::reg(log_desc* desc, const char* tags) {
     pthread_mutex_lock(&_mutex);
-    /* 如果当前缓冲区未满且足够写入当前数据，将日志写入当前缓冲区 */
-    if (_curr_buf->status == cell_buffer::FREE && _curr_buf->avail_len() >= len) {
-        _curr_buf->append(log_line, len);
-    } else {
-        /* 当前缓冲区已满或者不够写入当前数据，需要将日志写入下一个缓冲区 */
-
-        if (_curr_buf->status == cell_buffer::FREE) {
-            /* 如果当前缓冲区未满，但是不够写入len大小的数据了，要去下一个缓冲区 */
-            _curr_buf->status = cell_buffer::FULL;  // set to FULL
-            cell_buffer* next_buf = _curr_buf->next;
-            /* 告诉后端线程，当前缓冲区已满，需要将其写入磁盘 */
-            tell_back = true;
-
-            // 如果下一个缓冲区也是 FULL 状态，则无法使用下一个缓冲区，需要新开一个缓冲区
-            if (next_buf->status == cell_buffer::FULL) {
-                // 如果内存使用量已达到上限MEM_USE_LIMIT，则无法新开缓冲区，只能将当前缓冲区设置为下一个缓冲区
-                if (_one_buff_len * (_buff_cnt + 1) > MEM_USE_LIMIT) {
-                    fprintf(stderr, "no more log space can use\n");
-                    _curr_buf = next_buf;
-                    _lst_lts = curr_sec;
-                } else {
-                    /* 创建一个新的缓存区，并加入双向链表 */
-                    cell_buffer* new_buffer = new cell_buffer(_one_buff_len);
-                    _buff_cnt += 1;
-                    new_buffer->prev = _curr_buf;
-                    _curr_buf->next = new_buffer;
-                    new_buffer->next = next_buf;
-                    next_buf->prev = new_buffer;
-                    _curr_buf = new_buffer;
+    if (!desc->id.load(std::memory_order_relaxed)) {
+        desc->tags = tags;
+        _descs.push_back(desc);
+        desc->id.store(_descs.size(), std::memory_order_release);
+    }
+    pthread_mutex_unlock(&_mutex);
+    return desc->id.load(std::memory_order_relaxed);
+}
+
+char* ring_log::bin_begin(int level, uint32_t id, char** end) {
+    clock_snapshot now;
+    coarse_clock* clk = coarse_clock::ins();
+    clk->update();
+    clk->read(&now);
+
+    cell_buffer* buf = reserve(thread_ring(), now, level);
+    if (!buf)
+        return NULL;
+
+    /* 记录头的长度在参数写完后补上 */
+    char* line = buf->tail();
+    log_record rec;
+    rec.ts = now.mono_ms;
+    rec.len = 0;
+    rec.kind = 1;
+    memcpy(line, &rec, sizeof(rec));
+    char* p = line + sizeof(rec);
+    memcpy(p, &id, sizeof(id));
+    memcpy(p + sizeof(id), &now.real_ms, sizeof(now.real_ms));
+    *end = line + LOG_LEN_LIMIT;
+    return p + sizeof(id) + sizeof(now.real_ms);
+}
+
+void ring_log::bin_commit(char* p) {
+    cell_buffer* buf = t_ring->curr;
+    char* line = buf->tail();
+    uint32_t len = p - line - sizeof(log_record);
+    memcpy(line + offsetof(log_record, len), &len, sizeof(len));
+    buf->commit(sizeof(log_record) + len);
+}
+
+cell_buffer* ring_log::reserve(log_ring* ring, const clock_snapshot& now, int level) {
+    /* 最近LOG_RESUME_MS内缓冲区用尽过，视为仍在溢出：OVERFLOW_SAMPLE只放行1/N，
+       OVERFLOW_LEVEL不再让低于ERROR的日志占用缓冲区，剩下的空间留给ERROR及以上 */
+    int64_t full_ms = ring->full_ms.load(std::memory_order_relaxed);
+    bool overflow = full_ms && now.mono_ms - full_ms < LOG_RESUME_MS;
+    if (overflow && ((OVERFLOW_SAMPLE == _overflow && ring->sample++ % _overflow_arg != 0) ||
+                     (OVERFLOW_LEVEL == _overflow && level > ERROR))) {
+        drop(ring, now.mono_ms, level, false);
+        return NULL;
+    }
+
+    /* 等待超时后直到成功取到缓冲区之前不再阻塞，避免每条日志都等满超时 */
+    cell_buffer* buf = writable(ring, now, level, !ring->failed);
+    ring->failed = !buf;
+    if (!buf) {
+        drop(ring, now.mono_ms, level, true);
+        return NULL;
+    }
+    if (!ring->drop_ms.load(std::memory_order_relaxed) || overflow)
+        return buf;
+
+    /* 溢出已经结束，先写一行本线程这次溢出丢弃的条数；后台线程可能已经代写过了 */
+    ring->sample = 0;
+    uint64_t drops[TRACE + 1];
+    int64_t since;
+    if (!take_drops(ring, now.mono_ms, true, drops, &since))
+        return buf;
+    char text[512];
+    drops_text(text, sizeof(text), ring->tid, drops, now.mono_ms - since);
+    put_line(buf, now, LOG_NAME_WARN, "%s", text);
+    buf = writable(ring, now, level, true);
+    ring->failed = !buf;
+    if (!buf)
+        drop(ring, now.mono_ms, level, true);
+    return buf;
+}
+
+void ring_log::drop(log_ring* ring, int64_t now_ms, int level, bool full) {
+    /* 只在溢出时走到这里，加锁与后台线程代写汇总互斥 */
+    pthread_mutex_lock(&ring->mutex);
+    if (full)
+        ring->full_ms.store(now_ms, std::memory_order_relaxed);
+    if (!ring->drop_ms.load(std::memory_order_relaxed))
+        ring->drop_ms.store(now_ms, std::memory_order_relaxed);
+    ++ring->drops[level];
+    pthread_mutex_unlock(&ring->mutex);
+    _dropped[level].fetch_add(1, std::memory_order_relaxed);
+}
+
+bool ring_log::take_drops(log_ring* ring, int64_t now_ms, bool force, uint64_t* drops, int64_t* since) {
+    pthread_mutex_lock(&ring->mutex);
+    int64_t drop_ms = ring->drop_ms.load(std::memory_order_relaxed);
+    if (!drop_ms || (!force && now_ms - ring->full_ms.load(std::memory_order_relaxed) < LOG_RESUME_MS)) {
+        pthread_mutex_unlock(&ring->mutex);
+        return false;
+    }
+    memcpy(drops, ring->drops, sizeof(ring->drops));
+    memset(ring->drops, 0, sizeof(ring->drops));
+    *since = drop_ms;
+    ring->drop_ms.store(0, std::memory_order_relaxed);
+    ring->full_ms.store(0, std::memory_order_relaxed);
+    pthread_mutex_unlock(&ring->mutex);
+    return true;
+}
+
+int ring_log::drops_text(char* buf, int len, pid_t tid, const uint64_t* drops, int64_t elapsed_ms) {
+    int n = snprintf(buf, len,
+                     "[%u]%s:%d(%s): log overflow: dropped %llu lines in the last %lld ms "
+                     "(fatal=%llu error=%llu warn=%llu info=%llu debug=%llu trace=%llu) policy=%s\n",
+                     tid, __FILE__, __LINE__, __FUNCTION__,
+                     (unsigned long long)(drops[FATAL] + drops[ERROR] + drops[WARN] + drops[INFO] + drops[DEBUG] +
+                                          drops[TRACE]),
+                     (long long)elapsed_ms, (unsigned long long)drops[FATAL], (unsigned long long)drops[ERROR],
+                     (unsigned long long)drops[WARN], (unsigned long long)drops[INFO],
+                     (unsigned long long)drops[DEBUG], (unsigned long long)drops[TRACE], overflow_names[_overflow]);
+    return n < len ? n : len - 1;
+}
+
+void ring_log::write_drops(log_file* file, log_ring* ring, const clock_snapshot& now) {
+    uint64_t drops[TRACE + 1];
+    int64_t since;
+    if (!take_drops(ring, now.mono_ms, ring->dead.load(std::memory_order_acquire), drops, &since))
+        return;
+    /* 与put_text的行首格式一致 */
+    char line[LOG_LEN_LIMIT];
+    int len = snprintf(line, sizeof(line), "%s[%s.%03d]", LOG_NAME_WARN, now.log_fmt, (int)(now.real_ms % 1000));
+    len += drops_text(line + len, sizeof(line) - len, ring->tid, drops, now.mono_ms - since);
+    log_record rec;
+    rec.ts = now.mono_ms;
+    rec.len = len;
+    rec.kind = 0;
+    if (file)
+        write_record(file, ring->tid, rec, line);
+}
+
+cell_buffer* ring_log::writable(log_ring* ring, const clock_snapshot& now, int level, bool wait) {
+    cell_buffer* buf = ring->curr;
+    /* 当前缓冲区放不下一条最长的日志时换到下一个缓冲区，之后直接在缓冲区里写，不经过栈上的中转 */
+    if (buf->avail_len() >= LOG_LEN_LIMIT)
+        return buf;
+
+    wait = wait && OVERFLOW_BLOCK == _overflow;
+    /* OVERFLOW_LEVEL时低于ERROR的日志只能用预算的7/8 */
+    uint64_t limit = _mem_limit;
+    if (OVERFLOW_LEVEL == _overflow && level > ERROR)
+        limit -= limit / 8;
+    int64_t deadline = 0;
+    while (true) {
+        pthread_mutex_lock(&ring->mutex);
+        cell_buffer* next_buf = buf->next;
+
+        // 如果下一个缓冲区还是 FULL 状态，说明后台线程还没有持久化完，需要新开一个缓冲区
+        if (next_buf->status.load(std::memory_order_acquire) == cell_buffer::FULL) {
+            /* 创建一个新的缓存区，插在当前缓冲区之后；在当前缓冲区置FULL之前链好，后台线程读完它后能找到新缓冲区 */
+            cell_buffer* new_buffer = grow(ring, limit);
+            if (!new_buffer) {
+                pthread_mutex_unlock(&ring->mutex);
+                /* 内存预算已经用尽，OVERFLOW_BLOCK时不持锁地等后台线程读完下一个缓冲区，否则丢弃这条日志，
+                   当前缓冲区留给后台线程继续读 */
+                int64_t now_ms = coarse_clock::ins()->update();
+                if (!wait)
+                    return NULL;
+                if (!deadline) {
+                    deadline = now_ms + _overflow_arg;
+                    uint64_t one = 1;
+                    ssize_t ret = write(_efd, &one, sizeof(one));
+                    (void)ret;
                 }
-            } else {
-                /* 下一个缓冲区为free，可以直接进行写入 */
-                _curr_buf = next_buf;
+                if (now_ms >= deadline)
+                    return NULL;
+                usleep(LOG_BLOCK_US);
+                continue;
             }
-            if (!_lst_lts) {
-                /* 如果未达到MEM_USE_LIMIT，_lst_lts为0，可以直接追加日志 */
-                _curr_buf->append(log_line, len);
-            }
-                
-        } else  //_curr_buf->status == cell_buffer::FULL, assert persist is on here too!
-        {
-            /* 当前缓冲区已满，无法追加日志 */
-            _lst_lts = curr_sec;
+            new_buffer->prev = buf;
+            new_buffer->next = next_buf;
+            next_buf->prev = new_buffer;
+            buf->next = new_buffer;
+            next_buf = new_buffer;
+        }
+
+        /* 告诉后端线程，当前缓冲区已满，需要将其写入磁盘 */
+        buf->status.store(cell_buffer::FULL, std::memory_order_release);
+        ring->curr = buf = next_buf;
+        ring->switch_ms.store(now.mono_ms, std::memory_order_relaxed);
+        pthread_mutex_unlock(&ring->mutex);
+        uint64_t one = 1;
+        ssize_t ret = write(_efd, &one, sizeof(one));
+        (void)ret;
+        return buf;
+    }
+}
+
+/* 二进制日志文件中的字符串：uint16 长度 | 字节 */
+static void put_str(FILE* fp, const char* s) {
+    size_t n = strlen(s);
+    if (n > 0xffff)
+        n = 0xffff;
+    uint16_t len = n;
+    fwrite(&len, sizeof(len), 1, fp);
+    fwrite(s, 1, n, fp);
+}
+
+void ring_log::write_record(log_file* file, pid_t tid, const log_record& rec, const char* text) {
+    FILE* fp = file->fp;
+    if (!_binary) {
+        fwrite(text, 1, rec.len, fp);
+        return;
+    }
+    if (0 == rec.kind) {
+        char kind = BIN_TEXT;
+        fwrite(&kind, 1, 1, fp);
+        fwrite(&rec.len, sizeof(rec.len), 1, fp);
+        fwrite(text, 1, rec.len, fp);
+        return;
+    }
+
+    uint32_t id;
+    memcpy(&id, text, sizeof(id));
+    if (id > file->descs) {
+        /* 补写本文件还没有的格式描述，登记是追加的，已有的描述不会变 */
+        pthread_mutex_lock(&_mutex);
+        for (uint32_t i = file->descs; i < _descs.size(); ++i) {
+            const log_desc* desc = _descs[i];
+            char kind = BIN_DESC;
+            uint32_t desc_id = i + 1, line = desc->line;
+            fwrite(&kind, 1, 1, fp);
+            fwrite(&desc_id, sizeof(desc_id), 1, fp);
+            fwrite(&line, sizeof(line), 1, fp);
+            put_str(fp, desc->lvl);
+            put_str(fp, desc->file);
+            put_str(fp, desc->func);
+            put_str(fp, desc->fmt);
+            put_str(fp, desc->tags);
         }
+        file->descs = _descs.size();
+        pthread_mutex_unlock(&_mutex);
     }
-    pthread_mutex_unlock(&_mutex);
-    if (tell_back) {
-        /* 让消费者线程解除阻塞，开启持久化工作 */
-        pthread_cond_signal(&_cond);
+    char kind = BIN_LINE;
+    uint32_t t = tid;
+    fwrite(&kind, 1, 1, fp);
+    fwrite(&t, sizeof(t), 1, fp);
+    fwrite(&rec.len, sizeof(rec.len), 1, fp);
+    fwrite(text, 1, rec.len, fp);
+}
+
+void ring_log::open_file(log_file* file, const char* path) {
+    file->fp = fopen(path, "w");
+    file->descs = 0;
+    if (file->fp && _binary) {
+        uint32_t pid = _pid;
+        fwrite(BIN_LOG_MAGIC, 1, strlen(BIN_LOG_MAGIC), file->fp);
+        fwrite(&pid, sizeof(pid), 1, file->fp);
     }
 }
 
@@ -235,58 +783,59 @@ void ring_log::try_append(const char* lvl, const char* format, ...) {
  * @brief 决定根据日志消息的时间写时间？还是自主写时间？默认自主写时间
  * @return 操作是否成功
  */
-bool ring_log::decis_file(int year, int mon, int day) {
+bool ring_log::decis_file(log_file* file, int year, int mon, int day) {
     if (!_env_ok) {
         /* 打开文件 */
-        if (_fp)
-            fclose(_fp);
-        _fp = fopen("/dev/null", "w");
-        return _fp != NULL;
+        if (!file->fp)
+            file->fp = fopen("/dev/null", "w");
+        return file->fp != NULL;
     }
 
-    if (!_fp) {
+    /* 所有线程共用的文件名是 name.yyyymmdd.pid.log，按线程分文件时在pid后加上线程id；二进制日志的后缀是.blog */
+    const char* ext = _binary ? "blog" : "log";
+    char name[768] = {};
+    if (file->tid)
+        snprintf(name, sizeof(name), "%s/%s.%d%02d%02d.%u.%d", _log_dir, _prog_name, year, mon, day, _pid, file->tid);
+    else
+        snprintf(name, sizeof(name), "%s/%s.%d%02d%02d.%u", _log_dir, _prog_name, year, mon, day, _pid);
+
+    if (!file->fp) {
         /* 文件指针为空的话，创建一个文件并打开 */
-        _year = year, _mon = mon, _day = day;
+        file->year = year, file->mon = mon, file->day = day;
         char log_path[1024] = {};
-        sprintf(log_path, "%s/%s.%d%02d%02d.%u.log", _log_dir, _prog_name,
-                _year, _mon, _day, _pid);
-        _fp = fopen(log_path, "w");
-        if (_fp)
-            _log_cnt += 1;
-    } else if (_day != day) {
+        snprintf(log_path, sizeof(log_path), "%s.%s", name, ext);
+        open_file(file, log_path);
+        if (file->fp)
+            file->cnt += 1;
+    } else if (file->day != day) {
         /* 文件指针非空，先关闭再打开 */
-        fclose(_fp);
+        fclose(file->fp);
         char log_path[1024] = {};
-        _year = year, _mon = mon, _day = day;
-        sprintf(log_path, "%s/%s.%d%02d%02d.%u.log", _log_dir, _prog_name,
-                _year, _mon, _day, _pid);
-        _fp = fopen(log_path, "w");
-        if (_fp)
-            _log_cnt = 1;
-    } else if (ftell(_fp) >= LOG_USE_LIMIT) {
+        file->year = year, file->mon = mon, file->day = day;
+        snprintf(log_path, sizeof(log_path), "%s.%s", name, ext);
+        open_file(file, log_path);
+        if (file->fp)
+            file->cnt = 1;
+    } else if (ftell(file->fp) >= LOG_USE_LIMIT) {
         /* _fp使用的字符长度已经超过的LOG_USE_LIMIT的话，重新开一个文件 */
-        fclose(_fp);
+        fclose(file->fp);
         char old_path[1024] = {};
         char new_path[1024] = {};
         /* 更新log文件的名字，即.log为最新文件， mv xxx.log.[i] xxx.log.[i + 1] */
-        for (int i = _log_cnt - 1; i > 0; --i) {
-            sprintf(old_path, "%s/%s.%d%02d%02d.%u.log.%d", _log_dir,
-                    _prog_name, _year, _mon, _day, _pid, i);
-            sprintf(new_path, "%s/%s.%d%02d%02d.%u.log.%d", _log_dir,
-                    _prog_name, _year, _mon, _day, _pid, i + 1);
+        for (int i = file->cnt - 1; i > 0; --i) {
+            snprintf(old_path, sizeof(old_path), "%s.%s.%d", name, ext, i);
+            snprintf(new_path, sizeof(new_path), "%s.%s.%d", name, ext, i + 1);
             rename(old_path, new_path);
         }
         // mv xxx.log xxx.log.1
-        sprintf(old_path, "%s/%s.%d%02d%02d.%u.log", _log_dir, _prog_name,
-                _year, _mon, _day, _pid);
-        sprintf(new_path, "%s/%s.%d%02d%02d.%u.log.1", _log_dir, _prog_name,
-                _year, _mon, _day, _pid);
+        snprintf(old_path, sizeof(old_path), "%s.%s", name, ext);
+        snprintf(new_path, sizeof(new_path), "%s.%s.1", name, ext);
         rename(old_path, new_path);
-        _fp = fopen(old_path, "w");
-        if (_fp)
-            _log_cnt += 1;
+        open_file(file, old_path);
+        if (file->fp)
+            file->cnt += 1;
     }
-    return _fp != NULL;
+    return file->fp != NULL;
 }
 
 void* be_thdo(void* args) {
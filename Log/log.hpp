@@ -6,11 +6,17 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdarg.h>//va_list
 #include <pthread.h>
 #include <time.h>
 #include <sys/time.h>
 #include <sys/types.h>//getpid, gettid
 #include <sys/syscall.h>//system call
+#include <sys/mman.h>//madvise
+#include <atomic>
+#include <vector>
+#include "../Timer/coarse_clock.hpp"
+#include "bin_log.hpp"
 
 /* 日志级别 */
 enum LOG_LEVEL
@@ -23,91 +29,16 @@ enum LOG_LEVEL
     TRACE,
 };
 
-// extern pid_t gettid();
-
-/* 时间类 */
-struct utc_timer
+/* 缓冲区用尽(后台线程跟不上且内存预算已用完)时如何处理新的日志 */
+enum LOG_OVERFLOW
 {
-    utc_timer()
-    {
-        struct timeval tv;
-        gettimeofday(&tv, NULL);
-        /* 获取当前时间的秒数，存储在 _sys_acc_sec 中 */
-        _sys_acc_sec = tv.tv_sec;
-        /* 获取当前时间的分钟数，存储在 _sys_acc_min 中 */
-        _sys_acc_min = _sys_acc_sec / 60;
-        struct tm cur_tm;
-        /* 计算年、月、日、时、分和秒 */
-        localtime_r((time_t*)&_sys_acc_sec, &cur_tm);
-        year = cur_tm.tm_year + 1900;
-        mon  = cur_tm.tm_mon + 1;
-        day  = cur_tm.tm_mday;
-        hour  = cur_tm.tm_hour;
-        min  = cur_tm.tm_min;
-        sec  = cur_tm.tm_sec;
-        reset_utc_fmt();
-    }
-
-    // 获取当前时间的秒数，并更新年、月、日、时、分和秒
-    uint64_t get_curr_time(int* p_msec = NULL)
-    {
-        struct timeval tv;
-        // 获取当前时间的秒数和微秒数
-        gettimeofday(&tv, NULL);
-        if (p_msec)
-            *p_msec = tv.tv_usec / 1000;
-        // 如果不在同一秒
-        if ((uint32_t)tv.tv_sec != _sys_acc_sec)
-        {
-            // 更新秒数和系统当前秒数
-            sec = tv.tv_sec % 60;
-            _sys_acc_sec = tv.tv_sec;
-            // 如果不在同一分钟
-            if (_sys_acc_sec / 60 != _sys_acc_min)
-            {
-                
-                _sys_acc_min = _sys_acc_sec / 60;
-                struct tm cur_tm;
-                localtime_r((time_t*)&_sys_acc_sec, &cur_tm);
-                year = cur_tm.tm_year + 1900;
-                mon  = cur_tm.tm_mon + 1;
-                day  = cur_tm.tm_mday;
-                hour = cur_tm.tm_hour;
-                min  = cur_tm.tm_min;
-                // 重新格式化 UTC 时间
-                reset_utc_fmt();
-            }
-            else
-            {
-                // 仅更新秒数的 UTC 时间格式
-                reset_utc_fmt_sec();
-            }
-        }
-        return tv.tv_sec;
-    }
-
-    // 年、月、日、时、分、秒和 UTC 时间格式
-    int year, mon, day, hour, min, sec;
-    char utc_fmt[20];
-
-private:
-    // 格式化 UTC 时间
-    void reset_utc_fmt()
-    {
-        snprintf(utc_fmt, 20, "%d-%02d-%02d %02d:%02d:%02d", year, mon, day, hour, min, sec);
-    }
-    
-    // 格式化 UTC 时间中的秒数
-    void reset_utc_fmt_sec()
-    {
-        snprintf(utc_fmt + 17, 3, "%02d", sec);
-    }
-
-    // 记录写上一条日志时，系统经过的时间
-    uint64_t _sys_acc_min;
-    uint64_t _sys_acc_sec;
+    OVERFLOW_DROP = 0,  /* 丢弃新的日志 */
+    OVERFLOW_BLOCK,     /* 等后台线程腾出缓冲区，最多等待一段时间，超时后按OVERFLOW_DROP处理 */
+    OVERFLOW_LEVEL,     /* 低于ERROR的日志只能用预算的7/8，剩下的留给ERROR及以上 */
+    OVERFLOW_SAMPLE     /* 溢出期间每N条日志只尝试写1条，让后台线程追上来 */
 };
 
+// extern pid_t gettid();
 
 class cell_buffer
 {
@@ -127,6 +58,7 @@ public:
     status(FREE), 
     prev(NULL), 
     next(NULL), 
+    read_len(0),
     _total_len(len), 
     _used_len(0)
     {
@@ -138,57 +70,74 @@ public:
         }
     }
 
+    ~cell_buffer() { delete[] _data; }
+
+    /**
+     * @brief 返回当前缓冲区可用的大小，只由生产者调用
+     */
+    uint32_t avail_len() const { return _total_len - _used_len.load(std::memory_order_relaxed); }
+
     /**
-     * @brief 返回当前缓冲区可用的大小
+     * @brief 生产者已经写入的长度，消费者可以读到这里为止
      */
-    uint32_t avail_len() const { return _total_len - _used_len; }
+    uint32_t used_len() const { return _used_len.load(std::memory_order_acquire); }
+
+    uint32_t total_len() const { return _total_len; }
 
+    const char* data() const { return _data; }
 
     /**
      * @brief 当前缓冲区是否为空
      */
-    bool empty() const { return _used_len == 0; }
+    bool empty() const { return used_len() == 0; }
 
     /**
-     * @brief 向缓冲区中追加内容
-     * @param log_line 追加的字符串
+     * @brief 下一次写入的位置，生产者在这里直接格式化，写完后调用commit；只由生产者调用
      */
-    void append(const char* log_line, uint32_t len)
+    char* tail() { return _data + _used_len.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 写完后才发布新的长度，消费者不会读到写了一半的内容；只由生产者调用
+     * @param len 在tail()处写入的长度
+     */
+    void commit(uint32_t len)
     {
-        if (avail_len() < len)
-            return ;
-        memcpy(_data + _used_len, log_line, len);
-        _used_len += len;
+        _used_len.store(_used_len.load(std::memory_order_relaxed) + len, std::memory_order_release);
     }
 
     /**
-     * @brief 清空缓冲区
+     * @brief 预先为缓冲区建立物理页映射，避免运行时在写日志的路径上触发缺页；不修改缓冲区内容
+     * @return 预取的字节数
      */
-    void clear()
+    uint32_t prefault()
     {
-        /* 因为缓冲区的大小都是固定的，所以将_used_len置零即可 */
-        _used_len = 0;
-        status = FREE;
+#ifdef MADV_POPULATE_WRITE
+        long page = sysconf(_SC_PAGESIZE);
+        uintptr_t begin = ((uintptr_t)_data + page - 1) & ~(uintptr_t)(page - 1);
+        uintptr_t end = ((uintptr_t)_data + _total_len) & ~(uintptr_t)(page - 1);
+        if (end > begin && madvise((void*)begin, end - begin, MADV_POPULATE_WRITE) == 0)
+            return end - begin;
+#endif
+        return 0;
     }
 
     /**
-     * @brief 持久化，从缓冲区中追加内容到文件(磁盘)
-     * @param fp 文件指针
+     * @brief 清空缓冲区，由消费者在读完一个FULL的缓冲区后调用；先清长度再置FREE，生产者看到FREE时长度已经是0
      */
-    void persist(FILE* fp)
+    void clear()
     {
-        uint32_t wt_len = fwrite(_data, 1, _used_len, fp);
-        if (wt_len != _used_len)
-        {
-            fprintf(stderr, "write log to disk error, wt_len %u\n", wt_len);
-        }
-        fflush(fp);
+        /* 因为缓冲区的大小都是固定的，所以将_used_len置零即可 */
+        read_len = 0;
+        _used_len.store(0, std::memory_order_relaxed);
+        status.store(FREE, std::memory_order_release);
     }
 
-    buffer_status status;
+    std::atomic<buffer_status> status;
 
     cell_buffer* prev;  /* 指向前一个缓冲区 */
-    cell_buffer* next;  /* 指向后一个缓冲区 */
+    cell_buffer* next;  /* 指向后一个缓冲区，只由生产者修改，在把本缓冲区置为FULL之前写好 */
+
+    uint32_t read_len;  /* 消费者已经持久化到的位置 */
 
 private:
     /* 下面两个函数，禁止对象拷贝、赋值 */
@@ -196,10 +145,61 @@ private:
     cell_buffer& operator=(const cell_buffer&);
 
     uint32_t _total_len;    /* 缓冲区长度 */
-    uint32_t _used_len;     /* 缓冲区已经使用的长度 */
+    std::atomic<uint32_t> _used_len;    /* 缓冲区已经使用的长度 */
     char* _data;            /* 缓冲区 */
 };
 
+/* 缓冲区中每条日志前的记录头，后台线程按ts合并各线程的日志 */
+struct log_record
+{
+    uint64_t ts;    /* 与行首时间戳同一次发布的单调时钟毫秒数，同一毫秒内按线程先后 */
+    uint32_t len;   /* 后面日志文本(二进制日志为编号、时间和参数)的长度 */
+    uint32_t kind;  /* 0文本，1二进制 */
+};
+
+/* 一个日志文件及其按天、按大小切分的状态 */
+struct log_file
+{
+    log_file(): fp(NULL), year(0), mon(0), day(0), cnt(0), tid(0), descs(0) {}
+
+    FILE* fp;
+    int year, mon, day;
+    int cnt;        /* 日志文件计数器，从0开始 */
+    pid_t tid;      /* 按线程分文件时为所属线程，0表示所有线程共用的文件 */
+    uint32_t descs; /* 二进制日志已写入本文件的格式描述个数 */
+};
+
+/**
+ * @brief 一个生产者线程专用的缓冲区环：只有该线程在curr上追加，只有后台线程在prst上持久化，
+ *        两边通过cell_buffer的状态和已写入长度同步，追加日志不加锁。
+ *        环的结构(换缓冲区、增删缓冲区)只在持有mutex时修改，生产者每写满一个缓冲区才加一次锁
+ */
+struct log_ring
+{
+    log_ring(pid_t t, uint32_t buff_len, int buff_cnt);
+    ~log_ring();
+
+    cell_buffer* curr;  /* 生产者指针，只由所属线程访问，持有mutex时修改 */
+    cell_buffer* prst;  /* 消费者指针，只由后台线程访问 */
+    cell_buffer* head;  /* 环中任意一个缓冲区，用于遍历 */
+    std::atomic<int> buff_cnt;
+    std::atomic<uint64_t> bytes;        /* 环中所有缓冲区的总大小 */
+    uint32_t grow_len;                  /* 下一次新开缓冲区的大小，持续跟不上时翻倍，空闲收缩后复位 */
+    std::atomic<int64_t> switch_ms;     /* 最近一次换缓冲区的单调时钟毫秒数，后台线程据此判断是否空闲 */
+    /* 丢弃的汇总由所属线程在溢出结束后写出，线程退出或不再写日志时由后台线程代写；
+       以下三项持有mutex时修改，所属线程不加锁读取 */
+    std::atomic<int64_t> full_ms;       /* 最近一次缓冲区用尽的单调时钟毫秒数，0表示没有溢出过 */
+    std::atomic<int64_t> drop_ms;       /* 本次溢出第一次丢弃日志的时间 */
+    uint64_t drops[TRACE + 1];          /* 上次写出汇总以来各级别丢弃的条数 */
+    /* 以下只由所属线程访问 */
+    uint32_t sample;                    /* OVERFLOW_SAMPLE的计数 */
+    bool failed;                        /* 上一次取缓冲区失败，OVERFLOW_BLOCK在成功一次之前不再等待 */
+    pthread_mutex_t mutex;
+    pid_t tid;
+    std::atomic<bool> dead; /* 线程已退出，读完后由后台线程回收 */
+    log_file file;      /* 按线程分文件时使用 */
+};
+
 class ring_log
 {
 public:
@@ -224,44 +224,251 @@ public:
 
     void init_path(const char* log_dir, const char* prog_name, int level);
 
-    int get_level() const { return _level; }
+    int get_level() const { return _level.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 当前的日志级别，日志宏每次调用都要检查，不经过ins()里的pthread_once，只做一次relaxed读
+     */
+    static int level() { return _level.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 每个线程写到各自的文件，而不是按时间顺序合并到一个文件；需在LOG_INIT之前设置
+     */
+    void set_split(bool split) { _split = split; }
+
+    /**
+     * @brief 写二进制日志：调用处只拷贝参数，由logDecode离线格式化；需在LOG_INIT之前设置
+     */
+    void set_binary(bool binary) { _binary = binary; }
+
+    bool binary() const { return _binary; }
 
     void persist();
 
-    void try_append(const char* lvl, const char* format, ...);
+    /**
+     * @brief 为所有cell_buffer预先建立物理页映射，在启动阶段后台执行
+     * @return 预取的字节数
+     */
+    uint64_t prefault();
+
+    /**
+     * @brief 设置所有线程的日志缓冲区加起来最多占用的内存，需在LOG_INIT之前设置
+     */
+    void set_mem_limit(uint64_t bytes);
+
+    /**
+     * @brief 设置缓冲区用尽时的处理方式，需在LOG_INIT之前设置
+     * @param policy 见LOG_OVERFLOW
+     * @param arg OVERFLOW_BLOCK时为最多等待的毫秒数，OVERFLOW_SAMPLE时为N；0表示取默认值
+     */
+    void set_overflow(int policy, int arg);
+
+    /**
+     * @brief 某一级别累计丢弃的日志条数
+     */
+    uint64_t dropped(int level) const { return _dropped[level].load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 所有缓冲区当前的总大小和峰值
+     */
+    uint64_t mem_used() const { return _mem_used.load(std::memory_order_relaxed); }
+    uint64_t mem_peak() const { return _mem_peak.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 所有线程当前的缓冲区总个数
+     * @param threads 不为NULL时返回当前的线程数(缓冲区环数)
+     */
+    uint64_t buffers(size_t* threads = NULL);
+
+    /**
+     * @brief 缓冲区的占用和伸缩情况写入日志，由主线程定时调用
+     */
+    void report();
+
+    /**
+     * @brief 格式化一条日志写入当前线程的缓冲区
+     * @param level 日志级别，用于溢出时的处理和计数
+     * @param lvl 行首的级别名
+     */
+    void try_append(int level, const char* lvl, const char* format, ...);
+
+    /**
+     * @brief 写一条二进制日志，只拷贝格式描述的编号和参数
+     * @param desc 调用处的静态格式描述，第一次调用时登记
+     */
+    template <typename... Args>
+    void bin_append(int level, log_desc* desc, Args... args)
+    {
+        uint32_t id = desc->id.load(std::memory_order_acquire);
+        if (!id)
+            id = reg(desc, bin_tags<Args...>::str);
+        char* end;
+        char* p = bin_begin(level, id, &end);
+        if (!p)
+            return;
+        bin_commit(bin_put_args(p, end, args...));
+    }
+
+    /**
+     * @brief 记录后台写日志线程，供绑核使用
+     */
+    void set_writer(pthread_t tid) { _writer = tid; _has_writer = true; }
+
+    /**
+     * @brief 获取后台写日志线程，尚未启动时返回false
+     */
+    bool writer(pthread_t* tid) const
+    {
+        if (_has_writer)
+            *tid = _writer;
+        return _has_writer;
+    }
 
 private:
     ring_log();
 
-    bool decis_file(int year, int mon, int day);
+    /**
+     * @brief 当前线程的缓冲区环，第一次写日志时创建并登记
+     */
+    log_ring* thread_ring();
 
-    ring_log(const ring_log&);
-    const ring_log& operator=(const ring_log&);
+    /**
+     * @brief 线程退出时调用(pthread_key的析构函数)，标记其缓冲区环待回收
+     */
+    static void release_ring(void* ring);
+
+    /**
+     * @brief 取当前线程可写的缓冲区，放不下一条最长的日志时换下一个，必要时新开
+     * @param wait OVERFLOW_BLOCK时是否等待后台线程腾出缓冲区
+     * @return 内存用尽、丢弃这条日志时返回NULL
+     */
+    cell_buffer* writable(log_ring* ring, const clock_snapshot& now, int level, bool wait);
+
+    /**
+     * @brief 为一条日志取缓冲区，按溢出策略决定是否丢弃并计数；溢出结束后先写一行丢弃的汇总
+     * @return 丢弃这条日志时返回NULL
+     */
+    cell_buffer* reserve(log_ring* ring, const clock_snapshot& now, int level);
+
+    /**
+     * @brief 丢弃一条日志，计入所属线程和全局的计数
+     * @param full 是否因为缓冲区用尽而丢弃，是则记下溢出的时间
+     */
+    void drop(log_ring* ring, int64_t now_ms, int level, bool full);
+
+    /**
+     * @brief 取走还没写出汇总的丢弃计数并清零；所属线程和后台线程都可能调用，只有一方能取到
+     * @param force 为false时只在缓冲区已有LOG_RESUME_MS没有用尽时才取
+     * @return 没有待写的汇总时返回false
+     */
+    bool take_drops(log_ring* ring, int64_t now_ms, bool force, uint64_t* drops, int64_t* since);
+
+    /**
+     * @brief 格式化丢弃汇总的正文(不含行首的级别和时间)
+     * @return 写入buf的长度
+     */
+    int drops_text(char* buf, int len, pid_t tid, const uint64_t* drops, int64_t elapsed_ms);
+
+    /**
+     * @brief 后台线程为已退出或不再写日志的线程直接往文件里写一行丢弃汇总
+     */
+    void write_drops(log_file* file, log_ring* ring, const clock_snapshot& now);
+
+    /**
+     * @brief 在buf里格式化一条文本日志并发布，buf至少有LOG_LEN_LIMIT的空间
+     */
+    void put_text(cell_buffer* buf, const clock_snapshot& now, const char* lvl, const char* format, va_list args);
+    void put_line(cell_buffer* buf, const clock_snapshot& now, const char* lvl, const char* format, ...);
+
+    /**
+     * @brief 在预算内新开一个缓冲区，大小为ring->grow_len，预算不够时尽量开小一些；持有ring->mutex时调用
+     * @param limit 本次可用的预算
+     * @return 预算用尽时返回NULL
+     */
+    cell_buffer* grow(log_ring* ring, uint64_t limit);
+
+    /**
+     * @brief 线程空闲一段时间后，释放其环中多余的空闲缓冲区，只留当前的和一个最小的备用；由后台线程调用
+     */
+    void shrink(log_ring* ring, int64_t now_ms);
+
+    /**
+     * @brief 记录新开或释放的缓冲区大小，更新峰值
+     */
+    void mem_add(uint64_t len);
+    void mem_sub(uint64_t len);
+
+    /**
+     * @brief 登记一个格式描述，得到编号
+     */
+    uint32_t reg(log_desc* desc, const char* tags);
+
+    /**
+     * @brief 在当前线程的缓冲区里写好记录头、编号和时间
+     * @param end 参数最多写到这里
+     * @return 参数的写入位置，丢弃这条日志时返回NULL
+     */
+    char* bin_begin(int level, uint32_t id, char** end);
+
+    /**
+     * @brief 参数写到p为止，补上记录长度并发布
+     */
+    void bin_commit(char* p);
+
+    /**
+     * @brief 把一条日志写到文件，二进制日志先补写文件中还没有的格式描述
+     */
+    void write_record(log_file* file, pid_t tid, const log_record& rec, const char* text);
+
+    /**
+     * @brief 打开日志文件，二进制日志写入文件头
+     */
+    void open_file(log_file* file, const char* path);
 
-    int _buff_cnt;              /* buffer的个数——缓存区链表的长度 */
+    /**
+     * @brief 读取ring中下一条已写入的日志，读完的FULL缓冲区清空后交还生产者
+     * @return 没有可读的日志时返回false
+     */
+    static bool peek(log_ring* ring, log_record* rec, const char** text);
+
+    /**
+     * @brief 把所有线程已写入的日志写到文件：合并模式下每次取时间最早的一条，分文件模式下逐个线程写
+     * @return 写满DRAIN_LIMIT而提前结束，还有日志没写
+     */
+    bool drain();
 
-    cell_buffer* _curr_buf;     /* 生产者指针，指向当前缓存；该指针被多个生产者持有 */
-    cell_buffer* _prst_buf;     /* 消费者指针，指向持久化缓存；该指针只能被一个消费者持有 */
+    bool decis_file(log_file* file, int year, int mon, int day);
 
-    cell_buffer* last_buf;      
+    ring_log(const ring_log&);
+    const ring_log& operator=(const ring_log&);
 
-    FILE* _fp;                  /* 需要写入日志的文件的指针 */     
+    std::vector<log_ring*> _rings;   /* 所有线程的缓冲区环，登记和回收时持有_mutex */
+    std::vector<log_ring*> _draining; /* 后台线程本轮处理的缓冲区环 */
+    std::atomic<uint64_t> _mem_used; /* 所有缓冲区的总大小 */
+    std::atomic<uint64_t> _mem_peak; /* _mem_used的峰值 */
+    uint64_t _mem_limit;             /* 所有缓冲区加起来的上限 */
+    std::atomic<uint64_t> _grows;    /* 因后台线程跟不上而新开的缓冲区数 */
+    std::atomic<uint64_t> _shrinks;  /* 因空闲而释放的缓冲区数 */
+    int _overflow;                   /* 缓冲区用尽时的处理方式，见LOG_OVERFLOW */
+    int _overflow_arg;
+    std::atomic<uint64_t> _dropped[TRACE + 1];  /* 各级别累计丢弃的条数 */
+
+    log_file _file;             /* 所有线程共用的日志文件 */
+    bool _split;                /* 每个线程写各自的文件 */
+    bool _binary;               /* 写二进制日志 */
+    std::vector<log_desc*> _descs;  /* 已登记的格式描述，编号为下标加1，登记时持有_mutex */
+    int _efd;                   /* 生产者换缓冲区时通知后台线程 */
     pid_t _pid;                 /* 线程pid */ 
-    int _year, _mon, _day;      
-    int _log_cnt;               /* 日志文件计数器，从0开始 */  
     char _prog_name[128];       /* 程序名称 */
     char _log_dir[512];         
 
     bool _env_ok;               /* 当前日志的文件夹是否正常 */
-    int _level;                 /* 日志级别 */
-    uint64_t _lst_lts;          /* 代表上一次日志写入的时间戳(单位s)，如果该值非0，最后不能记录错误时间，记录错误发生在上次 */
-    
-    utc_timer _tm;
+    static std::atomic<int> _level; /* 日志级别 */
+    pthread_t _writer;          /* 后台写日志线程 */
+    bool _has_writer;
 
     static pthread_mutex_t _mutex;
-    static pthread_cond_t _cond;
-
-    static uint32_t _one_buff_len;  /* 一个缓冲区的大小 */
+    static pthread_key_t _ring_key;
 
     //singleton
     static ring_log* _ins;
@@ -270,18 +477,11 @@ private:
 
 void* be_thdo(void* args);
 
+//日志缓冲区的内存预算(字节)，超出范围时取最近的边界
 #define LOG_MEM_SET(mem_lmt) \
     do \
     { \
-        if (mem_lmt < 90 * 1024 * 1024) \
-        { \
-            mem_lmt = 90 * 1024 * 1024; \
-        } \
-        else if (mem_lmt > 1024 * 1024 * 1024) \
-        { \
-            mem_lmt = 1024 * 1024 * 1024; \
-        } \
-        ring_log::_one_buff_len = mem_lmt; \
+        ring_log::ins()->set_mem_limit(mem_lmt); \
     } while (0)
 
 #define LOG_INIT(log_dir, prog_name, level) \
@@ -291,141 +491,188 @@ void* be_thdo(void* args);
         pthread_t tid; \
         pthread_create(&tid, NULL, be_thdo, NULL); \
         pthread_detach(tid); \
+        ring_log::ins()->set_writer(tid); \
     } while (0)
 
+//编译进程序的最详细的日志级别，更详细的日志调用连同参数的求值在编译时去掉，如make LOG_LEVEL=INFO
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL TRACE
+#endif
+
+//某一级别的日志是否要写：先比较编译期的常量，再读运行时的级别
+//级别名加::限定，避免与类内同名的枚举(如http_conn::TRACE)混淆
+#define LOG_ON(lv) (::lv <= ::LOG_COMPILE_LEVEL && ring_log::level() >= ::lv)
+
+#define LOG_NAME_TRACE "[TRACE]"
+#define LOG_NAME_DEBUG "[DEBUG]"
+#define LOG_NAME_INFO "[INFO]"
+#define LOG_NAME_WARN "[WARN]"
+#define LOG_NAME_ERROR "[ERROR]"
+#define LOG_NAME_FATAL "[FATAL]"
+
 //format: [LEVEL][yy-mm-dd h:m:s.ms][tid]file_name:line_no(func_name):content
-#define LOG_TRACE(fmt, args...) \
+//二进制日志在调用处放一个静态的格式描述，只拷贝参数，还原后的格式相同
+#define LOG_APPEND(lvl, fmt, args...) \
     do \
     { \
-        if (ring_log::ins()->get_level() >= TRACE) \
+        ring_log* _log = ring_log::ins(); \
+        if (_log->binary()) \
+        { \
+            static log_desc _log_desc(LOG_NAME_##lvl, __FILE__, __LINE__, __FUNCTION__, fmt "\n"); \
+            _log->bin_append(::lvl, &_log_desc, ##args); \
+        } \
+        else \
         { \
-            ring_log::ins()->try_append("[TRACE]", "[%u]%s:%d(%s): " fmt "\n", \
+            _log->try_append(::lvl, LOG_NAME_##lvl, "[%u]%s:%d(%s): " fmt "\n", \
                     gettid(), __FILE__, __LINE__, __FUNCTION__, ##args); \
         } \
     } while (0)
 
+//热点路径上的日志：每个调用处每n次写一次，如LOG_EVERY_N(INFO, 100, "...")
+#define LOG_EVERY_N(lv, n, fmt, args...) \
+    do \
+    { \
+        if (LOG_ON(lv)) \
+        { \
+            static std::atomic<uint64_t> _log_cnt(0); \
+            if (_log_cnt.fetch_add(1, std::memory_order_relaxed) % (n) == 0) \
+                LOG_APPEND(lv, fmt, ##args); \
+        } \
+    } while (0)
+
+//热点路径上的日志：每个调用处每ms毫秒最多写一次，多个线程同时到达时只有一个写
+#define LOG_EVERY_MS(lv, ms, fmt, args...) \
+    do \
+    { \
+        if (LOG_ON(lv)) \
+        { \
+            static std::atomic<int64_t> _log_last(INT64_MIN / 2); \
+            int64_t _log_now = coarse_clock::ins()->update(); \
+            int64_t _log_prev = _log_last.load(std::memory_order_relaxed); \
+            if (_log_now - _log_prev >= (ms) && \
+                _log_last.compare_exchange_strong(_log_prev, _log_now, std::memory_order_relaxed)) \
+                LOG_APPEND(lv, fmt, ##args); \
+        } \
+    } while (0)
+
+#define LOG_TRACE(fmt, args...) \
+    do \
+    { \
+        if (LOG_ON(TRACE)) \
+        { \
+            LOG_APPEND(TRACE, fmt, ##args); \
+        } \
+    } while (0)
+
 #define LOG_DEBUG(fmt, args...) \
     do \
     { \
-        if (ring_log::ins()->get_level() >= DEBUG) \
+        if (LOG_ON(DEBUG)) \
         { \
-            ring_log::ins()->try_append("[DEBUG]", "[%u]%s:%d(%s): " fmt "\n", \
-                    gettid(), __FILE__, __LINE__, __FUNCTION__, ##args); \
+            LOG_APPEND(DEBUG, fmt, ##args); \
         } \
     } while (0)
 
 #define LOG_INFO(fmt, args...) \
     do \
     { \
-        if (ring_log::ins()->get_level() >= INFO) \
+        if (LOG_ON(INFO)) \
         { \
-            ring_log::ins()->try_append("[INFO]", "[%u]%s:%d(%s): " fmt "\n", \
-                    gettid(), __FILE__, __LINE__, __FUNCTION__, ##args); \
+            LOG_APPEND(INFO, fmt, ##args); \
         } \
     } while (0)
 
 #define LOG_NORMAL(fmt, args...) \
     do \
     { \
-        if (ring_log::ins()->get_level() >= INFO) \
+        if (LOG_ON(INFO)) \
         { \
-            ring_log::ins()->try_append("[INFO]", "[%u]%s:%d(%s): " fmt "\n", \
-                    gettid(), __FILE__, __LINE__, __FUNCTION__, ##args); \
+            LOG_APPEND(INFO, fmt, ##args); \
         } \
     } while (0)
 
 #define LOG_WARN(fmt, args...) \
     do \
     { \
-        if (ring_log::ins()->get_level() >= WARN) \
+        if (LOG_ON(WARN)) \
         { \
-            ring_log::ins()->try_append("[WARN]", "[%u]%s:%d(%s): " fmt "\n", \
-                    gettid(), __FILE__, __LINE__, __FUNCTION__, ##args); \
+            LOG_APPEND(WARN, fmt, ##args); \
         } \
     } while (0)
 
 #define LOG_ERROR(fmt, args...) \
     do \
     { \
-        if (ring_log::ins()->get_level() >= ERROR) \
+        if (LOG_ON(ERROR)) \
         { \
-            ring_log::ins()->try_append("[ERROR]", "[%u]%s:%d(%s): " fmt "\n", \
-                gettid(), __FILE__, __LINE__, __FUNCTION__, ##args); \
+            LOG_APPEND(ERROR, fmt, ##args); \
         } \
     } while (0)
 
 #define LOG_FATAL(fmt, args...) \
     do \
     { \
-        ring_log::ins()->try_append("[FATAL]", "[%u]%s:%d(%s): " fmt "\n", \
-            gettid(), __FILE__, __LINE__, __FUNCTION__, ##args); \
+        LOG_APPEND(FATAL, fmt, ##args); \
     } while (0)
 
 #define TRACE(fmt, args...) \
     do \
     { \
-        if (ring_log::ins()->get_level() >= TRACE) \
+        if (LOG_ON(TRACE)) \
         { \
-            ring_log::ins()->try_append("[TRACE]", "[%u]%s:%d(%s): " fmt "\n", \
-                    gettid(), __FILE__, __LINE__, __FUNCTION__, ##args); \
+            LOG_APPEND(TRACE, fmt, ##args); \
         } \
     } while (0)
 
 #define DEBUG(fmt, args...) \
     do \
     { \
-        if (ring_log::ins()->get_level() >= DEBUG) \
+        if (LOG_ON(DEBUG)) \
         { \
-            ring_log::ins()->try_append("[DEBUG]", "[%u]%s:%d(%s): " fmt "\n", \
-                    gettid(), __FILE__, __LINE__, __FUNCTION__, ##args); \
+            LOG_APPEND(DEBUG, fmt, ##args); \
         } \
     } while (0)
 
 #define INFO(fmt, args...) \
     do \
     { \
-        if (ring_log::ins()->get_level() >= INFO) \
+        if (LOG_ON(INFO)) \
         { \
-            ring_log::ins()->try_append("[INFO]", "[%u]%s:%d(%s): " fmt "\n", \
-                    gettid(), __FILE__, __LINE__, __FUNCTION__, ##args); \
+            LOG_APPEND(INFO, fmt, ##args); \
         } \
     } while (0)
 
 #define NORMAL(fmt, args...) \
     do \
     { \
-        if (ring_log::ins()->get_level() >= INFO) \
+        if (LOG_ON(INFO)) \
         { \
-            ring_log::ins()->try_append("[INFO]", "[%u]%s:%d(%s): " fmt "\n", \
-                    gettid(), __FILE__, __LINE__, __FUNCTION__, ##args); \
+            LOG_APPEND(INFO, fmt, ##args); \
         } \
     } while (0)
 
 #define WARN(fmt, args...) \
     do \
     { \
-        if (ring_log::ins()->get_level() >= WARN) \
+        if (LOG_ON(WARN)) \
         { \
-            ring_log::ins()->try_append("[WARN]", "[%u]%s:%d(%s): " fmt "\n", \
-                    gettid(), __FILE__, __LINE__, __FUNCTION__, ##args); \
+            LOG_APPEND(WARN, fmt, ##args); \
         } \
     } while (0)
 
 #define ERROR(fmt, args...) \
     do \
     { \
-        if (ring_log::ins()->get_level() >= ERROR) \
+        if (LOG_ON(ERROR)) \
         { \
-            ring_log::ins()->try_append("[ERROR]", "[%u]%s:%d(%s): " fmt "\n", \
-                gettid(), __FILE__, __LINE__, __FUNCTION__, ##args); \
+            LOG_APPEND(ERROR, fmt, ##args); \
         } \
     } while (0)
 
 #define FATAL(fmt, args...) \
     do \
     { \
-        ring_log::ins()->try_append("[FATAL]", "[%u]%s:%d(%s): " fmt "\n", \
-            gettid(), __FILE__, __LINE__, __FUNCTION__, ##args); \
+        LOG_APPEND(FATAL, fmt, ##args); \
     } while (0)
 
 #endif
@@ -0,0 +1,268 @@
+/*
+ * 把二进制日志(.blog)还原成文本日志，格式与文本模式相同
+ *   ./logDecode file.blog [file.blog ...] > file.log
+ * 按线程分文件(-L 1)时每个文件分别还原；时间按本机时区格式化。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "bin_log.hpp"
+
+struct desc
+{
+    uint32_t line;
+    std::string lvl, file, func, fmt, tags;
+};
+
+static bool read_n(FILE *fp, void *buf, size_t n) { return fread(buf, 1, n, fp) == n; }
+
+static bool read_str(FILE *fp, std::string *s)
+{
+    uint16_t len;
+    if (!read_n(fp, &len, sizeof(len)))
+        return false;
+    s->resize(len);
+    return len == 0 || read_n(fp, &(*s)[0], len);
+}
+
+/* 按参数类型依次读出记录中的参数 */
+struct arg_reader
+{
+    const char *tags;
+    const char *p;
+    const char *end;
+
+    /* 返回参数类型，参数不够(写日志时被截断)时返回0 */
+    char next(int64_t *i, double *d, std::string *s)
+    {
+        char tag = *tags;
+        if (!tag)
+            return 0;
+        ++tags;
+        if ('s' == tag)
+        {
+            uint32_t len;
+            if (end - p < (long)sizeof(len))
+                return 0;
+            memcpy(&len, p, sizeof(len));
+            p += sizeof(len);
+            if (len > (uint32_t)(end - p))
+                len = end - p;
+            s->assign(p, len);
+            p += len;
+            return tag;
+        }
+        if (end - p < 8)
+            return 0;
+        if ('f' == tag)
+            memcpy(d, p, sizeof(*d));
+        else
+            memcpy(i, p, sizeof(*i));
+        p += 8;
+        return tag;
+    }
+};
+
+static void append(std::string *out, const char *spec, ...)
+{
+    char buf[512];
+    va_list args;
+    va_start(args, spec);
+    int n = vsnprintf(buf, sizeof(buf), spec, args);
+    va_end(args);
+    if (n < 0)
+        return;
+    if (n < (int)sizeof(buf))
+    {
+        out->append(buf, n);
+        return;
+    }
+    std::vector<char> big(n + 1);
+    va_start(args, spec);
+    vsnprintf(&big[0], big.size(), spec, args);
+    va_end(args);
+    out->append(&big[0], n);
+}
+
+/* 按格式串逐个转换说明取参数；记录里的整数都是64位的，长度修饰统一换成ll */
+static void format(std::string *out, const char *fmt, arg_reader *args)
+{
+    int64_t i = 0;
+    double d = 0;
+    std::string s;
+    for (const char *f = fmt; *f;)
+    {
+        if (*f != '%')
+        {
+            out->push_back(*f++);
+            continue;
+        }
+        if ('%' == f[1])
+        {
+            out->push_back('%');
+            f += 2;
+            continue;
+        }
+        std::string spec = "%";
+        ++f;
+        while (*f && strchr("-+ #0", *f))
+            spec.push_back(*f++);
+        for (int part = 0; part < 2; ++part)
+        {
+            if ('*' == *f)
+            {
+                /* 宽度或精度由参数给出 */
+                ++f;
+                int64_t w = 0;
+                if (args->next(&w, &d, &s) == 'i')
+                    spec += std::to_string(w);
+            }
+            while (*f >= '0' && *f <= '9')
+                spec.push_back(*f++);
+            if (0 == part && '.' == *f)
+                spec.push_back(*f++);
+            else
+                break;
+        }
+        while (*f && strchr("hlLqjzt", *f))
+            ++f;
+        char conv = *f;
+        if (!conv)
+            break;
+        ++f;
+
+        char tag = args->next(&i, &d, &s);
+        if (!tag)
+        {
+            out->append("<?>");
+            continue;
+        }
+        if ('s' == tag)
+        {
+            append(out, (spec + "s").c_str(), s.c_str());
+        }
+        else if ('f' == tag)
+        {
+            if (strchr("eEfFgGaA", conv))
+                append(out, (spec + conv).c_str(), d);
+            else
+                append(out, (spec + "g").c_str(), d);
+        }
+        else if (strchr("di", conv))
+            append(out, (spec + "lld").c_str(), (long long)i);
+        else if (strchr("ouxX", conv))
+            append(out, (spec + "ll" + conv).c_str(), (unsigned long long)i);
+        else if ('c' == conv)
+            append(out, (spec + "c").c_str(), (int)i);
+        else if ('p' == conv)
+            append(out, (spec + "p").c_str(), (void *)(uintptr_t)i);
+        else if (strchr("eEfFgGaA", conv))
+            append(out, (spec + conv).c_str(), (double)i);
+        else
+            append(out, "%lld", (long long)i);
+    }
+}
+
+static int decode(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return 1;
+    }
+    char magic[8];
+    uint32_t pid;
+    if (!read_n(fp, magic, sizeof(magic)) || memcmp(magic, BIN_LOG_MAGIC, sizeof(magic)) ||
+        !read_n(fp, &pid, sizeof(pid)))
+    {
+        fprintf(stderr, "%s: not a binary log\n", path);
+        fclose(fp);
+        return 1;
+    }
+
+    std::vector<desc> descs;
+    std::vector<char> payload;
+    std::string out;
+    long lines = 0, bad = 0;
+    char kind;
+    while (read_n(fp, &kind, 1))
+    {
+        if (BIN_DESC == kind)
+        {
+            uint32_t id;
+            desc d;
+            if (!read_n(fp, &id, sizeof(id)) || !read_n(fp, &d.line, sizeof(d.line)) || !read_str(fp, &d.lvl) ||
+                !read_str(fp, &d.file) || !read_str(fp, &d.func) || !read_str(fp, &d.fmt) || !read_str(fp, &d.tags))
+                break;
+            if (id > descs.size())
+                descs.resize(id);
+            descs[id - 1] = d;
+            continue;
+        }
+
+        uint32_t tid = 0, len;
+        if ((BIN_LINE == kind && !read_n(fp, &tid, sizeof(tid))) || !read_n(fp, &len, sizeof(len)))
+            break;
+        payload.resize(len);
+        if (len && !read_n(fp, &payload[0], len))
+            break;
+        ++lines;
+        if (BIN_TEXT == kind)
+        {
+            fwrite(payload.data(), 1, len, stdout);
+            continue;
+        }
+
+        /* 编号 | real_ms | 参数 */
+        uint32_t id;
+        int64_t real_ms;
+        if (len < sizeof(id) + sizeof(real_ms))
+        {
+            ++bad;
+            continue;
+        }
+        memcpy(&id, &payload[0], sizeof(id));
+        memcpy(&real_ms, &payload[sizeof(id)], sizeof(real_ms));
+        if (0 == id || id > descs.size())
+        {
+            ++bad;
+            continue;
+        }
+        const desc &d = descs[id - 1];
+
+        time_t sec = real_ms / 1000;
+        struct tm tm;
+        localtime_r(&sec, &tm);
+        char ts[32];
+        strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &tm);
+
+        out.clear();
+        append(&out, "%s[%s.%03d][%u]%s:%u(%s): ", d.lvl.c_str(), ts, (int)(real_ms % 1000), tid, d.file.c_str(),
+               d.line, d.func.c_str());
+        arg_reader args = {d.tags.c_str(), &payload[0] + sizeof(id) + sizeof(real_ms), &payload[0] + len};
+        format(&out, d.fmt.c_str(), &args);
+        fwrite(out.data(), 1, out.size(), stdout);
+    }
+    fclose(fp);
+    fprintf(stderr, "%s: pid=%u formats=%zu lines=%ld bad=%ld\n", path, pid, descs.size(), lines, bad);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s file.blog [file.blog ...]\n", argv[0]);
+        return 1;
+    }
+    int ret = 0;
+    for (int i = 1; i < argc; ++i)
+        ret |= decode(argv[i]);
+    return ret;
+}
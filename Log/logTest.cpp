@@ -0,0 +1,292 @@
+/*
+ * 多线程写日志的开销与后台线程的写出速度
+ *   ./logTest [max_threads] [lines] [split] [binary] [mem_mb] [overflow] [overflow_arg]
+ * threads = 1, 2, 4 ... max_threads，每个线程各写lines行INFO日志(每1000行中有1行ERROR)：
+ *   mutex  原来的写法：所有线程共用一个缓冲区，持锁格式化并拷入(缓冲区写满后直接清空，不计写文件)
+ *   ring   ring_log：每个线程写自己的缓冲区环，不加锁，写满一块才通知后台线程
+ * producer为写日志的线程每行平均占用的CPU时间(不含等锁睡眠和被抢占的时间)；drained为从开始写到后台线程把最后一行写进文件为止的吞吐。
+ * split非0时每个线程写各自的文件(-L 1)，否则按时间顺序合并到一个文件。
+ * 另外先在单线程上测量不写日志的调用的开销：
+ *   filtered   低于当前级别的LOG_DEBUG，只读一次缓存的级别
+ *   once       原来的检查方式，每次经过ins()里的pthread_once再取级别
+ *   every_n    LOG_EVERY_N(INFO, 1000000)，绝大多数调用只累加计数
+ *   every_ms   LOG_EVERY_MS(INFO, 60000)，绝大多数调用只读粗粒度时钟
+ * binary非0时ring写二进制日志(-B 1)：只拷贝参数，写完后用logDecode还原，检查行数与文本模式一致。
+ * mem_mb为缓冲区的内存预算(-M)，ring一行后面的mem为各线程退出、缓冲区回收之前的峰值；
+ * 最后主线程连续写一阵再空闲，看缓冲区是否先变大、空闲后收缩回去，没有收缩回去时返回1。
+ * overflow为缓冲区用尽时的处理方式(-O，见LOG_OVERFLOW)，预算较小时ring一行后面给出本轮丢弃的INFO和ERROR条数；
+ * 文本模式下最后数一遍文件中ring写的行数，lost为既没写进文件也没计入丢弃的行数，应当为0；
+ * 有丢弃时各线程的汇总行(summaries)报告的条数之和(summarized)应等于丢弃数，否则返回1。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "log.hpp"
+
+#define LOG_DIR "/tmp/logTest"
+
+/* 空闲收缩后每个线程只留当前缓冲区(最大1MB，正在写的缓冲区不能换掉)和一个64KB的备用 */
+#define IDLE_BUFFERS 2
+#define IDLE_MEM_MAX (1024 * 1024 + 64 * 1024)
+
+static uint64_t now_ns(clockid_t id = CLOCK_MONOTONIC)
+{
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static long g_lines;
+static std::atomic<long> g_ring_lines(0); /* run_ring写的总行数 */
+
+/* 原来的共享缓冲区 */
+static pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char g_buf[1024 * 1024];
+static uint32_t g_used;
+
+static void locked_append(const char *lvl, const char *format, ...)
+{
+    clock_snapshot snap;
+    coarse_clock::ins()->update();
+    coarse_clock::ins()->read(&snap);
+
+    pthread_mutex_lock(&g_mutex);
+    if (sizeof(g_buf) - g_used < 1024)
+        g_used = 0;
+    char *p = g_buf + g_used;
+    int len = snprintf(p, 64, "%s[%s.%03d]", lvl, snap.log_fmt, (int)(snap.real_ms % 1000));
+    va_list args;
+    va_start(args, format);
+    len += vsnprintf(p + len, 1024 - len, format, args);
+    va_end(args);
+    g_used += len;
+    pthread_mutex_unlock(&g_mutex);
+}
+
+static void *run_mutex(void *arg)
+{
+    uint64_t begin = now_ns(CLOCK_THREAD_CPUTIME_ID);
+    for (long i = 0; i < g_lines; ++i)
+        locked_append("[INFO]", "[%u]%s:%d(%s): request %ld from 192.168.1.%ld done\n", gettid(), __FILE__, __LINE__,
+                      __FUNCTION__, i, i & 255);
+    *(uint64_t *)arg = now_ns(CLOCK_THREAD_CPUTIME_ID) - begin;
+    return NULL;
+}
+
+static void *run_ring(void *arg)
+{
+    uint64_t begin = now_ns(CLOCK_THREAD_CPUTIME_ID);
+    for (long i = 0; i < g_lines; ++i)
+    {
+        if (i % 1000 == 999)
+            LOG_ERROR("request %ld from 192.168.1.%ld failed", i, i & 255);
+        else
+            LOG_INFO("request %ld from 192.168.1.%ld done", i, i & 255);
+    }
+    g_ring_lines.fetch_add(g_lines);
+    if (arg)
+        *(uint64_t *)arg = now_ns(CLOCK_THREAD_CPUTIME_ID) - begin;
+    return NULL;
+}
+
+/* 不写日志的调用，每次的平均耗时 */
+static void bench_skip(const char *name, int kind, long calls)
+{
+    uint64_t begin = now_ns();
+    for (long i = 0; i < calls; ++i)
+    {
+        switch (kind)
+        {
+        case 0:
+            LOG_DEBUG("request %ld", i);
+            break;
+        case 1:
+            if (ring_log::ins()->get_level() >= DEBUG)
+                LOG_APPEND(DEBUG, "request %ld", i);
+            break;
+        case 2:
+            LOG_EVERY_N(INFO, 1000000, "request %ld", i);
+            break;
+        default:
+            LOG_EVERY_MS(INFO, 60000, "request %ld", i);
+            break;
+        }
+    }
+    printf("%-9s %5.1fns/call\n", name, (double)(now_ns() - begin) / calls);
+}
+
+/* 日志目录下所有文件的总大小 */
+static long long dir_size()
+{
+    long long total = 0;
+    DIR *dir = opendir(LOG_DIR);
+    if (!dir)
+        return 0;
+    struct dirent *ent;
+    char path[512];
+    while ((ent = readdir(dir)))
+    {
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", LOG_DIR, ent->d_name);
+        if (ent->d_name[0] != '.' && stat(path, &st) == 0)
+            total += st.st_size;
+    }
+    closedir(dir);
+    return total;
+}
+
+/* 文本日志中run_ring写的行数，丢弃汇总的行数和其中报告的丢弃条数 */
+static void count_lines(long long *lines, long long *summaries, long long *summarized)
+{
+    *lines = *summaries = *summarized = 0;
+    DIR *dir = opendir(LOG_DIR);
+    if (!dir)
+        return;
+    struct dirent *ent;
+    char path[512];
+    static char line[8192];
+    while ((ent = readdir(dir)))
+    {
+        snprintf(path, sizeof(path), "%s/%s", LOG_DIR, ent->d_name);
+        FILE *fp = ent->d_name[0] != '.' ? fopen(path, "r") : NULL;
+        if (!fp)
+            continue;
+        while (fgets(line, sizeof(line), fp))
+        {
+            if (strstr(line, " from 192.168.1."))
+                ++*lines;
+            else if (const char *p = strstr(line, "log overflow: dropped "))
+            {
+                ++*summaries;
+                *summarized += atoll(p + strlen("log overflow: dropped "));
+            }
+        }
+        fclose(fp);
+    }
+    closedir(dir);
+}
+
+static void bench(const char *name, void *(*fn)(void *), int threads, bool wait_drain)
+{
+    pthread_t tids[64];
+    uint64_t ns[64];
+    long long size = dir_size();
+    uint64_t info = ring_log::ins()->dropped(INFO), error = ring_log::ins()->dropped(ERROR);
+    uint64_t begin = now_ns();
+    for (int i = 0; i < threads; ++i)
+        pthread_create(&tids[i], NULL, fn, &ns[i]);
+    uint64_t sum = 0;
+    for (int i = 0; i < threads; ++i)
+    {
+        pthread_join(tids[i], NULL);
+        sum += ns[i];
+    }
+    uint64_t end = now_ns();
+
+    /* 文件大小200ms不再增长时认为已经写完，最后一次增长的时刻为写完的时刻 */
+    long long bytes = 0;
+    if (wait_drain)
+    {
+        uint64_t quiet = now_ns();
+        long long last = dir_size();
+        while (now_ns() - quiet < 200000000ull)
+        {
+            usleep(1000);
+            long long cur = dir_size();
+            if (cur != last)
+            {
+                last = cur;
+                end = quiet = now_ns();
+            }
+        }
+        bytes = last - size;
+    }
+    double total = (double)threads * g_lines;
+    printf("%-6s threads=%2d producer=%7.1fns/line drained=%6.2fM lines/s", name, threads, (double)sum / total,
+           total / ((end - begin) / 1e3));
+    if (wait_drain)
+        printf(" bytes=%lld mem=%.1fMB", bytes, ring_log::ins()->mem_peak() / 1048576.0);
+    info = ring_log::ins()->dropped(INFO) - info;
+    error = ring_log::ins()->dropped(ERROR) - error;
+    if (info || error)
+        printf(" dropped info=%llu error=%llu", (unsigned long long)info, (unsigned long long)error);
+    printf("\n");
+}
+
+/* 主线程写lines行，然后空闲，每秒看一次缓冲区的总大小；其他线程都已退出，最后应只剩主线程收缩后的缓冲区 */
+static bool bench_idle(int seconds)
+{
+    run_ring(NULL);
+    printf("idle   after burst mem=%.2fMB\n", ring_log::ins()->mem_used() / 1048576.0);
+    for (int i = 1; i <= seconds; ++i)
+    {
+        sleep(1);
+        if (i % 4 == 0 || i == seconds)
+            printf("idle   %2ds mem=%.2fMB\n", i, ring_log::ins()->mem_used() / 1048576.0);
+    }
+    /* 日志空闲超过10s，缓冲区应收缩到每个线程的下限：多出来的缓冲区都已释放 */
+    size_t threads;
+    uint64_t buffers = ring_log::ins()->buffers(&threads);
+    uint64_t mem = ring_log::ins()->mem_used();
+    if (buffers > IDLE_BUFFERS * threads || mem > IDLE_MEM_MAX * threads)
+    {
+        printf("idle   FAIL: buffers did not shrink, threads=%zu buffers=%llu mem=%.2fMB\n", threads,
+               (unsigned long long)buffers, mem / 1048576.0);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    int max_threads = argc > 1 ? atoi(argv[1]) : 32;
+    g_lines = argc > 2 ? atol(argv[2]) : 100000;
+    bool split = argc > 3 && atoi(argv[3]);
+    bool binary = argc > 4 && atoi(argv[4]);
+    uint64_t mem_mb = argc > 5 ? atoi(argv[5]) : 64;
+    int overflow = argc > 6 ? atoi(argv[6]) : OVERFLOW_DROP;
+    int overflow_arg = argc > 7 ? atoi(argv[7]) : 0;
+    if (max_threads > 64)
+        max_threads = 64;
+
+    ring_log::ins()->set_split(split);
+    ring_log::ins()->set_binary(binary);
+    LOG_MEM_SET(mem_mb * 1024 * 1024);
+    ring_log::ins()->set_overflow(overflow, overflow_arg);
+    LOG_INIT(LOG_DIR, "logTest", INFO);
+
+    bench_skip("filtered", 0, 10000000);
+    bench_skip("once", 1, 10000000);
+    bench_skip("every_n", 2, 10000000);
+    bench_skip("every_ms", 3, 10000000);
+
+    for (int threads = 1; threads <= max_threads; threads *= 2)
+    {
+        bench("mutex", run_mutex, threads, false);
+        bench("ring", run_ring, threads, true);
+    }
+    int ret = bench_idle(12) ? 0 : 1;
+
+    if (!binary)
+    {
+        long long lines, summaries, summarized;
+        count_lines(&lines, &summaries, &summarized);
+        uint64_t dropped = ring_log::ins()->dropped(INFO) + ring_log::ins()->dropped(ERROR);
+        printf("total  lines=%ld written=%lld dropped=%llu summaries=%lld summarized=%lld lost=%lld\n",
+               g_ring_lines.load(), lines, (unsigned long long)dropped, summaries, summarized,
+               g_ring_lines.load() - lines - (long long)dropped);
+        /* 所有线程都已退出或空闲了足够久，每一条丢弃都应出现在某一行汇总里 */
+        if (summarized != (long long)dropped)
+        {
+            printf("total  FAIL: %llu lines dropped but summaries cover %lld\n", (unsigned long long)dropped,
+                   summarized);
+            ret = 1;
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,90 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "admission.hpp"
+#include "../Log/log.hpp"
+
+static const char BUSY_BODY[] = "<html><body>503 Service Unavailable: server busy, retry later</body></html>";
+
+admission::admission()
+    : m_mode(SHED_OFF), m_wait_us(0), m_fd_limit(0), m_spare(-1), m_paused(false), m_busy_len(0), m_rejected(0),
+      m_emfile(0), m_pauses(0)
+{
+}
+
+admission::~admission()
+{
+    if (m_spare >= 0)
+        close(m_spare);
+}
+
+void admission::init(int mode, int wait_ms, int max_fd)
+{
+    m_mode = mode;
+    m_wait_us = wait_ms > 0 ? wait_ms * 1000ull : 0;
+
+    struct rlimit rl;
+    m_fd_limit = max_fd;
+    if (0 == getrlimit(RLIMIT_NOFILE, &rl) && rl.rlim_cur != RLIM_INFINITY && (rlim_t)m_fd_limit > rl.rlim_cur)
+        m_fd_limit = (int)rl.rlim_cur;
+
+    m_busy_len = snprintf(m_busy, sizeof(m_busy),
+                          "HTTP/1.1 503 Service Unavailable\r\nRetry-After: %d\r\nContent-Length: %d\r\n"
+                          "Content-Type: text/html\r\nConnection: close\r\n\r\n%s",
+                          ADMIT_RETRY_AFTER, (int)sizeof(BUSY_BODY) - 1, BUSY_BODY);
+
+    m_spare = open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+bool admission::fd_exhausted(int connfd, int users) const
+{
+    return connfd >= m_fd_limit || users >= m_fd_limit - ADMIT_FD_RESERVE;
+}
+
+bool admission::overloaded(size_t queued, int depth, uint64_t wait_us, bool low) const
+{
+    if (queued * 100 >= (size_t)depth * (low ? ADMIT_DEPTH_LOW : ADMIT_DEPTH_HIGH))
+        return true;
+    /* 队列已空时最近的排队时间已经过时，不再作为依据 */
+    return m_wait_us && queued && wait_us > (low ? m_wait_us / 2 : m_wait_us);
+}
+
+void admission::reject(int connfd)
+{
+    send(connfd, m_busy, m_busy_len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    m_rejected++;
+}
+
+bool admission::on_emfile(int listenfd)
+{
+    if (m_spare < 0)
+        return false;
+    close(m_spare);
+    m_spare = -1;
+    int connfd = accept(listenfd, NULL, NULL);
+    if (connfd >= 0)
+    {
+        reject(connfd);
+        close(connfd);
+        m_emfile++;
+    }
+    m_spare = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    return connfd >= 0;
+}
+
+void admission::set_paused(bool paused)
+{
+    m_paused = paused;
+    if (paused)
+        m_pauses++;
+}
+
+void admission::report()
+{
+    LOG_INFO("admission: mode=%d rejected=%llu emfile=%llu pauses=%llu paused=%d fd_limit=%d", m_mode,
+             (unsigned long long)m_rejected, (unsigned long long)m_emfile, (unsigned long long)m_pauses,
+             (int)m_paused, m_fd_limit);
+}
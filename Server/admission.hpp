@@ -0,0 +1,87 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* 准入控制的阈值 */
+#define ADMIT_DEPTH_HIGH 80  //积压达到队列上限的该百分比视为过载
+#define ADMIT_DEPTH_LOW 50   //暂停accept后积压降到该百分比以下、排队时间降到阈值一半以下才恢复
+#define ADMIT_FD_RESERVE 32  //为日志、数据库连接等保留的文件描述符数
+#define ADMIT_RETRY_AFTER 1  //503响应中Retry-After的秒数
+#define ADMIT_POLL_MS 10     //暂停accept期间事件循环检查能否恢复的间隔
+
+/**
+ * @brief 准入控制：根据线程池的积压、排队时间和剩余的文件描述符决定是否接收连接和请求。
+ *        拒绝时从预先格式化好的缓冲区发送503和Retry-After，事件循环不用临时拼接响应；
+ *        另外占住一个空闲描述符，accept遇到EMFILE时释放它接下连接、回复503后关闭，
+ *        否则监听socket一直可读，事件循环会空转。
+ *        只由事件循环线程调用。
+ */
+class admission
+{
+public:
+    /* 过载时的处理方式 */
+    enum SHED_MODE
+    {
+        SHED_OFF = 0, //只在队列已满或描述符耗尽时拒绝
+        SHED_REJECT,  //积压或排队时间超过阈值时对新请求回复503
+        SHED_PAUSE    //同上，另外所有线程池都过载时暂停accept，新连接留在内核的全连接队列中
+    };
+
+    admission();
+    ~admission();
+
+    /**
+     * @param mode 见SHED_MODE
+     * @param wait_ms 排队时间阈值(毫秒)
+     * @param max_fd 连接对象数组的大小，描述符不能超过它
+     */
+    void init(int mode, int wait_ms, int max_fd);
+
+    int mode() const { return m_mode; }
+
+    /* 新连接的描述符超出可用范围，或剩余的描述符不足 */
+    bool fd_exhausted(int connfd, int users) const;
+
+    /**
+     * @brief 队列是否过载：积压达到上限的ADMIT_DEPTH_HIGH%，或队列非空且最近的排队时间超过阈值；
+     *        low为true时用较低的阈值，判断暂停accept后能否恢复
+     */
+    bool overloaded(size_t queued, int depth, uint64_t wait_us, bool low = false) const;
+
+    /**
+     * @brief 向connfd非阻塞地发送503响应，不关闭连接；响应只有一百多字节，发送不完整就放弃
+     */
+    void reject(int connfd);
+
+    /**
+     * @brief accept返回EMFILE或ENFILE时调用：释放空闲描述符接下一个连接，回复503后关闭，再重新占住空闲描述符
+     * @return 是否处理了一个连接
+     */
+    bool on_emfile(int listenfd);
+
+    /* 记录accept的暂停与恢复 */
+    void set_paused(bool paused);
+    bool paused() const { return m_paused; }
+
+    /**
+     * @brief 将拒绝、描述符耗尽、暂停accept的计数写入日志
+     */
+    void report();
+
+private:
+    int m_mode;
+    uint64_t m_wait_us; //排队时间阈值
+    int m_fd_limit;     //可用的描述符上限，取RLIMIT_NOFILE与max_fd中较小的
+    int m_spare;        //EMFILE时使用的空闲描述符
+    bool m_paused;
+    char m_busy[256];   //预先格式化的503响应
+    int m_busy_len;
+
+    uint64_t m_rejected; //回复503的请求和连接数
+    uint64_t m_emfile;   //描述符耗尽时拒绝的连接数
+    uint64_t m_pauses;   //暂停accept的次数
+};
+
+#endif
@@ -0,0 +1,206 @@
+#include <dirent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <algorithm>
+#include "cpu_affinity.hpp"
+
+static pthread_once_t g_topology_once = PTHREAD_ONCE_INIT;
+static vector<int> g_cpu_node; //下标为CPU编号，值为所在节点
+static int g_nodes = 1;
+
+/* 解析"0-3,8"形式的列表，不检查CPU是否存在 */
+static bool parse_list(const char *p, vector<int> &out)
+{
+    out.clear();
+    while (*p && '\n' != *p)
+    {
+        char *end;
+        long lo = strtol(p, &end, 10);
+        if (end == p || lo < 0)
+            return false;
+        long hi = lo;
+        p = end;
+        if ('-' == *p)
+        {
+            hi = strtol(p + 1, &end, 10);
+            if (end == p + 1 || hi < lo)
+                return false;
+            p = end;
+        }
+        for (long c = lo; c <= hi; ++c)
+            out.push_back((int)c);
+        if (',' == *p)
+            ++p;
+        else if (*p && '\n' != *p)
+            return false;
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return true;
+}
+
+void cpu_affinity::load_topology()
+{
+    long ncpu = sysconf(_SC_NPROCESSORS_CONF);
+    g_cpu_node.assign(ncpu > 0 ? ncpu : 1, 0);
+
+    DIR *dir = opendir("/sys/devices/system/node");
+    if (!dir)
+        return;
+    int max_node = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        int node;
+        if (sscanf(entry->d_name, "node%d", &node) != 1)
+            continue;
+        char path[512], line[4096];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/%s/cpulist", entry->d_name);
+        FILE *fp = fopen(path, "r");
+        if (!fp)
+            continue;
+        vector<int> cpus;
+        if (fgets(line, sizeof(line), fp) && parse_list(line, cpus))
+        {
+            for (size_t i = 0; i < cpus.size(); ++i)
+                if (cpus[i] < (int)g_cpu_node.size())
+                    g_cpu_node[cpus[i]] = node;
+        }
+        fclose(fp);
+        max_node = std::max(max_node, node);
+    }
+    closedir(dir);
+    g_nodes = max_node + 1;
+}
+
+bool cpu_affinity::parse(const string &spec, vector<int> &cpus)
+{
+    pthread_once(&g_topology_once, load_topology);
+    if (!parse_list(spec.c_str(), cpus) || cpus.empty())
+        return false;
+    return cpus.back() < (int)g_cpu_node.size() && cpus.back() < CPU_SETSIZE;
+}
+
+string cpu_affinity::format(const vector<int> &cpus)
+{
+    string out;
+    char buf[32];
+    for (size_t i = 0; i < cpus.size();)
+    {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+            ++j;
+        if (j > i)
+            snprintf(buf, sizeof(buf), "%s%d-%d", out.empty() ? "" : ",", cpus[i], cpus[j]);
+        else
+            snprintf(buf, sizeof(buf), "%s%d", out.empty() ? "" : ",", cpus[i]);
+        out += buf;
+        i = j + 1;
+    }
+    return out;
+}
+
+static void to_set(const vector<int> &cpus, cpu_set_t &set)
+{
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cpus.size(); ++i)
+        CPU_SET(cpus[i], &set);
+}
+
+bool cpu_affinity::pin(pthread_t tid, const vector<int> &cpus)
+{
+    cpu_set_t set;
+    to_set(cpus, set);
+    return pthread_setaffinity_np(tid, sizeof(set), &set) == 0;
+}
+
+bool cpu_affinity::pin_attr(pthread_attr_t *attr, const vector<int> &cpus)
+{
+    cpu_set_t set;
+    to_set(cpus, set);
+    return pthread_attr_setaffinity_np(attr, sizeof(set), &set) == 0;
+}
+
+bool cpu_affinity::allowed(pthread_t tid, vector<int> &cpus)
+{
+    cpu_set_t set;
+    cpus.clear();
+    if (pthread_getaffinity_np(tid, sizeof(set), &set) != 0)
+        return false;
+    for (int c = 0; c < CPU_SETSIZE; ++c)
+        if (CPU_ISSET(c, &set))
+            cpus.push_back(c);
+    return true;
+}
+
+int cpu_affinity::node_of(int cpu)
+{
+    pthread_once(&g_topology_once, load_topology);
+    if (cpu < 0 || cpu >= (int)g_cpu_node.size())
+        return 0;
+    return g_cpu_node[cpu];
+}
+
+int cpu_affinity::node_count()
+{
+    pthread_once(&g_topology_once, load_topology);
+    return g_nodes;
+}
+
+vector<int> cpu_affinity::nodes_of(const vector<int> &cpus)
+{
+    vector<int> nodes;
+    for (size_t i = 0; i < cpus.size(); ++i)
+        nodes.push_back(node_of(cpus[i]));
+    std::sort(nodes.begin(), nodes.end());
+    nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+    return nodes;
+}
+
+bool cpu_affinity::set_policy(void *addr, size_t len, int mode, const vector<int> &nodes)
+{
+    /* 只有一个节点时内存放在哪里都一样，不必进入内核 */
+    if (node_count() <= 1 || nodes.empty())
+        return true;
+
+    long page = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = ((uintptr_t)addr + page - 1) & ~(uintptr_t)(page - 1);
+    uintptr_t end = ((uintptr_t)addr + len) & ~(uintptr_t)(page - 1);
+    if (end <= begin)
+        return true;
+
+    const int bits = sizeof(unsigned long) * 8;
+    unsigned long mask[1024 / (sizeof(unsigned long) * 8)];
+    memset(mask, 0, sizeof(mask));
+    for (size_t i = 0; i < nodes.size(); ++i)
+        if (nodes[i] >= 0 && nodes[i] < 1024)
+            mask[nodes[i] / bits] |= 1UL << (nodes[i] % bits);
+    /* 内核把maxnode减一后作为位数，所以要多传一位 */
+    return syscall(SYS_mbind, begin, end - begin, mode, mask, 1024 + 1, MPOL_MF_MOVE) == 0;
+}
+
+bool cpu_affinity::bind(void *addr, size_t len, int node)
+{
+    return set_policy(addr, len, MPOL_PREFERRED, vector<int>(1, node));
+}
+
+bool cpu_affinity::interleave(void *addr, size_t len, const vector<int> &nodes)
+{
+    if (nodes.size() == 1)
+        return bind(addr, len, nodes[0]);
+    return set_policy(addr, len, MPOL_INTERLEAVE, nodes);
+}
+
+void *cpu_affinity::alloc_pages(size_t len)
+{
+    void *p = NULL;
+    if (posix_memalign(&p, sysconf(_SC_PAGESIZE), len ? len : 1) != 0)
+        return NULL;
+    return p;
+}
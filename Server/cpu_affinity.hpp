@@ -0,0 +1,74 @@
+#ifndef CPU_AFFINITY_H
+#define CPU_AFFINITY_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+/**
+ * @brief 线程绑核与NUMA内存放置。CPU与节点的对应关系读自/sys/devices/system/node，
+ *        内存策略直接调用mbind系统调用，不依赖libnuma；单节点机器上内存相关的操作都是空操作。
+ */
+class cpu_affinity
+{
+public:
+    /**
+     * @brief 解析CPU列表，格式与taskset -c相同，如"0-3,8,10-11"
+     * @return 格式错误、为空或包含不存在的CPU时返回false
+     */
+    static bool parse(const string &spec, vector<int> &cpus);
+
+    /**
+     * @brief 把CPU列表格式化为"0-3,8"的形式
+     */
+    static string format(const vector<int> &cpus);
+
+    /**
+     * @brief 把线程绑定到cpus中的CPU上
+     */
+    static bool pin(pthread_t tid, const vector<int> &cpus);
+
+    /**
+     * @brief 设置线程属性，使新线程从创建起就只在cpus上运行，栈的首次访问即落在本地节点
+     */
+    static bool pin_attr(pthread_attr_t *attr, const vector<int> &cpus);
+
+    /**
+     * @brief 读取线程当前允许运行的CPU
+     */
+    static bool allowed(pthread_t tid, vector<int> &cpus);
+
+    /* CPU所在的NUMA节点，未知时返回0 */
+    static int node_of(int cpu);
+
+    /* 系统中NUMA节点的个数，至少为1 */
+    static int node_count();
+
+    /* 一组CPU所在的节点，去重后升序排列 */
+    static vector<int> nodes_of(const vector<int> &cpus);
+
+    /**
+     * @brief 把[addr, addr+len)完整覆盖的页优先放在node上，已分配的页会被迁移过去
+     */
+    static bool bind(void *addr, size_t len, int node);
+
+    /**
+     * @brief 把[addr, addr+len)完整覆盖的页按页轮流放在nodes上，已分配的页会被迁移
+     */
+    static bool interleave(void *addr, size_t len, const vector<int> &nodes);
+
+    /**
+     * @brief 分配按页对齐的内存，不访问其内容，便于在首次访问前设置内存策略；用free释放
+     */
+    static void *alloc_pages(size_t len);
+
+private:
+    static bool set_policy(void *addr, size_t len, int mode, const vector<int> &nodes);
+    static void load_topology();
+};
+
+#endif
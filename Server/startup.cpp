@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <sys/time.h>
+#include "startup.hpp"
+#include "../Log/log.hpp"
+
+startup_phases::startup_phases() : m_start_us(0)
+{
+}
+
+startup_phases::~startup_phases()
+{
+    wait_all();
+}
+
+long startup_phases::now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000L + tv.tv_usec;
+}
+
+int startup_phases::add(const char *name, phase_func func, void *arg, bool required, int after)
+{
+    phase p;
+    p.name = name;
+    p.func = func;
+    p.arg = arg;
+    p.required = required;
+    p.after = after;
+    p.done = false;
+    p.started = false;
+    p.begin_us = 0;
+    p.end_us = 0;
+    p.owner = this;
+    m_phases.push_back(p);
+    return (int)m_phases.size() - 1;
+}
+
+void startup_phases::wait_phase(int idx)
+{
+    m_lock.lock();
+    while (!m_phases[idx].done)
+        m_cond.wait(m_lock.get());
+    m_lock.unlock();
+}
+
+void *startup_phases::phase_worker(void *arg)
+{
+    phase *p = (phase *)arg;
+    startup_phases *owner = p->owner;
+
+    /* 先等前置阶段完成，例如读取用户表必须等数据库连接池建好 */
+    if (p->after >= 0)
+        owner->wait_phase(p->after);
+
+    long begin = now_us();
+    p->func(p->arg);
+    long end = now_us();
+
+    owner->m_lock.lock();
+    p->begin_us = begin - owner->m_start_us;
+    p->end_us = end - owner->m_start_us;
+    p->done = true;
+    owner->m_cond.broadcast();
+    owner->m_lock.unlock();
+
+    LOG_INFO("startup phase %s%s: waited %ld ms, ran %ld ms", p->name, p->required ? "" : "(background)",
+             p->begin_us / 1000, (p->end_us - p->begin_us) / 1000);
+    printf("startup phase %s: waited %ld ms, ran %ld ms\n", p->name, p->begin_us / 1000, (p->end_us - p->begin_us) / 1000);
+    return NULL;
+}
+
+void startup_phases::run()
+{
+    m_start_us = now_us();
+
+    /* 注册完毕后m_phases不再扩容，可以安全地把元素地址交给线程 */
+    for (size_t i = 0; i < m_phases.size(); ++i)
+    {
+        if (pthread_create(&m_phases[i].tid, NULL, phase_worker, &m_phases[i]) != 0)
+        {
+            /* 建线程失败就退化为在当前线程执行 */
+            phase_worker(&m_phases[i]);
+            continue;
+        }
+        m_phases[i].started = true;
+    }
+
+    for (size_t i = 0; i < m_phases.size(); ++i)
+    {
+        if (m_phases[i].required)
+            wait_phase(i);
+    }
+
+    long ready = now_us() - m_start_us;
+    LOG_INFO("startup: required phases ready after %ld ms", ready / 1000);
+    printf("startup: required phases ready after %ld ms\n", ready / 1000);
+}
+
+void startup_phases::wait_all()
+{
+    for (size_t i = 0; i < m_phases.size(); ++i)
+    {
+        if (m_phases[i].started)
+        {
+            pthread_join(m_phases[i].tid, NULL);
+            m_phases[i].started = false;
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <pthread.h>
+#include <vector>
+#include "../Lock/locker.hpp"
+
+/**
+ * @brief 服务器启动阶段的并行调度器：每个阶段在独立线程中执行，可以声明依赖的前置阶段；
+ *        run()只等待"必需"阶段完成就返回，其余阶段(预热类)继续在后台执行。
+ *        每个阶段的等待时间和执行时间都会写入日志。
+ */
+class startup_phases
+{
+public:
+    typedef void (*phase_func)(void *arg);
+
+    startup_phases();
+    ~startup_phases();
+
+    /**
+     * @brief 注册一个启动阶段
+     * @param name 阶段名称，用于输出耗时
+     * @param func 阶段的执行函数
+     * @param required 是否是开始监听之前必须完成的阶段
+     * @param after 依赖的前置阶段下标，-1表示没有依赖
+     * @return 阶段下标
+     */
+    int add(const char *name, phase_func func, void *arg, bool required, int after = -1);
+
+    /**
+     * @brief 启动所有阶段，阻塞到所有必需阶段完成
+     */
+    void run();
+
+    /**
+     * @brief 等待所有阶段(包括后台阶段)完成
+     */
+    void wait_all();
+
+private:
+    struct phase
+    {
+        const char *name;
+        phase_func func;
+        void *arg;
+        bool required;
+        int after;
+        bool done;
+        bool started;
+        pthread_t tid;
+        long begin_us; //开始执行的时刻(相对于run()调用)
+        long end_us;   //执行完毕的时刻
+        startup_phases *owner;
+    };
+
+    static void *phase_worker(void *arg);
+    static long now_us();
+    void wait_phase(int idx);
+
+    std::vector<phase> m_phases;
+    locker m_lock;
+    cond m_cond;
+    long m_start_us;
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "webserver.hpp"
+#include <dirent.h>
 
 
 /**
@@ -20,6 +21,14 @@ WebServer::WebServer()
 
     //定时器
     users_timer = new client_data[MAX_FD];
+
+    //使用内置存储引擎时不建立数据库连接池
+    m_connPool = NULL;
+    m_shards = NULL;
+
+    m_ready_num = 0;
+    m_loop_now = coarse_clock::ins()->mono_ms();
+    m_timer_refreshes = 0;
 }
 
 /**
@@ -28,6 +37,7 @@ WebServer::WebServer()
  */
 WebServer::~WebServer()
 {
+    m_startup.wait_all();
     close(m_epollfd);
     close(m_listenfd);
     close(m_pipefd[1]);
@@ -42,15 +52,37 @@ WebServer::~WebServer()
  * @return null
  */
 void WebServer::init(int port, string user, string passWord, string databaseName, int log_write, 
-                     int opt_linger, int trigmode, int sql_num, int thread_num, int close_log, int actor_model)
+                     int opt_linger, int trigmode, int sql_num, int thread_num, int close_log, int actor_model,
+                     string sql_shards, int sched_mode, int max_threads,
+                     string loop_cpus, string worker_cpus, string log_cpus, string bulkheads, int queue_deadline,
+                     int edf_backlog, int shed_mode, int shed_wait, string timeouts, int log_split,
+                     int log_binary, int access_log, int log_mem, int log_overflow, int log_overflow_arg)
 {
     m_port = port;
     m_user = user;
     m_passWord = passWord;
     m_databaseName = databaseName;
     m_sql_num = sql_num;
+    m_sql_shards = sql_shards;
     m_thread_num = thread_num;
+    m_sched_mode = sched_mode;
+    m_max_threads = max_threads;
+    m_loop_cpus = loop_cpus;
+    m_worker_cpus = worker_cpus;
+    m_log_cpus = log_cpus;
+    m_bulkheads = bulkheads;
+    m_queue_deadline = queue_deadline;
+    m_edf_backlog = edf_backlog;
+    m_shed_mode = shed_mode;
+    m_shed_wait = shed_wait;
+    m_timeouts = timeouts;
     m_log_write = log_write;
+    m_log_split = log_split;
+    m_log_binary = log_binary;
+    m_access_log = access_log;
+    m_log_mem = log_mem;
+    m_log_overflow = log_overflow;
+    m_log_overflow_arg = log_overflow_arg;
     m_OPT_LINGER = opt_linger;
     m_TRIGMode = trigmode;
     m_close_log = close_log;
@@ -98,22 +130,133 @@ void WebServer::log_write()
     if (0 == m_close_log)
     {
         //初始化日志
+        ring_log::ins()->set_split(1 == m_log_split);
+        ring_log::ins()->set_binary(1 == m_log_binary);
+        LOG_MEM_SET((uint64_t)m_log_mem * 1024 * 1024);
+        ring_log::ins()->set_overflow(m_log_overflow, m_log_overflow_arg);
         LOG_INIT("./ServerLog", "ServerLog", INFO);
+
+        //后台写日志线程绑核
+        vector<int> cpus;
+        pthread_t tid;
+        if (!m_log_cpus.empty())
+        {
+            if (!cpu_affinity::parse(m_log_cpus, cpus))
+            {
+                LOG_ERROR("invalid log cpu list: %s", m_log_cpus.c_str());
+                exit(1);
+            }
+            if (!ring_log::ins()->writer(&tid) || !cpu_affinity::pin(tid, cpus))
+                LOG_ERROR("pin log writer to cpus %s failed", m_log_cpus.c_str());
+        }
+    }
+
+    //访问日志与调试日志相互独立，关闭调试日志时也可以打开
+    access_log::ins()->init("./ServerLog", m_access_log);
+}
+
+/**
+ * @brief 为日志缓冲区预先建立物理页映射
+ * @return null
+ */
+void WebServer::log_buffers()
+{
+    if (0 == m_close_log)
+    {
+        uint64_t bytes = ring_log::ins()->prefault();
+        LOG_INFO("log buffers prefaulted: %llu bytes", (unsigned long long)bytes);
     }
 }
 
 /**
- * @brief 初始化数据连接池 
+ * @brief 预热静态资源：提示内核把根目录下的文件预读进页缓存，首批请求不必等磁盘
+ * @return null
+ */
+void WebServer::static_warmup()
+{
+    DIR *dir = opendir(m_root);
+    if (!dir)
+        return;
+
+    int files = 0;
+    long long bytes = 0;
+    char path[512];
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        snprintf(path, sizeof(path), "%s/%s", m_root, entry->d_name);
+        struct stat st;
+        if (stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+            continue;
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            continue;
+        posix_fadvise(fd, 0, st.st_size, POSIX_FADV_WILLNEED);
+        close(fd);
+        ++files;
+        bytes += st.st_size;
+    }
+    closedir(dir);
+
+    LOG_INFO("static warmup: %d files, %lld bytes", files, bytes);
+}
+
+/**
+ * @brief 初始化数据连接池：每个用户表分片一个连接池，第0个分片即默认连接池
  * @return null
  */
 void WebServer::sql_pool()
 {
+    vector<shard_addr> addrs;
+    if (!shard_map::parse(m_sql_shards, addrs))
+    {
+        LOG_ERROR("invalid shard list: %s", m_sql_shards.c_str());
+        exit(1);
+    }
+
     //初始化数据库连接池
-    m_connPool = connection_pool::GetInstance();
-    m_connPool->init("localhost", m_user, m_passWord, m_databaseName, 3306, m_sql_num, m_close_log);
+    m_shards = shard_map::GetInstance();
+    m_shards->init(addrs, m_user, m_passWord, m_databaseName, m_sql_num, m_close_log);
+    m_connPool = m_shards->GetPool(0);
+}
 
-    //初始化数据库读取表
-    users->initmysql_result(m_connPool);
+/**
+ * @brief 加载用户存储，MySQL后端依赖连接池已经建好
+ * @return null
+ */
+void WebServer::user_table()
+{
+    if (!user_store::GetInstance()->load())
+    {
+        LOG_ERROR("%s", "user store load failed");
+        exit(1);
+    }
+}
+
+static void phase_sql_pool(void *arg) { ((WebServer *)arg)->sql_pool(); }
+static void phase_user_table(void *arg) { ((WebServer *)arg)->user_table(); }
+static void phase_thread_pool(void *arg) { ((WebServer *)arg)->thread_pool(); }
+static void phase_static_warmup(void *arg) { ((WebServer *)arg)->static_warmup(); }
+static void phase_log_buffers(void *arg) { ((WebServer *)arg)->log_buffers(); }
+
+/**
+ * @brief 启动阶段：日志先同步初始化，其余阶段并行执行；
+ *        连接池、用户表和线程池是监听前必需的状态，静态资源和日志缓冲区的预热在后台继续。
+ *        用户存储不需要MySQL时跳过建连阶段
+ * @return null
+ */
+void WebServer::startup()
+{
+    log_write();
+
+    int db = -1;
+    if (user_store::GetInstance()->need_sql())
+        db = m_startup.add("db_connect", phase_sql_pool, this, true);
+    m_startup.add("user_load", phase_user_table, this, true, db);
+    m_startup.add("thread_pool", phase_thread_pool, this, true, db);
+    m_startup.add("static_warmup", phase_static_warmup, this, false);
+    m_startup.add("log_buffers", phase_log_buffers, this, false);
+    m_startup.run();
 }
 
 /**
@@ -122,8 +265,64 @@ void WebServer::sql_pool()
  */
 void WebServer::thread_pool()
 {
+    vector<int> cpus;
+    if (!m_worker_cpus.empty() && !cpu_affinity::parse(m_worker_cpus, cpus))
+    {
+        LOG_ERROR("invalid worker cpu list: %s", m_worker_cpus.c_str());
+        exit(1);
+    }
+
+    bulkhead<http_conn>::lane_conf confs[WORK_CLASS_NUM];
+    if (!m_bulkheads.empty() && !bulkhead<http_conn>::parse(m_bulkheads, confs))
+    {
+        LOG_ERROR("invalid bulkhead spec: %s", m_bulkheads.c_str());
+        exit(1);
+    }
+
     //线程池
-    m_pool = new threadpool<http_conn>(m_actormodel, m_connPool, m_thread_num);
+    m_pool = new bulkhead<http_conn>(m_actormodel, m_connPool, m_thread_num, 10000, m_sched_mode, m_max_threads,
+                                     cpus, m_bulkheads.empty() ? NULL : confs);
+    m_pool->set_edf(m_edf_backlog);
+}
+
+/**
+ * @brief 绑核与内存放置，在启动阶段之后调用，启动阶段的线程不会继承事件循环的绑定
+ * @return null
+ */
+void WebServer::placement()
+{
+    vector<int> loop_cpus, worker_cpus, cpus;
+    if (!m_loop_cpus.empty())
+    {
+        if (!cpu_affinity::parse(m_loop_cpus, loop_cpus))
+        {
+            LOG_ERROR("invalid loop cpu list: %s", m_loop_cpus.c_str());
+            exit(1);
+        }
+        if (!cpu_affinity::pin(pthread_self(), loop_cpus))
+            LOG_ERROR("pin event loop to cpus %s failed", m_loop_cpus.c_str());
+    }
+    cpu_affinity::parse(m_worker_cpus, worker_cpus);
+
+    /* 连接对象由事件循环和处理它的工作线程共同访问，按页交错放在它们所在的各个节点上，避免全部挤在一个节点 */
+    cpus = loop_cpus;
+    cpus.insert(cpus.end(), worker_cpus.begin(), worker_cpus.end());
+    vector<int> nodes = cpu_affinity::nodes_of(cpus);
+    if (!cpus.empty() && cpu_affinity::node_count() > 1)
+    {
+        if (!cpu_affinity::interleave(users, sizeof(http_conn) * MAX_FD, nodes))
+            LOG_ERROR("%s", "place connection array failed");
+    }
+
+    LOG_INFO("placement: %d numa nodes, connection array %llu bytes on nodes %s", cpu_affinity::node_count(),
+             (unsigned long long)sizeof(http_conn) * MAX_FD,
+             nodes.empty() || cpu_affinity::node_count() <= 1 ? "default" : cpu_affinity::format(nodes).c_str());
+    cpu_affinity::allowed(pthread_self(), cpus);
+    LOG_INFO("placement: event loop allowed=%s", cpu_affinity::format(cpus).c_str());
+    pthread_t tid;
+    if (ring_log::ins()->writer(&tid) && cpu_affinity::allowed(tid, cpus))
+        LOG_INFO("placement: log writer allowed=%s", cpu_affinity::format(cpus).c_str());
+    m_pool->placement();
 }
 
 /**
@@ -159,9 +358,23 @@ void WebServer::eventListen()
     setsockopt(m_listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
     ret = bind(m_listenfd, (struct sockaddr *)&address, sizeof(address));
     assert(ret >= 0);
-    ret = listen(m_listenfd, 5);
+    //暂停accept时新连接在内核的全连接队列中等待，队列不能太短
+    ret = listen(m_listenfd, SOMAXCONN);
     assert(ret >= 0);
 
+    m_admission.init(m_shed_mode, m_shed_wait, MAX_FD);
+
+    //请求头、请求体、keep-alive空闲、发送停滞的超时时间(毫秒)
+    if (sscanf(m_timeouts.c_str(), "%d,%d,%d,%d", &m_phase_ms[http_conn::PHASE_HEADER],
+               &m_phase_ms[http_conn::PHASE_BODY], &m_phase_ms[http_conn::PHASE_IDLE],
+               &m_phase_ms[http_conn::PHASE_WRITE]) != 4 ||
+        m_phase_ms[http_conn::PHASE_HEADER] <= 0 || m_phase_ms[http_conn::PHASE_BODY] <= 0 ||
+        m_phase_ms[http_conn::PHASE_IDLE] <= 0 || m_phase_ms[http_conn::PHASE_WRITE] <= 0)
+    {
+        LOG_ERROR("invalid timeout spec: %s", m_timeouts.c_str());
+        exit(1);
+    }
+
     utils.init(TIMESLOT);
 
     //epoll创建内核事件表
@@ -193,27 +406,48 @@ void WebServer::timer(int connfd, struct sockaddr_in client_address)
     users[connfd].init(connfd, client_address, m_root, m_CONNTrigmode, m_close_log, m_user, m_passWord, m_databaseName);
 
     //初始化client_data数据
-    //创建定时器，设置回调函数和超时时间，绑定用户数据，将定时器添加到链表中
+    //使用内嵌的定时器节点，设置回调函数和超时时间，绑定用户数据，将定时器添加到时间轮中
     users_timer[connfd].address = client_address;
     users_timer[connfd].sockfd = connfd;
-    util_timer *timer = new util_timer;
+    util_timer *timer = &users_timer[connfd].node;
+    //描述符被复用时上一个连接的定时器可能还在时间轮中(工作线程直接关闭了连接)，先摘下
+    utils.m_timer_wheel.del_timer(timer);
     timer->user_data = &users_timer[connfd];
     timer->cb_func = cb_func;
-    time_t cur = time(NULL);
-    timer->expire = cur + 3 * TIMESLOT;
+    //请求行和头部阶段从建立连接算起，连上后迟迟不发请求的连接按请求头超时关闭
+    users_timer[connfd].phase = http_conn::PHASE_HEADER;
+    timer->active = m_loop_now;
+    timer->idle = m_phase_ms[http_conn::PHASE_HEADER];
+    timer->expire = timer->active + timer->idle;
     users_timer[connfd].timer = timer;
-    utils.m_timer_lst.add_timer(timer);
+    utils.m_timer_wheel.add_timer(timer);
 }
 
-//若有数据传输，则将定时器往后延迟3个单位
-//并对新的定时器在链表上的位置进行调整
-void WebServer::adjust_timer(util_timer *timer)
+//若有数据传输，只记下活动时间，定时器留在原来的格中；
+//到期时时间轮发现期间有活动，再按剩余时间重新放入，每个请求不必移动定时器
+void WebServer::adjust_timer(util_timer *timer, int phase)
 {
-    time_t cur = time(NULL);
-    timer->expire = cur + 3 * TIMESLOT;
-    utils.m_timer_lst.adjust_timer(timer);
-
-    LOG_INFO("%s", "adjust timer once");
+    client_data *data = timer->user_data;
+    if (phase != data->phase)
+    {
+        //进入新阶段，超时时间从现在算起；比定时器原来的到期时间早时才需要移到更早的格中
+        data->phase = phase;
+        timer->active = m_loop_now;
+        timer->idle = m_phase_ms[phase];
+        if (timer->active + timer->idle < timer->expire)
+        {
+            timer->expire = timer->active + timer->idle;
+            utils.m_timer_wheel.adjust_timer(timer);
+        }
+        return;
+    }
+    //请求头和请求体阶段的期限从阶段开始时算起，零星到达的数据不能把它往后推；
+    //空闲和发送阶段每次有进展就顺延
+    if (http_conn::PHASE_IDLE == phase || http_conn::PHASE_WRITE == phase)
+    {
+        timer->active = m_loop_now;
+        m_timer_refreshes++;
+    }
 }
 
 void WebServer::deal_timer(util_timer *timer, int sockfd)
@@ -221,10 +455,10 @@ void WebServer::deal_timer(util_timer *timer, int sockfd)
     timer->cb_func(&users_timer[sockfd]);
     if (timer)
     {
-        utils.m_timer_lst.del_timer(timer);
+        utils.m_timer_wheel.del_timer(timer);
     }
 
-    LOG_INFO("close fd %d", users_timer[sockfd].sockfd);
+    LOG_EVERY_MS(INFO, 1000, "close fd %d", users_timer[sockfd].sockfd);
 }
 
 bool WebServer::dealclinetdata()
@@ -237,12 +471,18 @@ bool WebServer::dealclinetdata()
         int connfd = accept(m_listenfd, (struct sockaddr *)&client_address, &client_addrlength);
         if (connfd < 0)
         {
+            if ((EMFILE == errno || ENFILE == errno) && m_admission.on_emfile(m_listenfd))
+            {
+                LOG_WARN("%s", "out of file descriptors, connection refused with 503");
+                return false;
+            }
             LOG_ERROR("%s:errno is:%d", "accept error", errno);
             return false;
         }
-        if (http_conn::m_user_count >= MAX_FD)
+        if (m_admission.fd_exhausted(connfd, http_conn::m_user_count))
         {
-            utils.show_error(connfd, "Internal server busy");
+            m_admission.reject(connfd);
+            close(connfd);
             LOG_ERROR("%s", "Internal server busy");
             return false;
         }
@@ -256,14 +496,22 @@ bool WebServer::dealclinetdata()
             int connfd = accept(m_listenfd, (struct sockaddr *)&client_address, &client_addrlength);
             if (connfd < 0)
             {
-                LOG_ERROR("%s:errno is:%d", "accept error", errno);
+                //ET模式下必须把全连接队列取空，描述符耗尽时逐个回复503
+                if ((EMFILE == errno || ENFILE == errno) && m_admission.on_emfile(m_listenfd))
+                {
+                    LOG_WARN("%s", "out of file descriptors, connection refused with 503");
+                    continue;
+                }
+                if (EAGAIN != errno)
+                    LOG_ERROR("%s:errno is:%d", "accept error", errno);
                 break;
             }
-            if (http_conn::m_user_count >= MAX_FD)
+            if (m_admission.fd_exhausted(connfd, http_conn::m_user_count))
             {
-                utils.show_error(connfd, "Internal server busy");
+                m_admission.reject(connfd);
+                close(connfd);
                 LOG_ERROR("%s", "Internal server busy");
-                break;
+                continue;
             }
             timer(connfd, client_address);
         }
@@ -317,11 +565,23 @@ void WebServer::dealwithread(int sockfd)
     {
         if (timer)
         {
-            adjust_timer(timer);
+            //请求还没有读入，解析状态是上一次的；有数据到达说明至少进入了请求头阶段
+            int phase = users[sockfd].phase();
+            adjust_timer(timer, http_conn::PHASE_IDLE == phase ? (int)http_conn::PHASE_HEADER : phase);
         }
+        set_deadline(sockfd);
 
-        //若监测到读事件，将该事件放入请求队列
-        m_pool->append(users + sockfd, 0);
+        //若监测到读事件，将该事件放入请求队列；请求尚未读入，按该连接上一个请求的类别分派
+        int cls = users[sockfd].m_class;
+        bool over = admission::SHED_OFF != m_shed_mode &&
+                    m_admission.overloaded(m_pool->queued(cls), m_pool->depth(cls), m_pool->recent_wait_us(cls));
+        if (over || !m_pool->append(users + sockfd, 0, cls))
+        {
+            //先读走请求再回复，未读的数据会让close发出RST，客户端可能收不到503
+            users[sockfd].read_once();
+            shed(sockfd);
+            return;
+        }
 
         while (true)
         {
@@ -342,15 +602,17 @@ void WebServer::dealwithread(int sockfd)
         //proactor
         if (users[sockfd].read_once())
         {
-            LOG_INFO("deal with the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
+            LOG_EVERY_MS(INFO, 1000, "deal with the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
 
-            //若监测到读事件，将该事件放入请求队列
-            m_pool->append_p(users + sockfd);
+            //若监测到读事件，记下请求的工作类别，本轮事件处理完后批量放入请求队列
+            m_ready[m_ready_num] = users + sockfd;
+            m_ready_class[m_ready_num++] = users[sockfd].work_class();
 
             if (timer)
             {
-                adjust_timer(timer);
+                adjust_timer(timer, users[sockfd].phase());
             }
+            set_deadline(sockfd);
         }
         else
         {
@@ -359,6 +621,90 @@ void WebServer::dealwithread(int sockfd)
     }
 }
 
+void WebServer::set_deadline(int sockfd)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+
+    uint64_t deadline = m_queue_deadline > 0 ? now + m_queue_deadline * 1000000ull : 0;
+    util_timer *timer = users_timer[sockfd].timer;
+    if (timer)
+    {
+        //定时器用的是粗粒度单调时钟(毫秒)，与CLOCK_MONOTONIC同一起点；惰性刷新时expire可能早于真正的到期时间，以active + idle为准
+        uint64_t expire = (uint64_t)(timer->active + timer->idle) * 1000000ull;
+        if (0 == deadline || expire < deadline)
+            deadline = expire;
+    }
+    users[sockfd].m_deadline_ns = deadline;
+}
+
+void WebServer::dispatch_ready()
+{
+    if (0 == m_ready_num)
+        return;
+
+    //每个类别只判断一次是否过载，过载类别的请求直接拒绝，其余的批量入队
+    int n = m_ready_num, rejected = 0;
+    if (admission::SHED_OFF != m_shed_mode)
+    {
+        bool over[WORK_CLASS_NUM];
+        for (int c = 0; c < WORK_CLASS_NUM; ++c)
+            over[c] = m_admission.overloaded(m_pool->queued(c), m_pool->depth(c), m_pool->recent_wait_us(c));
+        n = 0;
+        for (int i = 0; i < m_ready_num; ++i)
+        {
+            if (over[m_ready_class[i]])
+            {
+                m_shed[rejected++] = m_ready[i];
+            }
+            else
+            {
+                m_ready[n] = m_ready[i];
+                m_ready_class[n++] = m_ready_class[i];
+            }
+        }
+    }
+    rejected += m_pool->append_batch(m_ready, m_ready_class, n, m_shed + rejected);
+    for (int i = 0; i < rejected; ++i)
+        shed(m_shed[i] - users);
+    m_ready_num = 0;
+}
+
+void WebServer::shed(int sockfd)
+{
+    m_admission.reject(sockfd);
+    deal_timer(users_timer[sockfd].timer, sockfd);
+}
+
+void WebServer::admit()
+{
+    if (admission::SHED_PAUSE != m_shed_mode)
+        return;
+
+    //按类别隔离时只要还有一个线程池能接收就继续accept，静态请求不因数据库变慢而被挡在门外
+    bool was = m_admission.paused();
+    bool pause = true;
+    for (int c = 0; c < WORK_CLASS_NUM && pause; ++c)
+    {
+        if (c > 0 && !m_pool->split())
+            break;
+        pause = m_admission.overloaded(m_pool->queued(c), m_pool->depth(c), m_pool->recent_wait_us(c), was);
+    }
+    if (pause == was)
+        return;
+
+    epoll_event event;
+    event.data.fd = m_listenfd;
+    uint32_t mask = EPOLLIN | EPOLLRDHUP;
+    if (1 == m_LISTENTrigmode)
+        mask |= EPOLLET;
+    event.events = pause ? 0 : mask;
+    epoll_ctl(m_epollfd, EPOLL_CTL_MOD, m_listenfd, &event);
+    m_admission.set_paused(pause);
+    LOG_WARN("%s accepting new connections", pause ? "pause" : "resume");
+}
+
 void WebServer::dealwithwrite(int sockfd)
 {
     util_timer *timer = users_timer[sockfd].timer;
@@ -367,10 +713,16 @@ void WebServer::dealwithwrite(int sockfd)
     {
         if (timer)
         {
-            adjust_timer(timer);
+            adjust_timer(timer, users[sockfd].phase());
         }
+        set_deadline(sockfd);
 
-        m_pool->append(users + sockfd, 1);
+        //响应已经发出一部分，无法再改成503，只能关闭连接
+        if (!m_pool->append(users + sockfd, 1, users[sockfd].m_class))
+        {
+            deal_timer(timer, sockfd);
+            return;
+        }
 
         while (true)
         {
@@ -381,6 +733,11 @@ void WebServer::dealwithwrite(int sockfd)
                     deal_timer(timer, sockfd);
                     users[sockfd].timer_flag = 0;
                 }
+                else if (timer)
+                {
+                    //写操作在improv置位之前已经完成，发送完毕时回到空闲阶段
+                    adjust_timer(timer, users[sockfd].phase());
+                }
                 users[sockfd].improv = 0;
                 break;
             }
@@ -391,11 +748,11 @@ void WebServer::dealwithwrite(int sockfd)
         //proactor
         if (users[sockfd].write())
         {
-            LOG_INFO("send data to the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
+            LOG_EVERY_MS(INFO, 1000, "send data to the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
 
             if (timer)
             {
-                adjust_timer(timer);
+                adjust_timer(timer, users[sockfd].phase());
             }
         }
         else
@@ -412,7 +769,13 @@ void WebServer::eventLoop()
 
     while (!stop_server)
     {
-        int number = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER, -1);
+        //有定时器时每格醒来一次推进时间轮；暂停accept期间定期醒来检查能否恢复
+        int wait_ms = utils.m_timer_wheel.size() ? TIMER_TICK_MS : -1;
+        if (m_admission.paused() && (wait_ms < 0 || ADMIT_POLL_MS < wait_ms))
+            wait_ms = ADMIT_POLL_MS;
+        int number = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER, wait_ms);
+        //每轮更新一次时钟服务，本轮事件共用这个时间，刷新定时器时不必每次取时间
+        m_loop_now = coarse_clock::ins()->update();
         if (number < 0 && errno != EINTR)
         {
             LOG_ERROR("%s", "epoll failure");
@@ -453,13 +816,30 @@ void WebServer::eventLoop()
                 dealwithwrite(sockfd);
             }
         }
+        //定时器处理之前分派，已就绪的连接不会被当作超时关闭
+        dispatch_ready();
+        admit();
+        utils.m_timer_wheel.tick(m_loop_now);
+
         if (timeout)
         {
             utils.timer_handler();
             printf("%s", "timer tick");
             LOG_INFO("%s", "timer tick");
 
+            user_store::GetInstance()->report();
+            m_pool->report();
+            m_admission.report();
+            access_log::ins()->report();
+            ring_log::ins()->report();
+            LOG_INFO("timer wheel: timers=%llu refreshes=%llu relinks=%llu rearms=%llu",
+                     (unsigned long long)utils.m_timer_wheel.size(), m_timer_refreshes,
+                     utils.m_timer_wheel.relinks(), utils.m_timer_wheel.rearms());
+
             timeout = false;
         }
     }
+
+    //退出前持久化用户存储尚未落盘的状态
+    user_store::GetInstance()->shutdown();
 }
\ No newline at end of file
@@ -12,8 +12,11 @@
 #include <cassert>
 #include <sys/epoll.h>
 
-#include "../ConnPool/threadpool.hpp"
+#include "../ConnPool/bulkhead.hpp"
 #include "../HttpConn/http_conn.hpp"
+#include "startup.hpp"
+#include "cpu_affinity.hpp"
+#include "admission.hpp"
 
 const int MAX_FD = 65536;           //最大文件描述符
 const int MAX_EVENT_NUMBER = 10000; //最大事件数
@@ -27,31 +30,79 @@ public:
 
     void init(int port , string user, string passWord, string databaseName,
               int log_write , int opt_linger, int trigmode, int sql_num,
-              int thread_num, int close_log, int actor_model);
+              int thread_num, int close_log, int actor_model, string sql_shards, int sched_mode, int max_threads,
+              string loop_cpus, string worker_cpus, string log_cpus, string bulkheads, int queue_deadline,
+              int edf_backlog, int shed_mode, int shed_wait, string timeouts, int log_split,
+              int log_binary, int access_log, int log_mem, int log_overflow, int log_overflow_arg);
+
+    /**
+     * @brief 并行执行启动阶段(建连、读用户表、创建线程池、预热)，必需阶段完成后返回
+     */
+    void startup();
 
     void thread_pool();
     void sql_pool();
+    void user_table();
     void log_write();
+    void log_buffers();
+    void static_warmup();
     void trig_mode();
     void eventListen();
 
+    /**
+     * @brief 事件循环线程绑核，连接对象数组放到各工作线程所在的节点上，并输出线程与内存的放置情况
+     */
+    void placement();
+
     /**
      * @brief webserver主要的工作函数
      */
     void eventLoop();
     void timer(int connfd, struct sockaddr_in client_address);
-    void adjust_timer(util_timer *timer);
+
+    /**
+     * @brief 连接上有事件时按其所处阶段(见http_conn::CONN_PHASE)更新定时器：进入新阶段时按该阶段的超时重新计时，
+     *        空闲和发送阶段有进展就顺延，请求头和请求体阶段的期限从阶段开始算起不顺延
+     */
+    void adjust_timer(util_timer *timer, int phase);
     void deal_timer(util_timer *timer, int sockfd);
     bool dealclinetdata();
     bool dealwithsignal(bool& timeout, bool& stop_server);
     void dealwithread(int sockfd);
     void dealwithwrite(int sockfd);
 
+    /**
+     * @brief 设置连接在队列中的截止时间：排队上限与连接定时器到期两者中较早的，
+     *        定时器到期后连接会被关闭，再处理它的请求已没有意义
+     */
+    void set_deadline(int sockfd);
+
+    /**
+     * @brief 把本轮epoll_wait中读完请求的连接一次性交给线程池；所属线程池过载或队列已满的请求回复503
+     */
+    void dispatch_ready();
+
+    /**
+     * @brief 回复503并关闭连接
+     */
+    void shed(int sockfd);
+
+    /**
+     * @brief 所有线程池都过载时暂停accept，积压回落后恢复(仅SHED_PAUSE模式)
+     */
+    void admit();
+
 public:
     //基础
     int m_port;
     char *m_root;
     int m_log_write;
+    int m_log_split; //每个线程写各自的日志文件
+    int m_log_binary; //写二进制日志
+    int m_access_log; //访问日志格式
+    int m_log_mem; //日志缓冲区内存预算(MB)
+    int m_log_overflow; //日志缓冲区用尽时的处理方式
+    int m_log_overflow_arg;
     int m_close_log;
     int m_actormodel;
 
@@ -65,14 +116,41 @@ public:
     string m_passWord;     //登陆数据库密码
     string m_databaseName; //使用数据库名
     int m_sql_num;
+    string m_sql_shards;   //用户表分片配置
+    shard_map *m_shards;   //用户表分片映射
 
     //线程池相关
-    threadpool<http_conn> *m_pool;
+    bulkhead<http_conn> *m_pool; //按工作类别隔离的线程池，未配置舱壁时只有一个线程池
     int m_thread_num;
+    int m_sched_mode; //任务分派方式，见threadpool::SCHED_MODE
+    int m_max_threads; //自适应扩缩容的线程数上限，不大于m_thread_num时不扩缩容
+    string m_bulkheads; //各工作类别的线程数与队列上限，为空表示所有类别共用一个线程池
+    int m_queue_deadline; //请求排队的最长时间(毫秒)，0表示只以连接定时器到期为限
+    int m_edf_backlog;    //积压达到该值时按截止时间最早优先取任务，0表示不启用
+
+    //准入控制
+    admission m_admission;
+    int m_shed_mode; //过载时的处理方式，见admission::SHED_MODE
+    int m_shed_wait; //排队时间阈值(毫秒)
+
+    //各阶段的超时
+    string m_timeouts; //"请求头,请求体,keep-alive空闲,发送停滞"，单位毫秒
+    int m_phase_ms[http_conn::PHASE_NUM];
+
+    //绑核相关，CPU列表格式同taskset -c，为空表示不绑定
+    string m_loop_cpus;   //事件循环线程
+    string m_worker_cpus; //工作线程，每个线程依次绑定列表中的一个CPU
+    string m_log_cpus;    //后台写日志线程
 
     //epoll_event相关
     epoll_event events[MAX_EVENT_NUMBER];
 
+    //proactor模式下本轮已读入请求、等待批量分派的连接及其工作类别
+    http_conn *m_ready[MAX_EVENT_NUMBER];
+    int m_ready_class[MAX_EVENT_NUMBER];
+    int m_ready_num;
+    http_conn *m_shed[MAX_EVENT_NUMBER]; //本轮被拒绝、需要回复503的连接
+
     int m_listenfd;
     int m_OPT_LINGER;
     int m_TRIGMode;
@@ -82,5 +160,10 @@ public:
     //定时器相关
     client_data *users_timer;
     Utils utils;
+    time_t m_loop_now;                     //本轮epoll_wait返回的时间(单调时钟毫秒，与定时器相同)
+    unsigned long long m_timer_refreshes; //有进展而顺延超时的次数
+
+    //启动阶段
+    startup_phases m_startup;
 };
 #endif
@@ -55,13 +55,15 @@ ThreadPool::ThreadPool(int minNum, int maxNum) {
 }
 
 ThreadPool::~ThreadPool() {
-    m_shutdown = 1;
+    {
+        std::lock_guard<std::mutex> locker(m_lock);
+        m_shutdown = true;
+    }
     // 销毁管理者线程
+    m_managerWake.notify_all();
     m_managerID.join();
     // 唤醒所有的消费者线程，让他们把活干完
-    for (int i = 0; i < m_aliveNum; i++) {
-        m_notEmpty.notify_all();
-    }
+    m_notEmpty.notify_all();
 
     if (!m_threadIDs.empty())
         for (int i = 0; i < m_maxNum; i++)
@@ -71,13 +73,30 @@ ThreadPool::~ThreadPool() {
 }
 
 void ThreadPool::addTask(Task task) {
-    std::lock_guard<std::mutex> locker(m_lock);
-    if (m_shutdown)
-        return;
+    post([task]() {
+        task.function(task.arg);
+        free(task.arg);
+    });
+}
 
-    m_taskQ.push(task);
-    // 唤醒工作线程
-    m_notEmpty.notify_all();
+void ThreadPool::enqueue(unique_task&& task) {
+    {
+        std::lock_guard<std::mutex> locker(m_lock);
+        if (m_shutdown)
+            return;
+        m_taskQ.push(std::move(task));
+    }
+    // 只唤醒一个工作线程，避免所有线程一起醒来争抢同一个任务
+    m_notEmpty.notify_one();
+}
+
+void ThreadPool::wake(size_t n) {
+    if (n >= (size_t)getAliveNumber()) {
+        m_notEmpty.notify_all();
+        return;
+    }
+    for (size_t i = 0; i < n; i++)
+        m_notEmpty.notify_one();
 }
 
 int ThreadPool::getAliveNumber() {
@@ -88,10 +107,7 @@ int ThreadPool::getAliveNumber() {
 }
 
 int ThreadPool::getBusyNumber() {
-    int threadNum = 0;
-    std::lock_guard<std::mutex> locker(m_lock);
-    threadNum = m_busyNum;
-    return threadNum;
+    return m_busyNum.load();
 }
 
 void* ThreadPool::worker(void* arg) {
@@ -117,42 +133,21 @@ void* ThreadPool::worker(void* arg) {
                 }
             }
         }
-        // pool->m_notEmpty.wait(locker, [pool]() {
-        //     return pool->m_taskQ.size() != 0 || pool->m_shutdown;});
-        // 解除阻塞之后, 判断是否要销毁线程
-
-        // 判断线程池是否被关闭
-        if (pool->m_shutdown) {
-            cout << "thread " << std::this_thread::get_id()
-                 << " exit working..." << endl;
+
+        // 线程池关闭时先把剩余任务做完再退出，否则等待这些任务的future永远不会完成
+        if (pool->m_taskQ.size() == 0) {
             // pool->threadExit();
             return nullptr;
         }
 
-        locker.unlock();
-
-        pool->m_lock.lock();
         // 从任务队列中取出一个任务
-        Task task = pool->m_taskQ.front();
-        pool->m_taskQ.pop();
-        // 线程的数量+1
-        pool->m_busyNum++;
-        pool->m_lock.unlock();
+        unique_task task = pool->m_taskQ.pop();
+        locker.unlock();
 
         // 执行任务
-        cout << "thread " << std::this_thread::get_id() << " start working..."
-             << endl;
-        task.function(task.arg);
-        free(task.arg);
-        task.arg = nullptr;
-
-        // 任务处理结束
-        cout << "thread " << std::this_thread::get_id() << " end working..."
-             << endl;
-
-        pool->m_lock.lock();
+        pool->m_busyNum++;
+        task();
         pool->m_busyNum--;
-        pool->m_lock.unlock();
     }
 
     return nullptr;
@@ -163,9 +158,13 @@ void* ThreadPool::manager(void* arg) {
     ThreadPool* pool = static_cast<ThreadPool*>(arg);
     /* 工作线程设置为true是因为需要将剩余任务处理完，然后在工作线程内部关闭 */
     /* 但是管理者线程要及时关闭 */
-    while (!pool->m_shutdown) {
-        // 每间隔5秒检测一次
-        sleep(5);
+    while (true) {
+        // 每间隔5秒检测一次，线程池关闭时立即醒来
+        std::unique_lock<std::mutex> waiter(pool->m_lock);
+        if (pool->m_managerWake.wait_for(waiter, std::chrono::seconds(5),
+                                         [pool]() { return pool->m_shutdown; }))
+            break;
+        waiter.unlock();
         // 取出工作线程的相关数量
         pool->m_lock.lock();
         int queueSize = pool->m_taskQ.size();
@@ -1,6 +1,7 @@
 #ifndef _THREADPOOL_HPP_
 #define _THREADPOOL_HPP_
 
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <functional>
@@ -10,7 +11,9 @@
 #include <queue>
 #include <thread>
 #include <string>
+#include <vector>
 #include <unistd.h>
+#include "./unique_task.hpp"
 
 using std::cout;
 using std::endl;
@@ -53,13 +56,74 @@ class TaskQueue {
     std::queue<Task> m_queue;
 };
 
+// 线程池内部的任务队列：按需倍增的环形缓冲区，稳定后入队出队都不再分配内存
+class TaskRing {
+   public:
+    TaskRing() : m_head(0), m_count(0) {}
+
+    void push(unique_task&& task) {
+        if (m_count == m_buf.size())
+            grow(m_count + 1);
+        m_buf[(m_head + m_count) % m_buf.size()] = std::move(task);
+        ++m_count;
+    }
+
+    unique_task pop() {
+        unique_task task(std::move(m_buf[m_head]));
+        m_head = (m_head + 1) % m_buf.size();
+        --m_count;
+        return task;
+    }
+
+    // 预留至少 n 个空位
+    void reserve(size_t n) {
+        if (m_count + n > m_buf.size())
+            grow(m_count + n);
+    }
+
+    size_t size() const { return m_count; }
+
+   private:
+    void grow(size_t need) {
+        size_t cap = m_buf.empty() ? 64 : m_buf.size();
+        while (cap < need)
+            cap *= 2;
+        std::vector<unique_task> buf(cap);
+        for (size_t i = 0; i < m_count; ++i)
+            buf[i] = std::move(m_buf[(m_head + i) % m_buf.size()]);
+        m_buf.swap(buf);
+        m_head = 0;
+    }
+
+    std::vector<unique_task> m_buf;
+    size_t m_head;
+    size_t m_count;
+};
+
 class ThreadPool {
    public:
     ThreadPool(int min, int max);
     ~ThreadPool();
 
-    // 添加任务
+    // 添加任务(旧接口)：执行后会 free(task.arg)，参数必须由 malloc 分配
     void addTask(Task task);
+
+    // 添加任意只能移动的可调用对象，不需要结果；小的 lambda 不分配内存
+    template <class F>
+    void post(F&& f);
+
+    // 添加任务并返回 future；可调用对象与结果共用一次分配
+    template <class F>
+    task_future<typename std::result_of<typename std::decay<F>::type()>::type> submit(F&& f);
+
+    // 批量添加 [first, last) 中的可调用对象(逐个移动)，只加一次锁、只唤醒需要的线程数
+    template <class Iter>
+    void postBulk(Iter first, Iter last);
+
+    // 批量添加 n 个任务 f(0) ... f(n-1)，返回各自的 future
+    template <class F>
+    std::vector<task_future<typename std::result_of<F(size_t)>::type>> submitBulk(size_t n, F f);
+
     // 获取忙线程的个数
     int getBusyNumber();
     // 获取活着的线程的数量
@@ -72,18 +136,84 @@ class ThreadPool {
     static void* manager(void* arg);
     // void threadExit();
 
+    // 入队并唤醒一个线程
+    void enqueue(unique_task&& task);
+    // 批量入队之后唤醒 n 个线程
+    void wake(size_t n);
+
    private:
     std::mutex m_lock;
     std::condition_variable m_notEmpty; // 注意，条件变量是“如果不满足当前条件，就阻塞当前线程，反之则继续运行”
+    std::condition_variable m_managerWake; // 关闭线程池时让管理者线程立即退出
     std::vector<std::thread> m_threadIDs; // 工作线程
     std::thread m_managerID;  // 管理者线程
-    std::queue<Task> m_taskQ;       // 任务队列
+    TaskRing m_taskQ;       // 任务队列
     int m_minNum;
     int m_maxNum;
-    int m_busyNum;
+    std::atomic<int> m_busyNum;
     int m_aliveNum;
     int m_exitNum;
     bool m_shutdown = false; // 标识当前线程池是否被关闭
 };
 
+template <class F>
+void ThreadPool::post(F&& f) {
+    enqueue(unique_task(std::forward<F>(f)));
+}
+
+template <class F>
+task_future<typename std::result_of<typename std::decay<F>::type()>::type> ThreadPool::submit(F&& f) {
+    typedef typename std::decay<F>::type Fn;
+    typedef typename std::result_of<Fn()>::type R;
+    detail::future_task<R, Fn>* state = new detail::future_task<R, Fn>(Fn(std::forward<F>(f)));
+    task_future<R> future(state);
+    enqueue(unique_task(detail::future_runner(state)));
+    return future;
+}
+
+template <class Iter>
+void ThreadPool::postBulk(Iter first, Iter last) {
+    size_t n = 0;
+    {
+        std::lock_guard<std::mutex> locker(m_lock);
+        if (m_shutdown)
+            return;
+        for (; first != last; ++first, ++n)
+            m_taskQ.push(unique_task(std::move(*first)));
+    }
+    wake(n);
+}
+
+template <class F>
+std::vector<task_future<typename std::result_of<F(size_t)>::type>> ThreadPool::submitBulk(size_t n, F f) {
+    typedef typename std::result_of<F(size_t)>::type R;
+    // 每个任务捕获 f 的一份拷贝和下标
+    struct call {
+        F fn;
+        size_t i;
+        R operator()() { return fn(i); }
+    };
+
+    std::vector<task_future<R>> futures;
+    std::vector<detail::future_runner> runners;
+    futures.reserve(n);
+    runners.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        detail::future_task<R, call>* state = new detail::future_task<R, call>(call{f, i});
+        futures.push_back(task_future<R>(state));
+        runners.push_back(detail::future_runner(state));
+    }
+    {
+        std::lock_guard<std::mutex> locker(m_lock);
+        if (!m_shutdown) {
+            m_taskQ.reserve(n);
+            for (size_t i = 0; i < n; ++i)
+                m_taskQ.push(unique_task(std::move(runners[i])));
+        }
+    }
+    // 线程池已关闭时 runners 析构，对应的 future 得到 broken_promise
+    wake(n);
+    return futures;
+}
+
 #endif  // _THREADPOOL_H_
\ No newline at end of file
@@ -1,50 +1,97 @@
-// #include <pthread.h>
-// #include <stdio.h>
-// #include <stdlib.h>
-// #include <string.h>
-// #include <string>
-// #include "./threadPool.h"
+// 线程池吞吐测试：各种提交方式每秒能完成多少个空任务
+//   ./threadpoolTest [tasks] [max_threads]
+// addTask   旧接口，每个参数 malloc 一次，执行后 free
+// post      小 lambda 直接存放在 unique_task 内部，不分配内存
+// postBulk  每 64 个任务一批，一次加锁、一次唤醒
+// submit    每个任务返回一个 future，最后逐个 get
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 #include "./ccthreadPool.hpp"
 
-void taskFunc(void* arg) {
-    int num = *(int*)arg;
-    std::cout << "thread " << std::this_thread::get_id()
-              << " is working, number =  " << num << std::endl;
-    std::cout << std::endl;
-    sleep(1);
+static std::atomic<long> g_sum(0);
+
+static void taskFunc(void* arg) {
+    g_sum += *(int*)arg;
+}
+
+static double nowSec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
-int main() {
-    // 创建线程池
-    ThreadPool pool(3, 10);
-    for (int i = 0; i < 100; ++i) {
+// 等待所有任务执行完：任务的结果都累加到 g_sum
+static void waitSum(long expect) {
+    while (g_sum.load() != expect)
+        std::this_thread::yield();
+}
+
+static double benchAddTask(ThreadPool& pool, int n) {
+    g_sum = 0;
+    double begin = nowSec();
+    for (int i = 0; i < n; ++i) {
         int* num = (int*)malloc(sizeof(int));
-        *num = i + 100;
-        Task t(taskFunc, num);
-        pool.addTask(t);
+        *num = 1;
+        pool.addTask(Task(taskFunc, num));
     }
-
-    sleep(20);
-    return 0;
+    waitSum(n);
+    return n / (nowSec() - begin);
 }
 
-/* void taskFunc(void* arg) {
-    int num = *(int*)arg;
-    printf("thread %ld is working, number = %d\n", pthread_self(), num);
-    sleep(1);
+static double benchPost(ThreadPool& pool, int n) {
+    g_sum = 0;
+    double begin = nowSec();
+    for (int i = 0; i < n; ++i)
+        pool.post([]() { g_sum++; });
+    waitSum(n);
+    return n / (nowSec() - begin);
 }
 
-int main() {
-    // 创建线程池
-    ThreadPool* pool = threadPoolCreate(3, 10, 100);
-    for (int i = 0; i < 100; ++i) {
-        int* num = (int*)malloc(sizeof(int));
-        *num = i + 100;
-        threadPoolAdd(pool, taskFunc, num);
+static double benchPostBulk(ThreadPool& pool, int n) {
+    const int BATCH = 64;
+    std::vector<unique_task> batch;
+    batch.reserve(BATCH);
+    g_sum = 0;
+    double begin = nowSec();
+    for (int i = 0; i < n; i += BATCH) {
+        batch.clear();
+        for (int j = i; j < n && j < i + BATCH; ++j)
+            batch.emplace_back([]() { g_sum++; });
+        pool.postBulk(batch.begin(), batch.end());
     }
+    waitSum(n);
+    return n / (nowSec() - begin);
+}
+
+static double benchSubmit(ThreadPool& pool, int n) {
+    std::vector<task_future<int>> futures;
+    futures.reserve(n);
+    double begin = nowSec();
+    for (int i = 0; i < n; ++i)
+        futures.push_back(pool.submit([i]() { return i & 1; }));
+    long sum = 0;
+    for (int i = 0; i < n; ++i)
+        sum += futures[i].get();
+    double cost = nowSec() - begin;
+    if (sum != n / 2)
+        printf("submit: wrong result %ld\n", sum);
+    return n / cost;
+}
 
-    sleep(20);
+int main(int argc, char* argv[]) {
+    int tasks = argc > 1 ? atoi(argv[1]) : 1000000;
+    int maxThreads = argc > 2 ? atoi(argv[2]) : 8;
 
-    threadPoolDestroy(pool);
+    printf("%-8s %-14s %-14s %-14s %-14s\n", "threads", "addTask/s", "post/s", "postBulk/s", "submit/s");
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        // 最小、最大线程数相同，管理者线程不会增减线程
+        ThreadPool pool(threads, threads);
+        double a = benchAddTask(pool, tasks);
+        double b = benchPost(pool, tasks);
+        double c = benchPostBulk(pool, tasks);
+        double d = benchSubmit(pool, tasks);
+        printf("%-8d %-14.0f %-14.0f %-14.0f %-14.0f\n", threads, a, b, c, d);
+    }
     return 0;
-} */
\ No newline at end of file
+}
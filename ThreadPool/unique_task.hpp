@@ -0,0 +1,283 @@
+#ifndef _UNIQUE_TASK_HPP_
+#define _UNIQUE_TASK_HPP_
+
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// 只能移动的 void() 可调用对象，std::function 要求可拷贝且大一些的 lambda 总要分配内存
+// 不超过 INLINE_SIZE 字节、移动不抛异常的可调用对象直接存放在对象内部，不分配堆内存
+class unique_task {
+   public:
+    static const size_t INLINE_SIZE = 48;
+
+    unique_task() noexcept : m_ops(nullptr) {}
+
+    template <class F, class = typename std::enable_if<
+                           !std::is_same<typename std::decay<F>::type, unique_task>::value>::type>
+    unique_task(F&& f) : m_ops(nullptr) {
+        typedef typename std::decay<F>::type Fn;
+        construct<Fn>(std::forward<F>(f), std::integral_constant<bool, fits<Fn>()>());
+    }
+
+    unique_task(unique_task&& other) noexcept : m_ops(other.m_ops) {
+        if (m_ops) {
+            m_ops->move(m_storage, other.m_storage);
+            other.m_ops = nullptr;
+        }
+    }
+
+    unique_task& operator=(unique_task&& other) noexcept {
+        if (this != &other) {
+            reset();
+            m_ops = other.m_ops;
+            if (m_ops) {
+                m_ops->move(m_storage, other.m_storage);
+                other.m_ops = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    ~unique_task() { reset(); }
+
+    void operator()() { m_ops->invoke(m_storage); }
+
+    explicit operator bool() const { return m_ops != nullptr; }
+
+    // 可调用对象是否能存放在内部
+    template <class Fn>
+    static constexpr bool fits() {
+        return sizeof(Fn) <= INLINE_SIZE &&
+               alignof(Fn) <= alignof(std::max_align_t) &&
+               std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+   private:
+    unique_task(const unique_task&) = delete;
+    unique_task& operator=(const unique_task&) = delete;
+
+    struct ops {
+        void (*invoke)(void* storage);
+        void (*move)(void* dst, void* src);  // 移动到 dst 并销毁 src
+        void (*destroy)(void* storage);
+    };
+
+    // 内部存储：对象本身放在 m_storage 中
+    template <class Fn>
+    struct inline_ops {
+        static void invoke(void* s) { (*static_cast<Fn*>(s))(); }
+        static void move(void* dst, void* src) {
+            new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+            static_cast<Fn*>(src)->~Fn();
+        }
+        static void destroy(void* s) { static_cast<Fn*>(s)->~Fn(); }
+        static const ops table;
+    };
+
+    // 堆存储：m_storage 中只放一个指针
+    template <class Fn>
+    struct heap_ops {
+        static Fn*& ptr(void* s) { return *static_cast<Fn**>(s); }
+        static void invoke(void* s) { (*ptr(s))(); }
+        static void move(void* dst, void* src) { new (dst) Fn*(ptr(src)); }
+        static void destroy(void* s) { delete ptr(s); }
+        static const ops table;
+    };
+
+    template <class Fn, class F>
+    void construct(F&& f, std::true_type) {
+        new (m_storage) Fn(std::forward<F>(f));
+        m_ops = &inline_ops<Fn>::table;
+    }
+
+    template <class Fn, class F>
+    void construct(F&& f, std::false_type) {
+        new (m_storage) Fn*(new Fn(std::forward<F>(f)));
+        m_ops = &heap_ops<Fn>::table;
+    }
+
+    void reset() {
+        if (m_ops) {
+            m_ops->destroy(m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char m_storage[INLINE_SIZE];
+    const ops* m_ops;
+};
+
+template <class Fn>
+const unique_task::ops unique_task::inline_ops<Fn>::table = {&inline_ops<Fn>::invoke, &inline_ops<Fn>::move,
+                                                             &inline_ops<Fn>::destroy};
+
+template <class Fn>
+const unique_task::ops unique_task::heap_ops<Fn>::table = {&heap_ops<Fn>::invoke, &heap_ops<Fn>::move,
+                                                           &heap_ops<Fn>::destroy};
+
+namespace detail {
+
+// future 的共享状态，由任务和 task_future 各持有一个引用
+// m_state：0 未完成，1 已完成，2 未完成且有线程在 futex 上等待
+struct future_base {
+    future_base() : m_state(0), m_refs(2) {}
+    virtual ~future_base() {}
+
+    void release() {
+        if (m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+    }
+
+    bool ready() const { return m_state.load(std::memory_order_acquire) == 1; }
+
+    void wait() {
+        for (int i = 0; i < 128; ++i) {
+            if (ready())
+                return;
+        }
+        while (!ready()) {
+            uint32_t expected = 0;
+            m_state.compare_exchange_strong(expected, 2);
+            if (expected == 1)
+                return;
+            syscall(SYS_futex, &m_state, FUTEX_WAIT_PRIVATE, 2, nullptr, nullptr, 0);
+        }
+    }
+
+    void set_ready() {
+        if (m_state.exchange(1, std::memory_order_acq_rel) == 2)
+            syscall(SYS_futex, &m_state, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+    }
+
+    // 任务被丢弃而没有执行
+    void abandon() {
+        m_error = std::make_exception_ptr(std::future_error(std::future_errc::broken_promise));
+        set_ready();
+    }
+
+    virtual void run() = 0;
+
+    std::atomic<uint32_t> m_state;
+    std::atomic<int> m_refs;
+    std::exception_ptr m_error;
+};
+
+template <class R>
+struct future_value : future_base {
+    future_value() : m_has_value(false) {}
+    ~future_value() {
+        if (m_has_value)
+            reinterpret_cast<R*>(&m_value)->~R();
+    }
+    template <class F>
+    void invoke(F& fn) {
+        new (&m_value) R(fn());
+        m_has_value = true;
+    }
+    R take() { return std::move(*reinterpret_cast<R*>(&m_value)); }
+
+    typename std::aligned_storage<sizeof(R), alignof(R)>::type m_value;
+    bool m_has_value;
+};
+
+template <>
+struct future_value<void> : future_base {
+    template <class F>
+    void invoke(F& fn) {
+        fn();
+    }
+    void take() {}
+};
+
+// 可调用对象和结果放在同一块内存里，带 future 的任务只分配这一次
+template <class R, class F>
+struct future_task : future_value<R> {
+    explicit future_task(F&& fn) : m_fn(std::move(fn)) {}
+    void run() {
+        try {
+            this->invoke(m_fn);
+        } catch (...) {
+            this->m_error = std::current_exception();
+        }
+        this->set_ready();
+    }
+    F m_fn;
+};
+
+// 放进任务队列的部分只有一个指针，总能存放在 unique_task 内部
+struct future_runner {
+    explicit future_runner(future_base* s) : m_state(s) {}
+    future_runner(future_runner&& other) noexcept : m_state(other.m_state) { other.m_state = nullptr; }
+    ~future_runner() {
+        if (m_state) {
+            m_state->abandon();
+            m_state->release();
+        }
+    }
+    void operator()() {
+        future_base* s = m_state;
+        m_state = nullptr;
+        s->run();
+        s->release();
+    }
+    future_base* m_state;
+};
+
+}  // namespace detail
+
+// 轻量的 future：不含互斥锁和条件变量，等待时先自旋，再在 futex 上休眠
+template <class R>
+class task_future {
+   public:
+    task_future() : m_state(nullptr) {}
+    explicit task_future(detail::future_value<R>* s) : m_state(s) {}
+    task_future(task_future&& other) noexcept : m_state(other.m_state) { other.m_state = nullptr; }
+    task_future& operator=(task_future&& other) noexcept {
+        if (this != &other) {
+            if (m_state)
+                m_state->release();
+            m_state = other.m_state;
+            other.m_state = nullptr;
+        }
+        return *this;
+    }
+    ~task_future() {
+        if (m_state)
+            m_state->release();
+    }
+
+    bool valid() const { return m_state != nullptr; }
+    bool ready() const { return m_state->ready(); }
+    void wait() const { m_state->wait(); }
+
+    // 等待结果；任务抛出的异常在这里重新抛出。与 std::future 一样只能取一次
+    R get() {
+        m_state->wait();
+        detail::future_value<R>* s = m_state;
+        m_state = nullptr;
+        struct guard {
+            detail::future_value<R>* s;
+            ~guard() { s->release(); }
+        } g = {s};
+        if (s->m_error)
+            std::rethrow_exception(s->m_error);
+        return s->take();
+    }
+
+   private:
+    task_future(const task_future&) = delete;
+    task_future& operator=(const task_future&) = delete;
+
+    detail::future_value<R>* m_state;
+};
+
+#endif  // _UNIQUE_TASK_HPP_
@@ -0,0 +1,146 @@
+/*
+ * 时钟服务的读取开销与一致性
+ *   ./clockTest [threads] [reads]
+ * 每个线程各做reads次"取时间并得到日志时间戳"：
+ *   syscall   每次gettimeofday + localtime_r + snprintf(相当于没有按秒缓存的写法)
+ *   cached    每次gettimeofday，秒数变化时才重新格式化(原来utc_timer的写法，但每个线程一份，不共享)
+ *   clock     coarse_clock::update() + read()，字符串由时钟服务按秒格式化并发布
+ * 同时检查clock读到的快照是自洽的(字符串的秒与real_ms一致)、单调时钟不倒退。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "coarse_clock.hpp"
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static long g_reads;
+static volatile int g_sink;
+
+struct result
+{
+    uint64_t ns;
+    long torn;      //字符串与real_ms不是同一秒
+    long backwards; //单调时钟倒退
+};
+
+static void *run_syscall(void *arg)
+{
+    result *r = (result *)arg;
+    char buf[64];
+    uint64_t begin = now_ns();
+    for (long i = 0; i < g_reads; ++i)
+    {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        struct tm tm;
+        time_t sec = tv.tv_sec;
+        localtime_r(&sec, &tm);
+        snprintf(buf, sizeof(buf), "%d-%02d-%02d %02d:%02d:%02d.%03d", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+                 tm.tm_hour, tm.tm_min, tm.tm_sec, (int)(tv.tv_usec / 1000));
+        g_sink += buf[18];
+    }
+    r->ns = now_ns() - begin;
+    return NULL;
+}
+
+static void *run_cached(void *arg)
+{
+    result *r = (result *)arg;
+    char buf[64];
+    time_t last = 0;
+    uint64_t begin = now_ns();
+    for (long i = 0; i < g_reads; ++i)
+    {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        if (tv.tv_sec != last)
+        {
+            struct tm tm;
+            last = tv.tv_sec;
+            localtime_r(&last, &tm);
+            snprintf(buf, sizeof(buf), "%d-%02d-%02d %02d:%02d:%02d", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+                     tm.tm_hour, tm.tm_min, tm.tm_sec);
+        }
+        g_sink += buf[18] + (int)(tv.tv_usec / 1000);
+    }
+    r->ns = now_ns() - begin;
+    return NULL;
+}
+
+static void *run_clock(void *arg)
+{
+    result *r = (result *)arg;
+    coarse_clock *clk = coarse_clock::ins();
+    int64_t last_mono = 0;
+    uint64_t begin = now_ns();
+    for (long i = 0; i < g_reads; ++i)
+    {
+        clock_snapshot snap;
+        clk->update();
+        clk->read(&snap);
+        g_sink += snap.log_fmt[18] + (int)(snap.real_ms % 1000);
+
+        if (snap.mono_ms < last_mono)
+            r->backwards++;
+        last_mono = snap.mono_ms;
+        if ((i & 1023) == 0)
+        {
+            struct tm tm;
+            time_t sec = snap.real_ms / 1000;
+            localtime_r(&sec, &tm);
+            if (tm.tm_sec != atoi(snap.log_fmt + 17))
+                r->torn++;
+        }
+    }
+    r->ns = now_ns() - begin;
+    return NULL;
+}
+
+static void bench(const char *name, void *(*fn)(void *), int threads)
+{
+    pthread_t tids[64];
+    result res[64];
+    memset(res, 0, sizeof(res));
+    for (int i = 0; i < threads; ++i)
+        pthread_create(&tids[i], NULL, fn, &res[i]);
+    uint64_t ns = 0;
+    long torn = 0, backwards = 0;
+    for (int i = 0; i < threads; ++i)
+    {
+        pthread_join(tids[i], NULL);
+        ns += res[i].ns;
+        torn += res[i].torn;
+        backwards += res[i].backwards;
+    }
+    printf("%-8s threads=%2d %7.1fns/read torn=%ld backwards=%ld\n", name, threads, (double)ns / threads / g_reads,
+           torn, backwards);
+}
+
+int main(int argc, char *argv[])
+{
+    int max_threads = argc > 1 ? atoi(argv[1]) : 8;
+    g_reads = argc > 2 ? atol(argv[2]) : 2000000;
+    if (max_threads > 64)
+        max_threads = 64;
+
+    for (int threads = 1; threads <= max_threads; threads *= 2)
+    {
+        bench("syscall", run_syscall, threads);
+        bench("cached", run_cached, threads);
+        bench("clock", run_clock, threads);
+    }
+    coarse_clock *clk = coarse_clock::ins();
+    clock_snapshot snap;
+    clk->read(&snap);
+    printf("publishes=%llu formats=%llu log=%s date=%s\n", (unsigned long long)clk->publishes(),
+           (unsigned long long)clk->formats(), snap.log_fmt, snap.http_date);
+    return 0;
+}
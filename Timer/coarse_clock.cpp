@@ -0,0 +1,78 @@
+#include <string.h>
+#include "coarse_clock.hpp"
+
+static int64_t to_ms(const struct timespec &ts)
+{
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+coarse_clock::coarse_clock()
+    : m_seq(0), m_writing(false), m_mono_ms(0), m_sec(-1), m_publishes(0), m_formats(0)
+{
+    memset(&m_snap, 0, sizeof(m_snap));
+    update();
+}
+
+coarse_clock *coarse_clock::ins()
+{
+    static coarse_clock clock;
+    return &clock;
+}
+
+void coarse_clock::format(time_t sec)
+{
+    struct tm tm;
+    localtime_r(&sec, &tm);
+    m_snap.year = tm.tm_year + 1900;
+    m_snap.mon = tm.tm_mon + 1;
+    m_snap.day = tm.tm_mday;
+    strftime(m_snap.log_fmt, sizeof(m_snap.log_fmt), "%Y-%m-%d %H:%M:%S", &tm);
+    gmtime_r(&sec, &tm);
+    strftime(m_snap.http_date, sizeof(m_snap.http_date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    m_sec = sec;
+    m_formats++;
+}
+
+int64_t coarse_clock::update()
+{
+    struct timespec mono, real;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &mono);
+    clock_gettime(CLOCK_REALTIME_COARSE, &real);
+    int64_t mono_ms = to_ms(mono), real_ms = to_ms(real);
+
+    /* 粗粒度时钟每几毫秒才走一格，多数调用到这里就返回，不碰写者标志 */
+    if (mono_ms <= m_mono_ms.load(std::memory_order_relaxed))
+        return mono_ms;
+    if (m_writing.exchange(true, std::memory_order_acquire))
+        return mono_ms;
+
+    /* 读时间和拿到写者标志之间可能有别的线程发布了更晚的时间，不能让时间倒退 */
+    if (mono_ms > m_snap.mono_ms)
+    {
+        uint32_t seq = m_seq.load(std::memory_order_relaxed);
+        m_seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        m_snap.mono_ms = mono_ms;
+        m_snap.real_ms = real_ms;
+        if (real.tv_sec != m_sec)
+            format(real.tv_sec);
+
+        m_seq.store(seq + 2, std::memory_order_release);
+        m_mono_ms.store(mono_ms, std::memory_order_release);
+        m_publishes++;
+    }
+    m_writing.store(false, std::memory_order_release);
+    return mono_ms;
+}
+
+void coarse_clock::read(clock_snapshot *snap) const
+{
+    uint32_t seq;
+    do
+    {
+        seq = m_seq.load(std::memory_order_acquire);
+        memcpy(snap, &m_snap, sizeof(*snap));
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != m_seq.load(std::memory_order_relaxed));
+}
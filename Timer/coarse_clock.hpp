@@ -0,0 +1,63 @@
+#ifndef COARSE_CLOCK_H
+#define COARSE_CLOCK_H
+
+#include <atomic>
+#include <stdint.h>
+#include <time.h>
+
+/*一次发布的时间，读者拿到的各字段属于同一时刻*/
+struct clock_snapshot
+{
+    int64_t mono_ms;    /*CLOCK_MONOTONIC_COARSE的毫秒数，定时器使用*/
+    int64_t real_ms;    /*CLOCK_REALTIME_COARSE的毫秒数*/
+    int year, mon, day; /*本地日期，日志文件按天切分*/
+    char log_fmt[20];   /*本地时间"YYYY-MM-DD hh:mm:ss"，日志的时间戳*/
+    char http_date[30]; /*RFC 7231的IMF-fixdate，如"Sun, 06 Nov 1994 08:49:37 GMT"，响应的Date首部*/
+};
+
+/**
+ * @brief 粗粒度时钟服务：事件循环每轮调用update()读取CLOCK_MONOTONIC_COARSE和CLOCK_REALTIME_COARSE
+ *        (经vDSO读取，不陷入内核)，秒数变化时才重新格式化日志时间戳和Date字符串，通过顺序锁(seqlock)发布。
+ *        定时器、日志和HTTP响应都从这里取时间，读者不加锁、不发起系统调用。
+ *        其他线程也可以调用update()，时钟没走时直接返回；同一时刻只有一个线程在发布，其余的跳过。
+ */
+class coarse_clock
+{
+public:
+    static coarse_clock *ins();
+
+    /**
+     * @brief 读取当前时间，比已发布的新就发布出去
+     * @return 读到的单调时钟毫秒数
+     */
+    int64_t update();
+
+    /*最近一次发布的单调时钟毫秒数*/
+    int64_t mono_ms() const { return m_mono_ms.load(std::memory_order_acquire); }
+
+    /*读取最近一次发布的完整时间，与发布者并发时重读*/
+    void read(clock_snapshot *snap) const;
+
+    /*发布的次数，以及其中重新格式化字符串的次数*/
+    uint64_t publishes() const { return m_publishes; }
+    uint64_t formats() const { return m_formats; }
+
+private:
+    coarse_clock();
+
+    coarse_clock(const coarse_clock &);
+    coarse_clock &operator=(const coarse_clock &);
+
+    /*格式化sec对应的字符串，只由持有m_writing的线程调用*/
+    void format(time_t sec);
+
+    std::atomic<uint32_t> m_seq;    /*顺序锁，奇数表示正在发布*/
+    std::atomic<bool> m_writing;    /*有线程正在发布*/
+    std::atomic<int64_t> m_mono_ms; /*单独发布一份，定时器只要它，不必走顺序锁*/
+    clock_snapshot m_snap;
+    time_t m_sec;                   /*字符串对应的秒*/
+    uint64_t m_publishes;
+    uint64_t m_formats;
+};
+
+#endif
@@ -1,157 +1,6 @@
 #include "timer.hpp"
 #include "../HttpConn/http_conn.hpp"
 
-sort_timer_lst::sort_timer_lst() {
-    head = NULL;
-    tail = NULL;
-}
-
-sort_timer_lst::~sort_timer_lst() {
-    util_timer* tmp = head;
-    while (tmp) {
-        head = tmp->next;
-        delete tmp;
-        tmp = head;
-    }
-}
-
-void sort_timer_lst::add_timer(util_timer* timer) {
-    if (!timer) {
-        return;
-    }
-    if (!head) {
-        head = tail = timer;
-        return;
-    }
-    /*如果目标定时器的超时时间小于当前链表中所有定时器的超时时间，则把该定时器插入链表头部，
-    作为链表新的头节点。否则就需要调用重载函数add_timer(util_timer*timer,util_timer*lst_head)，
-    把它插入链表中合适的位置，以保证链表的升序特性*/
-    if (timer->expire < head->expire) {
-        timer->next = head;
-        head->prev = timer;
-        head = timer;
-        return;
-    }
-    add_timer(timer, head);
-}
-
-void sort_timer_lst::adjust_timer(util_timer* timer) {
-    if (!timer) {
-        return;
-    }
-    util_timer* tmp = timer->next;
-
-    /*如果被调整的目标定时器处在链表尾部，
-    或者该定时器新的超时值仍然小于其下一个定时器的超时值，则不用调整*/
-    if (!tmp || (timer->expire < tmp->expire)) {
-        return;
-    }
-
-    /*如果目标定时器是链表的头节点，则将该定时器从链表中取出并重新插入链表*/
-    if (timer == head) {
-        head = head->next;
-        head->prev = NULL;
-        timer->next = NULL;
-        add_timer(timer, head);
-    } else { 
-        /*如果目标定时器不是链表的头节点，则将该定时器从链表中取出，
-        然后插入其原来所在位置之后的部分链表中*/
-        timer->prev->next = timer->next;
-        timer->next->prev = timer->prev;
-        add_timer(timer, timer->next);
-    }
-}
-
-void sort_timer_lst::del_timer(util_timer* timer) {
-    if (!timer) {
-        return;
-    }
-
-    /*下面这个条件成立表示链表中只有一个定时器，即目标定时器*/ 
-    if ((timer == head) && (timer == tail)) {
-        delete timer;
-        head = NULL;
-        tail = NULL;
-        return;
-    }
-
-    /*如果链表中至少有两个定时器，且目标定时器是链表的头结点，
-    则将链表的头结点重置为原头节点的下一个节点，然后删除目标定时器*/ 
-    if (timer == head) {
-        head = head->next;
-        head->prev = NULL;
-        delete timer;
-        return;
-    }
-
-    /*如果链表中至少有两个定时器，且目标定时器是链表的尾结点，则
-    将链表的尾结点重置为原尾节点的前一个节点，然后删除目标定时器*/
-    if (timer == tail) {
-        tail = tail->prev;
-        tail->next = NULL;
-        delete timer;
-        return;
-    }
-
-    /*如果目标定时器位于链表的中间，则把它前后的定时器串联起来，然后删除目标定时器*/
-    timer->prev->next = timer->next;
-    timer->next->prev = timer->prev;
-    delete timer;
-}
-
-void sort_timer_lst::tick() {
-    if (!head) {
-        return;
-    }
-
-    time_t cur = time(NULL);
-    util_timer* tmp = head;
-
-    /*从头结点开始依次处理每个定时器，直到遇到一个尚未到期的定时器，这就是定时器的核心逻辑*/
-    while (tmp) {
-        /*因为每个定时器都使用绝对时间作为超时值，所以我们可以把定时器的超时值和系统当前时间，
-        比较以判断定时器是否到期，当定时器的值小于当前时间，就说明到期了，即开始执行到期任务*/
-        if (cur < tmp->expire) {
-            break;
-        }
-        /*调用定时器的回调函数，以执行定时任务*/
-        tmp->cb_func(tmp->user_data);
-        /*执行完定时器中的定时任务之后，就将它从链表中删除，并重置链表头结点*/
-        head = tmp->next;
-        if (head) {
-            head->prev = NULL;
-        }
-        delete tmp;
-        tmp = head;
-    }
-}
-
-void sort_timer_lst::add_timer(util_timer* timer, util_timer* lst_head) {
-    util_timer* prev = lst_head;
-    util_timer* tmp = prev->next;
-    /*遍历lst_head节点之后的部分链表，直到找到一个超时时间大于目标定时器的超时时间的节点，
-    并将目标定时器插入该节点之前*/
-    while (tmp) {
-        if (timer->expire < tmp->expire) {
-            prev->next = timer;
-            timer->next = tmp;
-            tmp->prev = timer;
-            timer->prev = prev;
-            break;
-        }
-        prev = tmp;
-        tmp = tmp->next;
-    }
-    /*如果遍历完lst_head节点之后的部分链表，仍未找到超时时间大于目标定时器的超时时间的节点，
-    则将目标定时器插入链表尾部，并把它设置为链表新的尾节点*/
-    if (!tmp) {
-        prev->next = timer;
-        timer->prev = prev;
-        timer->next = NULL;
-        tail = timer;
-    }
-}
-
 void Utils::init(int timeslot) {
     m_TIMESLOT = timeslot;
 }
@@ -202,15 +51,10 @@ void Utils::addsig(int sig, void(handler)(int), bool restart) {
 
 // 定时处理任务，重新定时以不断触发SIGALRM信号
 void Utils::timer_handler() {
-    m_timer_lst.tick();
+    m_timer_wheel.tick();
     alarm(m_TIMESLOT);
 }
 
-void Utils::show_error(int connfd, const char* info) {
-    send(connfd, info, strlen(info), 0);
-    close(connfd);
-}
-
 int* Utils::u_pipefd = 0;
 int Utils::u_epollfd = 0;
 
@@ -0,0 +1,198 @@
+/*
+ * 定时器的添加、刷新与到期处理：分层时间轮与原来的升序链表对比
+ *   ./timerTest [timers] [refreshes] [timeout]
+ * 先为timers个连接各加一个定时器(超时时间在[1, timeout]秒内随机，精确到毫秒)，然后模拟时间
+ * 按TIMER_TICK_MS推进(与事件循环相同)，每一步随机挑选连接刷新为now + timeout并处理到期的定时器，
+ * 挑中已到期关闭的连接时当作新连接重新添加，连接总数保持不变。
+ * 链表的添加和刷新都是O(n)的，10万个定时器仅添加就要约n^2/2次比较，因此链表只用1/10的定时器、
+ * 做1/50的刷新，按每次操作的耗时比较；
+ * lazy表示刷新只记下活动时间(WebServer的做法)，到期时再按剩余时间重新放入；
+ * relinks为平均每次刷新放入格中的次数。另外检查每个定时器都在超时之后的一步之内被处理，没有提前。
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+#include "timer_wheel.hpp"
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static time_t g_now;     //模拟的当前时间(毫秒)
+static long g_fired;     //到期的定时器数
+static long g_off_time;  //提前或晚于一步才被处理的定时器数
+
+static void on_expire(client_data *data)
+{
+    util_timer *timer = data->timer;
+    g_fired++;
+    time_t due = timer->idle ? timer->active + timer->idle : timer->expire;
+    if (due > g_now || g_now - due >= TIMER_TICK_MS)
+        g_off_time++;
+    data->sockfd = -1; //连接已关闭
+}
+
+/* 原来的升序双向链表(sort_timer_lst)，节点换成内嵌的，只保留基准测试用到的操作 */
+struct sorted_list
+{
+    util_timer *head, *tail;
+
+    sorted_list() : head(NULL), tail(NULL) {}
+
+    void insert_after(util_timer *timer, util_timer *prev)
+    {
+        util_timer *tmp = prev->next;
+        while (tmp && timer->expire >= tmp->expire)
+        {
+            prev = tmp;
+            tmp = tmp->next;
+        }
+        prev->next = timer;
+        timer->prev = prev;
+        timer->next = tmp;
+        if (tmp)
+            tmp->prev = timer;
+        else
+            tail = timer;
+    }
+    void add_timer(util_timer *timer)
+    {
+        timer->prev = timer->next = NULL;
+        if (!head)
+        {
+            head = tail = timer;
+            return;
+        }
+        if (timer->expire < head->expire)
+        {
+            timer->next = head;
+            head->prev = timer;
+            head = timer;
+            return;
+        }
+        insert_after(timer, head);
+    }
+    void adjust_timer(util_timer *timer)
+    {
+        util_timer *tmp = timer->next;
+        if (!tmp || timer->expire < tmp->expire)
+            return;
+        if (timer == head)
+        {
+            head = head->next;
+            head->prev = NULL;
+            timer->next = NULL;
+            insert_after(timer, head);
+        }
+        else
+        {
+            timer->prev->next = timer->next;
+            timer->next->prev = timer->prev;
+            insert_after(timer, timer->next);
+        }
+    }
+    void tick(time_t cur)
+    {
+        while (head && cur >= head->expire)
+        {
+            util_timer *tmp = head;
+            head = tmp->next;
+            if (head)
+                head->prev = NULL;
+            else
+                tail = NULL;
+            tmp->cb_func(tmp->user_data);
+        }
+    }
+};
+
+static double relinks_of(const timer_wheel &wheel) { return wheel.relinks(); }
+static double relinks_of(const sorted_list &) { return 0; }
+
+template <typename Timers>
+static void run(const char *name, int n, long refreshes, int timeout_s, bool lazy)
+{
+    time_t timeout = timeout_s * 1000;
+    std::vector<client_data> conns(n);
+    Timers timers;
+    srand(1);
+    g_now = timer_wheel::now_ms() / TIMER_TICK_MS * TIMER_TICK_MS; //对齐到格的边界，每一步推进整一格
+    g_fired = g_off_time = 0;
+
+    uint64_t begin = now_ns();
+    for (int i = 0; i < n; ++i)
+    {
+        client_data &c = conns[i];
+        c.sockfd = i;
+        c.timer = &c.node;
+        c.node.cb_func = on_expire;
+        c.node.user_data = &c;
+        c.node.expire = g_now + 1000 + rand() % (timeout - 999);
+        c.node.active = c.node.expire - timeout;
+        c.node.idle = lazy ? timeout : 0;
+        timers.add_timer(c.timer);
+    }
+    uint64_t add_ns = now_ns() - begin;
+    double relinks = relinks_of(timers);
+
+    /* 每个连接在一个超时周期内平均有8次活动(keep-alive上的多个请求)，少数连接空闲到期 */
+    long per_step = (long)n * 8 * TIMER_TICK_MS / timeout > 0 ? (long)n * 8 * TIMER_TICK_MS / timeout : 1;
+    long done = 0, steps = 0;
+    uint64_t refresh_ns = 0, tick_ns = 0;
+    while (done < refreshes)
+    {
+        g_now += TIMER_TICK_MS;
+        ++steps;
+        uint64_t t = now_ns();
+        for (long k = 0; k < per_step && done < refreshes; ++k, ++done)
+        {
+            int i = rand() % n;
+            client_data &c = conns[i];
+            /* 已到期的连接被关闭了，换成一个新连接，和accept时一样添加定时器 */
+            if (c.sockfd < 0)
+            {
+                c.sockfd = i;
+                c.node.active = g_now;
+                c.node.expire = g_now + timeout;
+                timers.add_timer(c.timer);
+                continue;
+            }
+            if (lazy)
+            {
+                c.node.active = g_now;
+                continue;
+            }
+            c.node.expire = g_now + timeout;
+            timers.adjust_timer(c.timer);
+        }
+        uint64_t t2 = now_ns();
+        timers.tick(g_now);
+        refresh_ns += t2 - t;
+        tick_ns += now_ns() - t2;
+    }
+
+    printf("%-10s timeout=%5ds add=%7.1fns/op refresh=%9.1fns/op tick=%8.1fus/s relinks=%5.2f/refresh fired=%ld "
+           "off-time=%ld\n", name, timeout_s, (double)add_ns / n, (double)refresh_ns / done,
+           tick_ns / 1e3 / (steps * TIMER_TICK_MS / 1000.0),
+           (relinks_of(timers) - relinks) / done, g_fired, g_off_time);
+}
+
+int main(int argc, char *argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 100000;
+    long refreshes = argc > 2 ? atol(argv[2]) : 2000000;
+    int timeout = argc > 3 ? atoi(argv[3]) : 15;
+
+    printf("timers=%d refreshes=%ld (list: timers=%d refreshes=%ld)\n", n, refreshes, n / 10, refreshes / 50);
+    run<sorted_list>("list", n / 10, refreshes / 50, timeout, false);
+    run<timer_wheel>("wheel", n, refreshes, timeout, false);
+    run<timer_wheel>("wheel-lazy", n, refreshes, timeout, true);
+    /* 超过第0层一圈(25.6秒)的超时会经过级联 */
+    run<timer_wheel>("wheel", n, refreshes, 3600, false);
+    run<timer_wheel>("wheel-lazy", n, refreshes, 3600, true);
+    return 0;
+}
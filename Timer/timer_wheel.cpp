@@ -0,0 +1,142 @@
+#include <string.h>
+#include "timer_wheel.hpp"
+#include "coarse_clock.hpp"
+
+timer_wheel::timer_wheel() : m_now(now_ms() / TIMER_TICK_MS), m_size(0), m_relinks(0), m_rearms(0)
+{
+    memset(m_tv1, 0, sizeof(m_tv1));
+    memset(m_tvn, 0, sizeof(m_tvn));
+}
+
+time_t timer_wheel::now_ms()
+{
+    return coarse_clock::ins()->mono_ms();
+}
+
+void timer_wheel::link(util_timer **slot, util_timer *timer)
+{
+    timer->prev = NULL;
+    timer->next = *slot;
+    if (*slot)
+        (*slot)->prev = timer;
+    *slot = timer;
+    timer->slot = slot;
+}
+
+void timer_wheel::unlink(util_timer *timer)
+{
+    if (timer->prev)
+        timer->prev->next = timer->next;
+    else
+        *timer->slot = timer->next;
+    if (timer->next)
+        timer->next->prev = timer->prev;
+    timer->prev = timer->next = NULL;
+    timer->slot = NULL;
+}
+
+void timer_wheel::place(util_timer *timer)
+{
+    time_t expire = (timer->expire + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    time_t delta = expire - m_now;
+    util_timer **slot;
+    if (delta < 0)
+    {
+        /*已经到期的放在下一个要处理的格中，下次tick时执行*/
+        slot = &m_tv1[m_now & TVR_MASK];
+    }
+    else if (delta < TVR_SIZE)
+    {
+        slot = &m_tv1[expire & TVR_MASK];
+    }
+    else
+    {
+        int level = 0;
+        while (level < TVN_LEVELS && delta >= (time_t)1 << (TVR_BITS + (level + 1) * TVN_BITS))
+            ++level;
+        if (TVN_LEVELS == level)
+        {
+            /*超出时间轮范围的放在最远的格中，级联时再重新分配*/
+            level = TVN_LEVELS - 1;
+            expire = m_now + ((time_t)1 << (TVR_BITS + TVN_LEVELS * TVN_BITS)) - 1;
+        }
+        slot = &m_tvn[level][(expire >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK];
+    }
+    link(slot, timer);
+    m_relinks++;
+}
+
+void timer_wheel::cascade(int level, int idx)
+{
+    util_timer *timer = m_tvn[level][idx];
+    m_tvn[level][idx] = NULL;
+    while (timer)
+    {
+        util_timer *next = timer->next;
+        place(timer);
+        timer = next;
+    }
+}
+
+void timer_wheel::add_timer(util_timer *timer)
+{
+    if (!timer)
+        return;
+    place(timer);
+    m_size++;
+}
+
+void timer_wheel::adjust_timer(util_timer *timer)
+{
+    if (!timer)
+        return;
+    if (timer->slot)
+        unlink(timer);
+    else
+        m_size++;
+    place(timer);
+}
+
+void timer_wheel::del_timer(util_timer *timer)
+{
+    if (!timer || !timer->slot)
+        return;
+    unlink(timer);
+    m_size--;
+}
+
+void timer_wheel::tick(time_t cur)
+{
+    cur /= TIMER_TICK_MS;
+    while (m_now <= cur)
+    {
+        int idx = m_now & TVR_MASK;
+        /*第0层转完一圈，把上一层对应格中的定时器分配下来；上一层也转完一圈时继续往上*/
+        if (0 == idx)
+        {
+            for (int level = 0; level < TVN_LEVELS; ++level)
+            {
+                int i = (m_now >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK;
+                cascade(level, i);
+                if (i != 0)
+                    break;
+            }
+        }
+        /*先摘下再回调，回调中再对它调用del_timer不会出错*/
+        while (util_timer *timer = m_tv1[idx])
+        {
+            unlink(timer);
+            if (timer->idle && timer->active + timer->idle > m_now * TIMER_TICK_MS)
+            {
+                /*期间有过活动，按剩余的空闲时间重新放入，它在m_now之后，不会回到当前格*/
+                timer->expire = timer->active + timer->idle;
+                place(timer);
+                m_rearms++;
+                continue;
+            }
+            m_size--;
+            timer->cb_func(timer->user_data);
+        }
+        m_now++;
+    }
+}
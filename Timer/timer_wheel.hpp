@@ -0,0 +1,107 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <time.h>
+
+/* 时间轮的层级：第0层每格TIMER_TICK_MS毫秒共256格(25.6秒)，往上每层64格，每格是下一层转一圈的时间，
+共覆盖2^26格(约77天) */
+#define TIMER_TICK_MS 100 //一格的时间，也是定时器的精度
+#define TVR_BITS 8
+#define TVN_BITS 6
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVN_SIZE (1 << TVN_BITS)
+#define TVR_MASK (TVR_SIZE - 1)
+#define TVN_MASK (TVN_SIZE - 1)
+#define TVN_LEVELS 3 //第0层之上的层数
+
+struct client_data;
+
+/*定时器类，作为节点嵌在client_data中，不单独分配*/
+class util_timer
+{
+public:
+    util_timer() : expire(0), active(0), idle(0), cb_func(NULL), user_data(NULL), prev(NULL), next(NULL), slot(NULL) {}
+
+public:
+    time_t expire; /*任务的超时时间，这里使用绝对时间(单调时钟毫秒，见timer_wheel::now_ms)*/
+    /*空闲超时的惰性刷新：有活动时只更新active，不移动定时器；到期时若active + idle还没到，
+    就按剩余时间重新放入时间轮，否则才执行回调。idle为0表示到期即执行*/
+    time_t active;
+    time_t idle;
+    void (*cb_func)(client_data*); /*任务回调函数*/
+    /*回调函数处理的客户数据，由定时器的执行者传递给回调函数*/
+    client_data* user_data;
+    util_timer* prev; /*同一格中的前一个定时器*/
+    util_timer* next; /*同一格中的后一个定时器*/
+    util_timer** slot; /*所在格的链表头，不在时间轮中时为NULL*/
+};
+
+/*用户数据结构：客户端socket地址、socket文件描述符、读缓存和定时器*/
+struct client_data
+{
+    sockaddr_in address;
+    int sockfd;
+    util_timer *timer;
+    util_timer node; /*该连接的定时器节点，timer指向它*/
+    int phase; /*定时器当前按哪个阶段计时(见http_conn::CONN_PHASE)*/
+};
+
+/**
+ * @brief 分层时间轮：添加、调整、删除都是O(1)，不随定时器数量增长；
+ *        时间以单调时钟的毫秒计，tick按TIMER_TICK_MS一格推进，定时器不会早于超时时间执行，最多晚一格；
+ *        第0层转完一圈时把上一层对应格中的定时器重新分配到下层(级联)。
+ *        接口与原来的升序链表相同，定时器到期仍调用cb_func(user_data)；只由主线程访问。
+ */
+class timer_wheel
+{
+public:
+    timer_wheel();
+
+    /*将目标定时器timer添加到时间轮中，timer不能已在时间轮中*/
+    void add_timer(util_timer *timer);
+
+    /*定时器的超时时间改变后调用，移到新的格中*/
+    void adjust_timer(util_timer *timer);
+
+    /*将目标定时器timer从时间轮中删除，不在时间轮中时什么也不做；节点内存由所属的client_data管理*/
+    void del_timer(util_timer *timer);
+
+    /*处理到当前时间为止所有到期的定时器*/
+    void tick() { tick(now_ms()); }
+
+    /*处理到cur(毫秒)为止所有到期的定时器*/
+    void tick(time_t cur);
+
+    /*定时器使用的时间：时钟服务最近一次发布的单调时钟毫秒数(见coarse_clock)，不受系统时间调整影响*/
+    static time_t now_ms();
+
+    /*时间轮中的定时器数*/
+    size_t size() const { return m_size; }
+
+    /*放入格中的次数(添加、调整、级联、惰性重新放入都算)，衡量时间轮本身的开销*/
+    unsigned long long relinks() const { return m_relinks; }
+
+    /*到期时发现期间有活动而重新放入的次数*/
+    unsigned long long rearms() const { return m_rearms; }
+
+private:
+    /*按超时时间与m_now的距离选择层和格，超时时间向上取整到格，保证不提前执行*/
+    void place(util_timer *timer);
+
+    /*把第0层之上第level层(m_tvn[level])第idx格中的定时器重新放入时间轮*/
+    void cascade(int level, int idx);
+
+    static void link(util_timer **slot, util_timer *timer);
+    static void unlink(util_timer *timer);
+
+    time_t m_now; /*下一个要处理的格(毫秒数 / TIMER_TICK_MS)*/
+    size_t m_size;
+    unsigned long long m_relinks;
+    unsigned long long m_rearms;
+    util_timer *m_tv1[TVR_SIZE];
+    util_timer *m_tvn[TVN_LEVELS][TVN_SIZE];
+};
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+/**
+ * @brief 布隆过滤器：判定"一定不存在"或"可能存在"。
+ *        采用双重哈希 h1 + i*h2 生成k个位置；add使用原子或操作，允许多个线程并发插入和查询。
+ */
+class bloom_filter
+{
+public:
+    bloom_filter() : m_bits(NULL), m_nbits(0), m_words(0), m_k(0) {}
+    ~bloom_filter() { delete[] m_bits; }
+
+    /**
+     * @brief 按预计元素个数和期望误判率分配位数组
+     * @param expected 预计元素个数
+     * @param fp_rate 期望误判率，例如0.01
+     */
+    void init(uint64_t expected, double fp_rate)
+    {
+        if (expected < 1024)
+            expected = 1024;
+        /* m = -n*ln(p)/(ln2)^2, k = m/n*ln2 */
+        double m = -(double)expected * log(fp_rate) / (M_LN2 * M_LN2);
+        m_words = ((uint64_t)m + 63) / 64;
+        m_nbits = m_words * 64;
+        m_k = (int)(m / expected * M_LN2 + 0.5);
+        if (m_k < 1)
+            m_k = 1;
+
+        delete[] m_bits;
+        m_bits = new uint64_t[m_words];
+        memset(m_bits, 0, m_words * sizeof(uint64_t));
+    }
+
+    void add(const char *data, size_t len)
+    {
+        uint64_t h1, h2;
+        hash(data, len, h1, h2);
+        for (int i = 0; i < m_k; ++i)
+        {
+            uint64_t bit = (h1 + i * h2) % m_nbits;
+            __atomic_fetch_or(&m_bits[bit >> 6], (uint64_t)1 << (bit & 63), __ATOMIC_RELAXED);
+        }
+    }
+
+    bool may_contain(const char *data, size_t len) const
+    {
+        uint64_t h1, h2;
+        hash(data, len, h1, h2);
+        for (int i = 0; i < m_k; ++i)
+        {
+            uint64_t bit = (h1 + i * h2) % m_nbits;
+            if (!(__atomic_load_n(&m_bits[bit >> 6], __ATOMIC_RELAXED) & ((uint64_t)1 << (bit & 63))))
+                return false;
+        }
+        return true;
+    }
+
+    size_t bytes() const { return m_words * sizeof(uint64_t); }
+    int hashes() const { return m_k; }
+
+private:
+    /* 64位FNV-1a得到h1，再经splitmix64混合得到h2，h2取奇数保证步长与位数组长度互素的概率更高 */
+    static void hash(const char *data, size_t len, uint64_t &h1, uint64_t &h2)
+    {
+        uint64_t h = 14695981039346656037ull;
+        for (size_t i = 0; i < len; ++i)
+        {
+            h ^= (unsigned char)data[i];
+            h *= 1099511628211ull;
+        }
+        h1 = h;
+        h += 0x9e3779b97f4a7c15ull;
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+        h2 = (h ^ (h >> 31)) | 1;
+    }
+
+    /* 下面两个函数，禁止对象拷贝、赋值 */
+    bloom_filter(const bloom_filter &);
+    bloom_filter &operator=(const bloom_filter &);
+
+    uint64_t *m_bits;  //位数组
+    uint64_t m_nbits;  //位数
+    uint64_t m_words;  //位数组占用的64位字数
+    int m_k;           //哈希函数个数
+};
+
+#endif
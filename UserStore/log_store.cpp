@@ -0,0 +1,391 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "log_store.hpp"
+#include "../Log/log.hpp"
+
+#define STORE_MAGIC "USRLOG01"
+#define STORE_MAGIC_LEN 8
+#define RECORD_HEADER 8
+
+/* 文件小于该大小时不压缩，避免小文件上频繁重写 */
+#define COMPACT_MIN_BYTES (4 * 1024 * 1024)
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint32_t checksum(const char *data, size_t len, uint32_t h)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        h ^= (unsigned char)data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* 校验和覆盖两个长度字段和内容，用来识别崩溃时写了一半的尾部记录 */
+static uint32_t record_sum(uint16_t name_len, uint16_t passwd_len, const char *name, const char *passwd)
+{
+    uint32_t h = 2166136261u;
+    h = checksum((const char *)&name_len, sizeof(name_len), h);
+    h = checksum((const char *)&passwd_len, sizeof(passwd_len), h);
+    h = checksum(name, name_len, h);
+    return checksum(passwd, passwd_len, h);
+}
+
+static bool write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, data, len);
+        if (n < 0)
+        {
+            if (EINTR == errno)
+                continue;
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* rename之后还要fsync所在目录，新的目录项才算持久 */
+static void sync_dir(const string &path)
+{
+    char buf[512];
+    snprintf(buf, sizeof(buf), "%s", path.c_str());
+    int fd = open(dirname(buf), O_RDONLY | O_DIRECTORY);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+log_user_store::log_user_store()
+    : m_close_log(0), m_fd(-1), m_appended(0), m_durable(0), m_file_bytes(0), m_live_bytes(0),
+      m_broken(false), m_stop(false), m_running(false), m_lookups(0), m_inserts(0), m_fsyncs(0),
+      m_fsync_ns(0), m_batch_max(0), m_compactions(0)
+{
+}
+
+log_user_store::~log_user_store()
+{
+    shutdown();
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+void log_user_store::init(const string &path, int close_log)
+{
+    m_path = path;
+    m_close_log = close_log;
+}
+
+size_t log_user_store::record_bytes(const string &name, const string &passwd)
+{
+    return RECORD_HEADER + name.size() + passwd.size();
+}
+
+void log_user_store::encode(string &buf, const string &name, const string &passwd)
+{
+    uint16_t name_len = name.size(), passwd_len = passwd.size();
+    uint32_t sum = record_sum(name_len, passwd_len, name.data(), passwd.data());
+    buf.append((const char *)&sum, sizeof(sum));
+    buf.append((const char *)&name_len, sizeof(name_len));
+    buf.append((const char *)&passwd_len, sizeof(passwd_len));
+    buf.append(name);
+    buf.append(passwd);
+}
+
+long log_user_store::replay()
+{
+    struct stat st;
+    if (fstat(m_fd, &st) < 0)
+        return -1;
+    if (0 == st.st_size)
+    {
+        if (!write_all(m_fd, STORE_MAGIC, STORE_MAGIC_LEN) || fdatasync(m_fd) != 0)
+            return -1;
+        return STORE_MAGIC_LEN;
+    }
+
+    string data(st.st_size, '\0');
+    size_t got = 0;
+    while (got < data.size())
+    {
+        ssize_t n = pread(m_fd, &data[got], data.size() - got, got);
+        if (n < 0 && EINTR == errno)
+            continue;
+        if (n <= 0)
+            return -1;
+        got += n;
+    }
+    if (data.size() < STORE_MAGIC_LEN || memcmp(data.data(), STORE_MAGIC, STORE_MAGIC_LEN) != 0)
+    {
+        LOG_ERROR("user store %s: bad magic", m_path.c_str());
+        return -1;
+    }
+
+    /* 同名记录以后写入的为准 */
+    size_t pos = STORE_MAGIC_LEN;
+    while (pos + RECORD_HEADER <= data.size())
+    {
+        uint32_t sum;
+        uint16_t name_len, passwd_len;
+        memcpy(&sum, data.data() + pos, sizeof(sum));
+        memcpy(&name_len, data.data() + pos + 4, sizeof(name_len));
+        memcpy(&passwd_len, data.data() + pos + 6, sizeof(passwd_len));
+        size_t end = pos + RECORD_HEADER + name_len + passwd_len;
+        if (end > data.size())
+            break;
+        const char *name = data.data() + pos + RECORD_HEADER;
+        const char *passwd = name + name_len;
+        if (sum != record_sum(name_len, passwd_len, name, passwd))
+            break;
+        m_index[string(name, name_len)] = string(passwd, passwd_len);
+        pos = end;
+    }
+    return pos;
+}
+
+bool log_user_store::load()
+{
+    uint64_t begin = now_ns();
+    m_fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (m_fd < 0)
+    {
+        LOG_ERROR("open user store %s failed: errno %d", m_path.c_str(), errno);
+        return false;
+    }
+
+    long valid = replay();
+    if (valid < 0)
+    {
+        LOG_ERROR("replay user store %s failed", m_path.c_str());
+        return false;
+    }
+
+    /* 崩溃可能留下写了一半的记录，截掉后新记录才能接在有效数据之后 */
+    struct stat st;
+    if (fstat(m_fd, &st) == 0 && st.st_size > valid)
+    {
+        LOG_WARN("user store %s: truncating %lld bytes of torn tail", m_path.c_str(),
+                 (long long)(st.st_size - valid));
+        if (ftruncate(m_fd, valid) != 0 || fdatasync(m_fd) != 0)
+            return false;
+    }
+
+    m_file_bytes = valid;
+    m_live_bytes = STORE_MAGIC_LEN;
+    for (unordered_map<string, string>::iterator it = m_index.begin(); it != m_index.end(); ++it)
+        m_live_bytes += record_bytes(it->first, it->second);
+
+    m_lock.lock();
+    if (need_compact())
+        compact();
+    m_lock.unlock();
+
+    if (pthread_create(&m_flusher, NULL, flush_worker, this) != 0)
+        return false;
+    m_running = true;
+
+    LOG_INFO("user store %s loaded: %llu users, %llu bytes in %llu ms", m_path.c_str(),
+             (unsigned long long)m_index.size(), (unsigned long long)m_file_bytes,
+             (unsigned long long)((now_ns() - begin) / 1000000));
+    return true;
+}
+
+bool log_user_store::find(const string &name, string &passwd, MYSQL * /*conn*/)
+{
+    m_lookups++;
+    m_lock.lock();
+    unordered_map<string, string>::iterator it = m_index.find(name);
+    bool found = it != m_index.end();
+    if (found)
+        passwd = it->second;
+    m_lock.unlock();
+    return found;
+}
+
+int log_user_store::insert(const string &name, const string &passwd, MYSQL * /*conn*/)
+{
+    if (name.size() > UINT16_MAX || passwd.size() > UINT16_MAX)
+        return INSERT_FAILED;
+
+    m_lock.lock();
+    if (m_broken || !m_running)
+    {
+        m_lock.unlock();
+        return INSERT_FAILED;
+    }
+    if (!m_index.insert(pair<string, string>(name, passwd)).second)
+    {
+        m_lock.unlock();
+        return INSERT_EXISTS;
+    }
+    m_live_bytes += record_bytes(name, passwd);
+    encode(m_pending, name, passwd);
+    m_pending_names.push_back(name);
+    uint64_t seq = ++m_appended;
+    m_flush_cond.signal();
+
+    /* 等待所属批次落盘；等待期间到达的注册会并入下一批，由同一次fsync确认 */
+    while (m_durable < seq && !m_broken)
+        m_commit_cond.wait(m_lock.get());
+    bool ok = m_durable >= seq;
+    m_lock.unlock();
+
+    m_inserts++;
+    return ok ? INSERT_OK : INSERT_FAILED;
+}
+
+void *log_user_store::flush_worker(void *arg)
+{
+    ((log_user_store *)arg)->flush_loop();
+    return NULL;
+}
+
+void log_user_store::flush_loop()
+{
+    string batch;
+    vector<string> names;
+
+    m_lock.lock();
+    while (true)
+    {
+        while (m_pending.empty() && !m_stop)
+            m_flush_cond.wait(m_lock.get());
+        if (m_pending.empty())
+            break;
+
+        batch.clear();
+        names.clear();
+        batch.swap(m_pending);
+        names.swap(m_pending_names);
+        uint64_t target = m_appended;
+        m_lock.unlock();
+
+        uint64_t begin = now_ns();
+        bool ok = write_all(m_fd, batch.data(), batch.size()) && fdatasync(m_fd) == 0;
+        m_fsync_ns += now_ns() - begin;
+        m_fsyncs++;
+        if (names.size() > m_batch_max.load())
+            m_batch_max = names.size();
+
+        m_lock.lock();
+        if (ok)
+        {
+            m_durable = target;
+            m_file_bytes += batch.size();
+        }
+        else
+        {
+            /* fsync失败后页缓存的状态不可信，撤销这一批并拒绝之后的注册 */
+            LOG_ERROR("user store %s: commit failed, errno %d", m_path.c_str(), errno);
+            m_broken = true;
+            for (size_t i = 0; i < names.size(); ++i)
+            {
+                unordered_map<string, string>::iterator it = m_index.find(names[i]);
+                if (it != m_index.end())
+                {
+                    m_live_bytes -= record_bytes(it->first, it->second);
+                    m_index.erase(it);
+                }
+            }
+        }
+        m_commit_cond.broadcast();
+
+        if (ok && need_compact())
+            compact();
+    }
+    m_lock.unlock();
+}
+
+bool log_user_store::need_compact() const
+{
+    return m_file_bytes > COMPACT_MIN_BYTES && m_file_bytes > 2 * m_live_bytes;
+}
+
+void log_user_store::compact()
+{
+    /* 索引里可能有尚在待提交缓冲区中的记录，它们只能随所属批次落盘：
+       提前写进新文件的话，那一批提交失败时从索引中撤销了，文件里却还留着 */
+    unordered_set<string> pending(m_pending_names.begin(), m_pending_names.end());
+    string image(STORE_MAGIC, STORE_MAGIC_LEN);
+    image.reserve(m_live_bytes);
+    for (unordered_map<string, string>::iterator it = m_index.begin(); it != m_index.end(); ++it)
+        if (!pending.count(it->first))
+            encode(image, it->first, it->second);
+    uint64_t old_bytes = m_file_bytes;
+    m_lock.unlock();
+
+    /* 只有刷盘线程(或启动时的load)写文件，替换期间不会有并发的追加 */
+    string tmp = m_path + ".compact";
+    int fd = open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    bool ok = fd >= 0 && write_all(fd, image.data(), image.size()) && fdatasync(fd) == 0 &&
+              rename(tmp.c_str(), m_path.c_str()) == 0;
+    if (ok)
+        sync_dir(m_path);
+
+    m_lock.lock();
+    if (!ok)
+    {
+        LOG_ERROR("user store %s: compaction failed, errno %d", m_path.c_str(), errno);
+        if (fd >= 0)
+            close(fd);
+        unlink(tmp.c_str());
+        return;
+    }
+    close(m_fd);
+    m_fd = fd;
+    m_file_bytes = image.size();
+    m_compactions++;
+    LOG_INFO("user store %s compacted: %llu -> %llu bytes", m_path.c_str(), (unsigned long long)old_bytes,
+             (unsigned long long)m_file_bytes);
+}
+
+void log_user_store::shutdown()
+{
+    m_lock.lock();
+    if (!m_running)
+    {
+        m_lock.unlock();
+        return;
+    }
+    m_stop = true;
+    m_flush_cond.signal();
+    m_lock.unlock();
+
+    /* 刷盘线程先提交完剩余的记录再退出 */
+    pthread_join(m_flusher, NULL);
+    m_running = false;
+}
+
+void log_user_store::report()
+{
+    m_lock.lock();
+    size_t users = m_index.size();
+    uint64_t file_bytes = m_file_bytes, live_bytes = m_live_bytes;
+    m_lock.unlock();
+
+    uint64_t fsyncs = m_fsyncs.load();
+    LOG_INFO("user store log engine: users=%llu file=%llu bytes live=%llu bytes lookups=%llu inserts=%llu "
+             "group_commits=%llu avg_batch=%.2f max_batch=%llu avg_fsync_us=%llu compactions=%llu",
+             (unsigned long long)users, (unsigned long long)file_bytes, (unsigned long long)live_bytes,
+             (unsigned long long)m_lookups.load(), (unsigned long long)m_inserts.load(), (unsigned long long)fsyncs,
+             fsyncs ? (double)m_inserts.load() / fsyncs : 0.0, (unsigned long long)m_batch_max.load(),
+             (unsigned long long)(fsyncs ? m_fsync_ns.load() / fsyncs / 1000 : 0),
+             (unsigned long long)m_compactions.load());
+}
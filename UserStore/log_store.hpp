@@ -0,0 +1,94 @@
+#ifndef LOG_STORE_H
+#define LOG_STORE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include "../Lock/locker.hpp"
+#include "user_store.hpp"
+
+using namespace std;
+
+/**
+ * @brief 内置的用户存储引擎：追加写日志 + 内存哈希索引。
+ *        文件布局：8字节魔数 | 记录 | 记录 ...，记录为 校验和(4) | 用户名长度(2) | 密码长度(2) | 用户名 | 密码。
+ *        注册先写入内存中的待提交缓冲区，由单独的刷盘线程成批write + fdatasync，
+ *        一次fsync确认期间到达的所有注册(组提交)；注册在所属批次落盘后才返回。
+ *        日志中的重复记录超过一定比例时，刷盘线程把存活条目重写成新文件并原子替换(压缩)。
+ */
+class log_user_store : public user_store
+{
+public:
+    log_user_store();
+    ~log_user_store();
+
+    /**
+     * @param path 日志文件路径
+     */
+    void init(const string &path, int close_log);
+
+    /**
+     * @brief 重放日志重建索引，截掉尾部不完整的记录，然后启动刷盘线程
+     */
+    bool load();
+
+    bool find(const string &name, string &passwd, MYSQL *conn);
+    int insert(const string &name, const string &passwd, MYSQL *conn);
+
+    /**
+     * @brief 提交剩余的注册并停止刷盘线程
+     */
+    void shutdown();
+
+    void report();
+
+private:
+    static void *flush_worker(void *arg);
+    void flush_loop();
+
+    /* 读取整个日志重建索引，返回有效数据的长度，文件无法读取时返回-1 */
+    long replay();
+
+    /* 把存活条目写成新文件并替换旧日志，调用时持有m_lock，写文件期间会暂时释放 */
+    void compact();
+
+    /* 存活数据不足文件大小的一半时需要压缩 */
+    bool need_compact() const;
+
+    static void encode(string &buf, const string &name, const string &passwd);
+    static size_t record_bytes(const string &name, const string &passwd);
+
+    string m_path;
+    int m_close_log;
+    int m_fd;
+
+    /* 下面的成员由m_lock保护 */
+    locker m_lock;
+    cond m_flush_cond;  //有待提交的记录或需要停止时唤醒刷盘线程
+    cond m_commit_cond; //一个批次落盘后唤醒等待的注册线程
+    unordered_map<string, string> m_index;
+    string m_pending;              //待提交的记录
+    vector<string> m_pending_names; //待提交记录的用户名，写盘失败时从索引中撤销
+    uint64_t m_appended;           //已进入待提交缓冲区的记录序号
+    uint64_t m_durable;            //已落盘的记录序号
+    uint64_t m_file_bytes;         //日志文件大小
+    uint64_t m_live_bytes;         //索引中条目按记录格式计算的大小
+    bool m_broken;                 //写盘或fsync失败后不再接受注册
+    bool m_stop;
+    bool m_running;
+    pthread_t m_flusher;
+
+    /* 统计信息 */
+    atomic<uint64_t> m_lookups;
+    atomic<uint64_t> m_inserts;
+    atomic<uint64_t> m_fsyncs;      //组提交的次数
+    atomic<uint64_t> m_fsync_ns;    //fdatasync的总耗时
+    atomic<uint64_t> m_batch_max;   //单次组提交的最大记录数
+    atomic<uint64_t> m_compactions;
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef LRU_CACHE_H
+#define LRU_CACHE_H
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include "../Lock/locker.hpp"
+
+using namespace std;
+
+/**
+ * @brief 用户名到密码的LRU缓存，容量满时淘汰最久未使用的条目；所有操作都在互斥锁内完成
+ */
+class lru_cache
+{
+public:
+    lru_cache() : m_capacity(0) {}
+
+    void init(size_t capacity) { m_capacity = capacity; }
+
+    /**
+     * @brief 查找并把命中的条目移到链表头部
+     * @return 是否命中
+     */
+    bool get(const string &name, string &passwd)
+    {
+        m_lock.lock();
+        unordered_map<string, list<entry>::iterator>::iterator it = m_index.find(name);
+        if (it == m_index.end())
+        {
+            m_lock.unlock();
+            return false;
+        }
+        m_items.splice(m_items.begin(), m_items, it->second);
+        passwd = it->second->second;
+        m_lock.unlock();
+        return true;
+    }
+
+    void put(const string &name, const string &passwd)
+    {
+        if (0 == m_capacity)
+            return;
+        m_lock.lock();
+        unordered_map<string, list<entry>::iterator>::iterator it = m_index.find(name);
+        if (it != m_index.end())
+        {
+            it->second->second = passwd;
+            m_items.splice(m_items.begin(), m_items, it->second);
+        }
+        else
+        {
+            if (m_index.size() >= m_capacity)
+            {
+                m_index.erase(m_items.back().first);
+                m_items.pop_back();
+            }
+            m_items.push_front(entry(name, passwd));
+            m_index[name] = m_items.begin();
+        }
+        m_lock.unlock();
+    }
+
+    size_t size()
+    {
+        m_lock.lock();
+        size_t n = m_index.size();
+        m_lock.unlock();
+        return n;
+    }
+
+private:
+    typedef pair<string, string> entry;
+
+    size_t m_capacity;
+    list<entry> m_items; //按最近使用排序，头部最新
+    unordered_map<string, list<entry>::iterator> m_index;
+    locker m_lock;
+};
+
+#endif
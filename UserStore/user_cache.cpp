@@ -0,0 +1,330 @@
+#include <mysql/mysql.h>
+#include <stdlib.h>
+#include <time.h>
+#include "user_cache.hpp"
+
+/* LAZY模式下布隆过滤器的目标误判率 */
+#define BLOOM_FP_RATE 0.01
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* std::map中一个条目的估算大小：红黑树节点 + 两个string，超出短字符串优化的部分另算 */
+static uint64_t entry_bytes(const string &name, const string &passwd)
+{
+    uint64_t bytes = 32 + 2 * sizeof(string);
+    if (name.size() > 15)
+        bytes += name.size() + 1;
+    if (passwd.size() > 15)
+        bytes += passwd.size() + 1;
+    return bytes;
+}
+
+user_cache::user_cache()
+    : m_mode(FULL), m_close_log(0), m_shards(NULL), m_users_bytes(0), m_snapshot_ok(false), m_bloom_ok(false), m_lru_capacity(0),
+      m_lookups(0), m_lookup_ns(0), m_lookup_max_ns(0), m_bloom_rejects(0), m_lru_hits(0),
+      m_db_lookups(0), m_false_positives(0), m_db_errors(0)
+{
+}
+
+user_cache *user_cache::GetInstance()
+{
+    static user_cache cache;
+    return &cache;
+}
+
+void user_cache::init(int mode, int lru_capacity, const string &snapshot, int close_log)
+{
+    m_mode = (LAZY == mode) ? LAZY : FULL;
+    m_snapshot_path = snapshot;
+    m_lru_capacity = lru_capacity > 0 ? lru_capacity : 0;
+    m_close_log = close_log;
+    m_lru.init(m_lru_capacity);
+}
+
+void user_cache::count_row(int /*shard*/, MYSQL_ROW row, void *arg)
+{
+    ((atomic<uint64_t> *)arg)->fetch_add(row[0] ? strtoull(row[0], NULL, 10) : 0);
+}
+
+void user_cache::bloom_row(int /*shard*/, MYSQL_ROW row, void *arg)
+{
+    if (row[0])
+        ((bloom_filter *)arg)->add(row[0], strlen(row[0]));
+}
+
+void user_cache::id_row(int shard, MYSQL_ROW row, void *arg)
+{
+    user_cache *cache = (user_cache *)arg;
+    if (!row[0] || !row[1] || !row[2])
+        return;
+
+    /* 每个分片只由自己的扫描线程更新对应的水位线，不需要加锁 */
+    uint64_t id = strtoull(row[0], NULL, 10);
+    if (id > cache->m_watermarks[shard])
+        cache->m_watermarks[shard] = id;
+
+    string name(row[1]), passwd(row[2]);
+    cache->m_lock.lock();
+    map<string, string>::iterator it = cache->m_users.find(name);
+    if (it == cache->m_users.end())
+    {
+        cache->m_users_bytes += entry_bytes(name, passwd);
+        cache->m_users.insert(pair<string, string>(name, passwd));
+    }
+    else
+        it->second = passwd;
+    cache->m_lock.unlock();
+}
+
+bool user_cache::load_snapshot()
+{
+    int n = m_shards->size();
+    m_watermarks.assign(n, 0);
+
+    /* 快照的分片布局必须与当前配置一致，否则水位线没有意义，只能重建 */
+    if (m_snapshot.open(m_snapshot_path.c_str()) && m_snapshot.shards() == n)
+    {
+        vector<string> sqls(n);
+        char sql[128];
+        for (int i = 0; i < n; ++i)
+        {
+            m_watermarks[i] = m_snapshot.watermark(i);
+            snprintf(sql, sizeof(sql), "SELECT id,username,passwd FROM user WHERE id > %llu",
+                     (unsigned long long)m_watermarks[i]);
+            sqls[i] = sql;
+        }
+        if (!m_shards->scan(sqls, id_row, this))
+        {
+            LOG_ERROR("user snapshot %s: reading rows newer than the watermarks failed", m_snapshot_path.c_str());
+            return false;
+        }
+        LOG_INFO("user snapshot %s mapped: %u entries, %llu bytes, %llu newer rows",
+                 m_snapshot_path.c_str(), m_snapshot.count(), (unsigned long long)m_snapshot.bytes(),
+                 (unsigned long long)m_users.size());
+        return true;
+    }
+
+    /* 没有可用的快照：全量读取一次并立即生成快照，之后只保留映射，不再常驻整张表 */
+    m_snapshot.close();
+    if (!m_shards->scan("SELECT id,username,passwd FROM user", id_row, this))
+    {
+        LOG_ERROR("user snapshot %s: full scan of the user table failed", m_snapshot_path.c_str());
+        return false;
+    }
+    long written = user_snapshot::write(m_snapshot_path.c_str(), m_snapshot, m_users, m_watermarks);
+    if (written < 0 || !m_snapshot.open(m_snapshot_path.c_str()))
+    {
+        LOG_ERROR("write user snapshot %s failed", m_snapshot_path.c_str());
+        return true;
+    }
+    LOG_INFO("user snapshot %s created: %ld entries", m_snapshot_path.c_str(), written);
+    m_users.clear();
+    m_users_bytes = 0;
+    return true;
+}
+
+void user_cache::load(shard_map *shards)
+{
+    m_shards = shards;
+
+    if (FULL == m_mode && !m_snapshot_path.empty())
+    {
+        m_snapshot_ok = load_snapshot();
+        if (!m_snapshot_ok)
+        {
+            /* 具体原因(连接失败、user表没有id列等)已由分片扫描和上面的日志记录 */
+            LOG_WARN("user snapshot %s disabled, falling back to a full load", m_snapshot_path.c_str());
+            m_snapshot.close();
+            m_users.clear();
+            m_users_bytes = 0;
+        }
+    }
+
+    if (FULL == m_mode && !m_snapshot_ok)
+    {
+        m_shards->load_users(m_users, m_lock);
+        for (map<string, string>::iterator it = m_users.begin(); it != m_users.end(); ++it)
+            m_users_bytes += entry_bytes(it->first, it->second);
+    }
+    else if (LAZY == m_mode)
+    {
+        /* 先统计总行数来确定位数组大小，再流式扫描用户名，全程不在客户端缓存结果集 */
+        atomic<uint64_t> rows(0);
+        m_bloom_ok = m_shards->scan("SELECT COUNT(*) FROM user", count_row, &rows);
+        m_bloom.init(rows.load(), BLOOM_FP_RATE);
+        if (m_bloom_ok)
+            m_bloom_ok = m_shards->scan("SELECT username FROM user", bloom_row, &m_bloom);
+
+        /* 不完整的过滤器会把已有用户判为不存在，导致拒绝登录和重复注册，只能停用 */
+        if (!m_bloom_ok)
+            LOG_ERROR("user cache lazy mode: scanning usernames failed, bloom filter disabled, "
+                      "every lookup missing the LRU goes to MySQL");
+        else
+            LOG_INFO("user cache lazy mode: %llu usernames, bloom %llu bytes, %d hashes",
+                     (unsigned long long)rows.load(), (unsigned long long)m_bloom.bytes(), m_bloom.hashes());
+    }
+
+    m_shards->report();
+    report();
+}
+
+int user_cache::fetch(const string &name, string &passwd, MYSQL *conn)
+{
+    /* 注册时用户名不会超过100个字符，更长的用户名无法查询，按出错处理 */
+    if (name.size() > 100)
+        return LOOKUP_ERROR;
+
+    int idx = m_shards->shard_of(name);
+    MYSQL *sql = conn;
+    connectionRAII shardcon(&sql, 0 == idx && conn ? NULL : m_shards->GetPool(idx));
+    if (!sql)
+        return LOOKUP_ERROR;
+
+    char escaped[2 * 100 + 1];
+    mysql_real_escape_string(sql, escaped, name.c_str(), name.size());
+
+    char query[300];
+    snprintf(query, sizeof(query), "SELECT passwd FROM user WHERE username='%s' LIMIT 1", escaped);
+
+    m_db_lookups++;
+    m_shards->metrics(idx).reads++;
+    if (mysql_query(sql, query))
+    {
+        LOG_ERROR("SELECT error:%s", mysql_error(sql));
+        return LOOKUP_ERROR;
+    }
+
+    MYSQL_RES *result = mysql_store_result(sql);
+    if (!result)
+    {
+        LOG_ERROR("SELECT error:%s", mysql_error(sql));
+        return LOOKUP_ERROR;
+    }
+    MYSQL_ROW row = mysql_fetch_row(result);
+    bool found = row && row[0];
+    if (found)
+        passwd = row[0];
+    mysql_free_result(result);
+    return found ? LOOKUP_FOUND : LOOKUP_ABSENT;
+}
+
+int user_cache::find(const string &name, string &passwd, MYSQL *conn)
+{
+    uint64_t begin = now_ns();
+    int res;
+
+    if (FULL == m_mode)
+    {
+        m_shards->metrics(m_shards->shard_of(name)).reads++;
+        m_lock.lock();
+        map<string, string>::iterator it = m_users.find(name);
+        bool found = it != m_users.end();
+        if (found)
+            passwd = it->second;
+        m_lock.unlock();
+
+        /* 快照是只读映射，查询无需加锁 */
+        if (!found)
+            found = m_snapshot.find(name, passwd);
+        res = found ? LOOKUP_FOUND : LOOKUP_ABSENT;
+    }
+    else if (m_bloom_ok && !m_bloom.may_contain(name.data(), name.size()))
+    {
+        /* 布隆过滤器没有误漏，判定不存在就一定不存在 */
+        m_bloom_rejects++;
+        res = LOOKUP_ABSENT;
+    }
+    else if (m_lru.get(name, passwd))
+    {
+        m_lru_hits++;
+        res = LOOKUP_FOUND;
+    }
+    else
+    {
+        res = fetch(name, passwd, conn);
+        if (LOOKUP_FOUND == res)
+            m_lru.put(name, passwd);
+        else if (LOOKUP_ABSENT == res && m_bloom_ok)
+            m_false_positives++;
+        else
+            m_db_errors++;
+    }
+
+    uint64_t cost = now_ns() - begin;
+    m_lookups++;
+    m_lookup_ns += cost;
+    uint64_t max = m_lookup_max_ns.load();
+    while (cost > max && !m_lookup_max_ns.compare_exchange_weak(max, cost))
+        ;
+    return res;
+}
+
+void user_cache::add(const string &name, const string &passwd)
+{
+    if (FULL == m_mode)
+    {
+        m_lock.lock();
+        if (m_users.insert(pair<string, string>(name, passwd)).second)
+            m_users_bytes += entry_bytes(name, passwd);
+        m_lock.unlock();
+    }
+    else
+    {
+        m_bloom.add(name.data(), name.size());
+        m_lru.put(name, passwd);
+    }
+}
+
+void user_cache::save_snapshot()
+{
+    if (!m_snapshot_ok)
+        return;
+
+    m_lock.lock();
+    map<string, string> delta(m_users);
+    m_lock.unlock();
+
+    /* 新注册的行id未知，水位线保持为已从MySQL读到的最大id，下次启动会把它们作为增量再读一次 */
+    long written = user_snapshot::write(m_snapshot_path.c_str(), m_snapshot, delta, m_watermarks);
+    if (written < 0)
+        LOG_ERROR("write user snapshot %s failed", m_snapshot_path.c_str());
+    else
+        LOG_INFO("user snapshot %s saved: %ld entries", m_snapshot_path.c_str(), written);
+}
+
+void user_cache::report()
+{
+    uint64_t lookups = m_lookups.load();
+    uint64_t avg_ns = lookups ? m_lookup_ns.load() / lookups : 0;
+
+    if (FULL == m_mode)
+    {
+        m_lock.lock();
+        size_t entries = m_users.size();
+        uint64_t bytes = m_users_bytes;
+        m_lock.unlock();
+        LOG_INFO("user cache full mode: entries=%llu memory~%llu bytes snapshot=%u entries/%llu bytes mapped "
+                 "lookups=%llu avg_ns=%llu max_ns=%llu",
+                 (unsigned long long)entries, (unsigned long long)bytes, m_snapshot.count(),
+                 (unsigned long long)m_snapshot.bytes(), (unsigned long long)lookups,
+                 (unsigned long long)avg_ns, (unsigned long long)m_lookup_max_ns.load());
+    }
+    else
+    {
+        size_t entries = m_lru.size();
+        /* LRU每个条目：链表节点 + 哈希表节点，各含一个string */
+        uint64_t bytes = m_bloom.bytes() + entries * (4 * sizeof(string) + 64);
+        LOG_INFO("user cache lazy mode: lru=%llu/%llu memory~%llu bytes lookups=%llu avg_ns=%llu max_ns=%llu "
+                 "bloom_rejects=%llu lru_hits=%llu db_lookups=%llu false_positives=%llu db_errors=%llu",
+                 (unsigned long long)entries, (unsigned long long)m_lru_capacity, (unsigned long long)bytes,
+                 (unsigned long long)lookups, (unsigned long long)avg_ns, (unsigned long long)m_lookup_max_ns.load(),
+                 (unsigned long long)m_bloom_rejects.load(), (unsigned long long)m_lru_hits.load(),
+                 (unsigned long long)m_db_lookups.load(), (unsigned long long)m_false_positives.load(),
+                 (unsigned long long)m_db_errors.load());
+    }
+}
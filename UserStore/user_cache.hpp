@@ -0,0 +1,125 @@
+#ifndef USER_CACHE_H
+#define USER_CACHE_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <atomic>
+#include "../ConnPool/shard_map.hpp"
+#include "../Lock/locker.hpp"
+#include "../Log/log.hpp"
+#include "bloom_filter.hpp"
+#include "lru_cache.hpp"
+#include "user_snapshot.hpp"
+
+using namespace std;
+
+/**
+ * @brief 登录、注册使用的用户凭据缓存，有两种模式：
+ *        FULL：启动时把所有分片的user表全部读入内存(原有行为)；
+ *        LAZY：启动时只用用户名构建布隆过滤器，凭据按需单行回源并放入LRU。
+ *              布隆过滤器判定不存在的用户名直接在内存中给出答案，不访问数据库。
+ *        FULL模式可以配合快照文件使用：启动时mmap快照，只从MySQL补读id大于水位线的行，
+ *        这要求user表带有自增的id列。
+ */
+class user_cache
+{
+public:
+    enum MODE
+    {
+        FULL = 0,
+        LAZY
+    };
+
+    /* find的返回值：回源出错时与用户不存在区分开，调用方应让请求失败而不是当作不存在 */
+    enum LOOKUP_RESULT
+    {
+        LOOKUP_FOUND = 0,
+        LOOKUP_ABSENT,
+        LOOKUP_ERROR
+    };
+
+    //单例模式
+    static user_cache *GetInstance();
+
+    /**
+     * @param mode 缓存模式
+     * @param lru_capacity LAZY模式下LRU的容量
+     * @param snapshot FULL模式下的快照文件路径，为空表示不使用快照
+     */
+    void init(int mode, int lru_capacity, const string &snapshot, int close_log);
+
+    /**
+     * @brief 启动时按模式加载：FULL读入全部凭据，LAZY只构建布隆过滤器
+     */
+    void load(shard_map *shards);
+
+    /**
+     * @brief 查询用户名对应的密码
+     * @param conn 调用方已经持有的第0个分片的连接，回源到该分片时直接复用，避免同一线程从同一个池取两条连接
+     * @return LOOKUP_RESULT
+     */
+    int find(const string &name, string &passwd, MYSQL *conn);
+
+    /**
+     * @brief 注册成功后加入缓存
+     */
+    void add(const string &name, const string &passwd);
+
+    /**
+     * @brief 把快照与之后的增量合并写成新快照，在服务器退出时调用
+     */
+    void save_snapshot();
+
+    /**
+     * @brief 将内存占用和查询延迟写入日志
+     */
+    void report();
+
+private:
+    user_cache();
+    ~user_cache() {}
+
+    /* 从所属分片单行读取密码，返回LOOKUP_RESULT */
+    int fetch(const string &name, string &passwd, MYSQL *conn);
+
+    /* FULL模式下基于快照加载，失败(例如user表没有id列)时返回false */
+    bool load_snapshot();
+
+    static void count_row(int shard, MYSQL_ROW row, void *arg);
+    static void bloom_row(int shard, MYSQL_ROW row, void *arg);
+    static void id_row(int shard, MYSQL_ROW row, void *arg);
+
+    int m_mode;
+    int m_close_log;
+    shard_map *m_shards;
+
+    /* FULL模式：全部凭据；使用快照时只存放快照之后的增量 */
+    map<string, string> m_users;
+    uint64_t m_users_bytes; //m_users的估算内存占用
+    locker m_lock;
+
+    /* FULL模式的快照 */
+    string m_snapshot_path;
+    user_snapshot m_snapshot;
+    vector<uint64_t> m_watermarks; //每个分片已加载的最大id
+    bool m_snapshot_ok;            //快照机制是否可用
+
+    /* LAZY模式：用户名布隆过滤器 + 最近使用凭据的LRU */
+    bloom_filter m_bloom;
+    bool m_bloom_ok; //启动时扫描出错则为false，布隆过滤器不完整，所有查询都要回源
+    lru_cache m_lru;
+    size_t m_lru_capacity;
+
+    /* 统计信息 */
+    atomic<uint64_t> m_lookups;         //查询次数
+    atomic<uint64_t> m_lookup_ns;       //查询总耗时(纳秒)
+    atomic<uint64_t> m_lookup_max_ns;   //单次查询最大耗时(纳秒)
+    atomic<uint64_t> m_bloom_rejects;   //被布隆过滤器直接拒绝的次数
+    atomic<uint64_t> m_lru_hits;        //LRU命中次数
+    atomic<uint64_t> m_db_lookups;      //单行回源次数
+    atomic<uint64_t> m_false_positives; //布隆过滤器误判(回源后不存在)的次数
+    atomic<uint64_t> m_db_errors;       //回源失败的次数
+};
+
+#endif
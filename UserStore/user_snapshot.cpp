@@ -0,0 +1,264 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "user_snapshot.hpp"
+
+#define SNAPSHOT_MAGIC "USRSNAP1"
+#define SNAPSHOT_VERSION 1
+
+struct user_snapshot::header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t count;       //条目数
+    uint32_t shard_count; //生成快照时的分片数
+    uint32_t index_cap;   //哈希索引的槽数，2的幂
+    uint64_t table_off;   //条目表的偏移
+    uint64_t index_off;   //哈希索引的偏移
+    uint64_t arena_off;   //字符串区的偏移
+    uint64_t arena_len;   //字符串区的长度
+    uint64_t watermarks[MAX_SHARDS];
+};
+
+/* 条目表中的一项，指向字符串区中的用户名和密码 */
+struct user_snapshot::entry
+{
+    uint32_t name_off;
+    uint32_t name_len;
+    uint32_t passwd_off;
+    uint32_t passwd_len;
+};
+
+static uint64_t name_hash(const char *data, size_t len)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < len; ++i)
+    {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+/* 与std::string的比较规则一致：按字节无符号比较，前缀较短者在前 */
+static int compare(const char *a, size_t alen, const char *b, size_t blen)
+{
+    int r = memcmp(a, b, alen < blen ? alen : blen);
+    if (r)
+        return r;
+    return alen < blen ? -1 : (alen > blen ? 1 : 0);
+}
+
+user_snapshot::user_snapshot() : m_base(NULL), m_size(0)
+{
+}
+
+user_snapshot::~user_snapshot()
+{
+    close();
+}
+
+const user_snapshot::entry *user_snapshot::entries() const
+{
+    return (const entry *)(m_base + hdr()->table_off);
+}
+
+const uint32_t *user_snapshot::index() const
+{
+    return (const uint32_t *)(m_base + hdr()->index_off);
+}
+
+const char *user_snapshot::arena() const
+{
+    return m_base + hdr()->arena_off;
+}
+
+uint32_t user_snapshot::count() const
+{
+    return m_base ? hdr()->count : 0;
+}
+
+int user_snapshot::shards() const
+{
+    return m_base ? (int)hdr()->shard_count : 0;
+}
+
+uint64_t user_snapshot::watermark(int shard) const
+{
+    return (m_base && shard < MAX_SHARDS) ? hdr()->watermarks[shard] : 0;
+}
+
+bool user_snapshot::open(const char *path)
+{
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(header))
+    {
+        ::close(fd);
+        return false;
+    }
+    /* 映射之后只按需缺页，启动耗时与快照大小无关 */
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+    m_base = (char *)addr;
+    m_size = st.st_size;
+
+    const header *h = hdr();
+    bool ok = memcmp(h->magic, SNAPSHOT_MAGIC, 8) == 0 && h->version == SNAPSHOT_VERSION &&
+              h->shard_count <= MAX_SHARDS && h->index_cap > 0 && (h->index_cap & (h->index_cap - 1)) == 0 &&
+              h->table_off + (uint64_t)h->count * sizeof(entry) <= m_size &&
+              h->index_off + (uint64_t)h->index_cap * sizeof(uint32_t) <= m_size &&
+              h->arena_off + h->arena_len <= m_size;
+    if (!ok)
+    {
+        close();
+        return false;
+    }
+    madvise(m_base, m_size, MADV_RANDOM);
+    return true;
+}
+
+void user_snapshot::close()
+{
+    if (m_base)
+    {
+        munmap(m_base, m_size);
+        m_base = NULL;
+        m_size = 0;
+    }
+}
+
+bool user_snapshot::find(const string &name, string &passwd) const
+{
+    if (!m_base || 0 == hdr()->count)
+        return false;
+
+    const header *h = hdr();
+    const entry *table = entries();
+    const uint32_t *slots = index();
+    const char *strs = arena();
+    uint32_t mask = h->index_cap - 1;
+
+    /* 线性探测，槽中存放条目下标+1，0表示空槽 */
+    for (uint32_t i = name_hash(name.data(), name.size()) & mask, n = 0; n < h->index_cap; i = (i + 1) & mask, ++n)
+    {
+        uint32_t slot = slots[i];
+        if (0 == slot || slot > h->count)
+            return false;
+        const entry &e = table[slot - 1];
+        if ((uint64_t)e.name_off + e.name_len > h->arena_len || (uint64_t)e.passwd_off + e.passwd_len > h->arena_len)
+            return false;
+        if (e.name_len == name.size() && memcmp(strs + e.name_off, name.data(), e.name_len) == 0)
+        {
+            passwd.assign(strs + e.passwd_off, e.passwd_len);
+            return true;
+        }
+    }
+    return false;
+}
+
+long user_snapshot::write(const char *path, const user_snapshot &base, const map<string, string> &delta,
+                          const vector<uint64_t> &watermarks)
+{
+    vector<entry> table;
+    string strs;
+    table.reserve(base.count() + delta.size());
+
+    /* 旧快照和增量都按用户名有序，归并一遍即可得到新的有序条目表 */
+    const entry *old = base.mapped() ? base.entries() : NULL;
+    const char *old_strs = base.mapped() ? base.arena() : NULL;
+    uint32_t i = 0, n = base.count();
+    map<string, string>::const_iterator it = delta.begin();
+    while (i < n || it != delta.end())
+    {
+        entry e;
+        int cmp;
+        if (i >= n)
+            cmp = 1;
+        else if (it == delta.end())
+            cmp = -1;
+        else
+            cmp = compare(old_strs + old[i].name_off, old[i].name_len, it->first.data(), it->first.size());
+
+        e.name_off = strs.size();
+        if (cmp < 0)
+        {
+            e.name_len = old[i].name_len;
+            strs.append(old_strs + old[i].name_off, old[i].name_len);
+            e.passwd_off = strs.size();
+            e.passwd_len = old[i].passwd_len;
+            strs.append(old_strs + old[i].passwd_off, old[i].passwd_len);
+            ++i;
+        }
+        else
+        {
+            e.name_len = it->first.size();
+            strs.append(it->first);
+            e.passwd_off = strs.size();
+            e.passwd_len = it->second.size();
+            strs.append(it->second);
+            if (0 == cmp)
+                ++i;
+            ++it;
+        }
+        table.push_back(e);
+    }
+    if (strs.size() > UINT32_MAX)
+        return -1;
+
+    /* 负载因子不超过0.5 */
+    uint32_t cap = 16;
+    while (cap < table.size() * 2)
+        cap <<= 1;
+    vector<uint32_t> slots(cap, 0);
+    for (uint32_t k = 0; k < table.size(); ++k)
+    {
+        uint32_t pos = name_hash(strs.data() + table[k].name_off, table[k].name_len) & (cap - 1);
+        while (slots[pos])
+            pos = (pos + 1) & (cap - 1);
+        slots[pos] = k + 1;
+    }
+
+    header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAPSHOT_MAGIC, 8);
+    h.version = SNAPSHOT_VERSION;
+    h.count = table.size();
+    h.shard_count = watermarks.size() < (size_t)MAX_SHARDS ? watermarks.size() : MAX_SHARDS;
+    h.index_cap = cap;
+    h.table_off = sizeof(header);
+    h.index_off = h.table_off + table.size() * sizeof(entry);
+    h.arena_off = h.index_off + cap * sizeof(uint32_t);
+    h.arena_len = strs.size();
+    for (uint32_t k = 0; k < h.shard_count; ++k)
+        h.watermarks[k] = watermarks[k];
+
+    string tmp = string(path) + ".tmp";
+    FILE *fp = fopen(tmp.c_str(), "w");
+    if (!fp)
+        return -1;
+    bool ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+    if (ok && !table.empty())
+        ok = fwrite(&table[0], sizeof(entry), table.size(), fp) == table.size();
+    if (ok)
+        ok = fwrite(&slots[0], sizeof(uint32_t), cap, fp) == cap;
+    if (ok && !strs.empty())
+        ok = fwrite(strs.data(), 1, strs.size(), fp) == strs.size();
+    ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    fclose(fp);
+    if (!ok || rename(tmp.c_str(), path) != 0)
+    {
+        unlink(tmp.c_str());
+        return -1;
+    }
+    return (long)table.size();
+}
@@ -0,0 +1,69 @@
+#ifndef USER_SNAPSHOT_H
+#define USER_SNAPSHOT_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief 只读的凭据快照文件，可以直接mmap使用，重启时不必重新读取整张user表。
+ *        文件布局：header | 条目表(按用户名升序) | 哈希索引(开放寻址) | 字符串区
+ *        header中记录每个分片已包含的最大id(水位线)，启动时只需向MySQL补读水位线之后的行。
+ */
+class user_snapshot
+{
+public:
+    static const int MAX_SHARDS = 64;
+
+    user_snapshot();
+    ~user_snapshot();
+
+    /**
+     * @brief 映射并校验快照文件
+     * @return 文件存在且格式合法
+     */
+    bool open(const char *path);
+    void close();
+
+    bool mapped() const { return m_base != NULL; }
+    uint32_t count() const;
+    int shards() const;
+    uint64_t watermark(int shard) const;
+    size_t bytes() const { return m_size; }
+
+    /**
+     * @brief 通过哈希索引查找，只会访问少数几个页面
+     */
+    bool find(const string &name, string &passwd) const;
+
+    /**
+     * @brief 把基础快照与增量合并后写成新的快照：先写临时文件、fsync，再rename覆盖，保证文件总是完整的
+     * @param base 旧快照，可以为空(未映射)
+     * @param delta 增量凭据，与旧快照同名时以增量为准
+     * @param watermarks 每个分片的水位线
+     * @return 写入的条目数，失败返回-1
+     */
+    static long write(const char *path, const user_snapshot &base, const map<string, string> &delta,
+                      const vector<uint64_t> &watermarks);
+
+private:
+    struct header;
+    struct entry;
+
+    const header *hdr() const { return (const header *)m_base; }
+    const entry *entries() const;
+    const uint32_t *index() const;
+    const char *arena() const;
+
+    /* 下面两个函数，禁止对象拷贝、赋值 */
+    user_snapshot(const user_snapshot &);
+    user_snapshot &operator=(const user_snapshot &);
+
+    char *m_base;  //映射的起始地址
+    size_t m_size; //文件大小
+};
+
+#endif
@@ -0,0 +1,96 @@
+#include <mysql/mysql.h>
+#include "user_store.hpp"
+#include "log_store.hpp"
+#include "../Log/log.hpp"
+
+user_store *user_store::m_instance = NULL;
+
+user_store *user_store::create(int backend, const string &path, int close_log)
+{
+    if (LOG_STORE == backend)
+    {
+        log_user_store *store = new log_user_store;
+        store->init(path, close_log);
+        m_instance = store;
+    }
+    else
+        m_instance = new mysql_user_store;
+    return m_instance;
+}
+
+/**
+ * @brief 按user_cache的模式加载用户表：全量模式把所有凭据读入内存，懒加载模式只构建用户名布隆过滤器
+ */
+bool mysql_user_store::load()
+{
+    user_cache::GetInstance()->load(shard_map::GetInstance());
+    return true;
+}
+
+bool mysql_user_store::find(const string &name, string &passwd, MYSQL *conn)
+{
+    return user_cache::LOOKUP_FOUND == user_cache::GetInstance()->find(name, passwd, conn);
+}
+
+int mysql_user_store::insert(const string &name, const string &passwd, MYSQL *conn)
+{
+    if (name.size() > 100 || passwd.size() > 100)
+        return INSERT_FAILED;
+
+    /* 查重和写入在同一把锁内，同名的并发注册只有一个能写入 */
+    user_cache *cache = user_cache::GetInstance();
+    locker &lock = m_locks[hash<string>()(name) % INSERT_LOCKS];
+    lock.lock();
+    string stored;
+    int found = cache->find(name, stored, conn);
+    if (found != user_cache::LOOKUP_ABSENT)
+    {
+        /* 回源出错时无法确认用户名是否已被占用，注册失败而不是冒险写入 */
+        lock.unlock();
+        return user_cache::LOOKUP_FOUND == found ? INSERT_EXISTS : INSERT_FAILED;
+    }
+
+    /* 按用户名路由到所属分片；第0个分片就是工作线程已经持有连接的默认连接池 */
+    shard_map *shards = shard_map::GetInstance();
+    int idx = shards->shard_of(name);
+    int res = 1;
+    {
+        MYSQL *shard_sql = conn;
+        connectionRAII shardcon(&shard_sql, 0 == idx ? NULL : shards->GetPool(idx));
+        if (shard_sql)
+        {
+            char escaped_name[2 * 100 + 1], escaped_passwd[2 * 100 + 1];
+            mysql_real_escape_string(shard_sql, escaped_name, name.c_str(), name.size());
+            mysql_real_escape_string(shard_sql, escaped_passwd, passwd.c_str(), passwd.size());
+
+            char sql_insert[512];
+            snprintf(sql_insert, sizeof(sql_insert), "INSERT INTO user(username, passwd) VALUES('%s', '%s')",
+                     escaped_name, escaped_passwd);
+            res = mysql_query(shard_sql, sql_insert);
+            if (!res)
+                cache->add(name, passwd);
+        }
+    }
+    lock.unlock();
+
+    shards->metrics(idx).writes++;
+    if (res)
+        shards->metrics(idx).write_errors++;
+    return res ? INSERT_FAILED : INSERT_OK;
+}
+
+/**
+ * @brief 退出前把凭据快照与运行期间的增量合并，缩短下次冷启动需要补读的范围
+ */
+void mysql_user_store::shutdown()
+{
+    user_cache::GetInstance()->save_snapshot();
+}
+
+void mysql_user_store::report()
+{
+    shard_map *shards = shard_map::GetInstance();
+    if (shards->size() > 1)
+        shards->report();
+    user_cache::GetInstance()->report();
+}
@@ -0,0 +1,101 @@
+#ifndef USER_STORE_H
+#define USER_STORE_H
+
+#include <string>
+#include "../ConnPool/sql_connection_pool.hpp"
+#include "../ConnPool/shard_map.hpp"
+#include "../Lock/locker.hpp"
+#include "user_cache.hpp"
+
+using namespace std;
+
+/**
+ * @brief 登录、注册使用的用户存储接口。后端有两种：
+ *        MYSQL_STORE：分片的MySQL连接池，凭据由user_cache缓存(原有实现)；
+ *        LOG_STORE：内置的追加日志 + 内存哈希索引，不依赖MySQL。
+ */
+class user_store
+{
+public:
+    enum BACKEND
+    {
+        MYSQL_STORE = 0,
+        LOG_STORE
+    };
+
+    /* insert的返回值 */
+    enum INSERT_RESULT
+    {
+        INSERT_OK = 0,
+        INSERT_EXISTS,
+        INSERT_FAILED
+    };
+
+    virtual ~user_store() {}
+
+    /**
+     * @brief 按配置创建后端并设为全局实例
+     * @param path LOG_STORE使用的日志文件路径
+     */
+    static user_store *create(int backend, const string &path, int close_log);
+
+    static user_store *GetInstance() { return m_instance; }
+
+    /**
+     * @brief 启动时加载已有用户
+     */
+    virtual bool load() = 0;
+
+    /**
+     * @brief 查询用户名对应的密码
+     * @param conn 工作线程已经持有的数据库连接，MySQL后端可以复用；其他后端忽略
+     */
+    virtual bool find(const string &name, string &passwd, MYSQL *conn) = 0;
+
+    /**
+     * @brief 注册：用户名不存在时写入
+     */
+    virtual int insert(const string &name, const string &passwd, MYSQL *conn) = 0;
+
+    /**
+     * @brief 服务器退出前调用，持久化尚未落盘的状态
+     */
+    virtual void shutdown() {}
+
+    /**
+     * @brief 将统计信息写入日志
+     */
+    virtual void report() = 0;
+
+    /**
+     * @brief 是否需要MySQL连接池
+     */
+    virtual bool need_sql() const { return false; }
+
+private:
+    static user_store *m_instance;
+};
+
+/**
+ * @brief MySQL后端：读经过user_cache，写按用户名路由到所属分片
+ */
+class mysql_user_store : public user_store
+{
+public:
+    bool load();
+    bool find(const string &name, string &passwd, MYSQL *conn);
+    int insert(const string &name, const string &passwd, MYSQL *conn);
+    void shutdown();
+    void report();
+    bool need_sql() const { return true; }
+
+private:
+    /* 同名的注册落在同一把锁上，查重和写入在锁内完成，不同用户名的注册可以并发 */
+    enum
+    {
+        INSERT_LOCKS = 64
+    };
+    locker m_locks[INSERT_LOCKS];
+};
+
+#endif
@@ -0,0 +1,117 @@
+/*
+ * 用户存储后端的注册/登录吞吐测试
+ *   ./userstoreTest log [threads] [users] [path]
+ *   ./userstoreTest mysql [threads] [users] [host:port,...] [user] [passwd] [db]
+ * 每个线程先注册users个不重名的用户，再逐个登录，分别统计吞吐。
+ * MySQL后端会向user表写入以bench_开头的用户，测试结束后需要手动清理。
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "user_store.hpp"
+#include "log_store.hpp"
+
+struct bench_arg
+{
+    int id;
+    int users;
+    bool login;
+    std::atomic<long> *failed;
+};
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *bench_worker(void *p)
+{
+    bench_arg *arg = (bench_arg *)p;
+    user_store *store = user_store::GetInstance();
+    connection_pool *pool = store->need_sql() ? shard_map::GetInstance()->GetPool(0) : NULL;
+    MYSQL *mysql = NULL;
+    connectionRAII mysqlcon(&mysql, pool);
+
+    char name[64];
+    std::string stored;
+    for (int i = 0; i < arg->users; ++i)
+    {
+        snprintf(name, sizeof(name), "bench_%d_%d_%d", (int)getpid(), arg->id, i);
+        bool ok = arg->login ? store->find(name, stored, mysql) && stored == "123456"
+                             : store->insert(name, "123456", mysql) == user_store::INSERT_OK;
+        if (!ok)
+            (*arg->failed)++;
+    }
+    return NULL;
+}
+
+static void run(const char *phase, int threads, int users)
+{
+    std::vector<pthread_t> tids(threads);
+    std::vector<bench_arg> args(threads);
+    std::atomic<long> failed(0);
+
+    double begin = now_sec();
+    for (int i = 0; i < threads; ++i)
+    {
+        args[i].id = i;
+        args[i].users = users;
+        args[i].login = phase[0] == 'l';
+        args[i].failed = &failed;
+        pthread_create(&tids[i], NULL, bench_worker, &args[i]);
+    }
+    for (int i = 0; i < threads; ++i)
+        pthread_join(tids[i], NULL);
+    double cost = now_sec() - begin;
+
+    long total = (long)threads * users;
+    printf("%-8s threads=%-3d ops=%-8ld failed=%-6ld %.3f s  %.0f ops/s\n", phase, threads, total,
+           failed.load(), cost, total / cost);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("usage: %s log|mysql [threads] [users] ...\n", argv[0]);
+        return 1;
+    }
+    std::string backend = argv[1];
+    int threads = argc > 2 ? atoi(argv[2]) : 8;
+    int users = argc > 3 ? atoi(argv[3]) : 1000;
+
+    if (backend == "log")
+    {
+        std::string path = argc > 4 ? argv[4] : "./userstore_bench.log";
+        unlink(path.c_str());
+        user_store::create(user_store::LOG_STORE, path, 1);
+    }
+    else
+    {
+        std::vector<shard_addr> addrs;
+        shard_map::parse(argc > 4 ? argv[4] : "localhost:3306", addrs);
+        shard_map::GetInstance()->init(addrs, argc > 5 ? argv[5] : "root", argc > 6 ? argv[6] : "123456",
+                                       argc > 7 ? argv[7] : "mydb", threads, 1);
+        user_cache::GetInstance()->init(user_cache::FULL, 0, "", 1);
+        user_store::create(user_store::MYSQL_STORE, "", 1);
+    }
+
+    user_store *store = user_store::GetInstance();
+    if (!store->load())
+    {
+        printf("load %s store failed\n", backend.c_str());
+        return 1;
+    }
+
+    run("register", threads, users);
+    run("login", threads, users);
+    store->shutdown();
+    return 0;
+}
@@ -22,9 +22,70 @@ Config::Config(){
     //数据库连接池数量,默认8
     sql_num = 8;
 
+    //用户表分片,默认只有本机一个实例
+    sql_shards = "localhost:3306";
+
+    //用户凭据缓存,默认全量加载
+    user_cache_mode = 0;
+
+    //懒加载模式下LRU容量,默认10万条
+    user_cache_size = 100000;
+
+    //凭据快照,默认不使用
+    user_snapshot = "";
+
+    //用户存储后端,默认MySQL
+    user_store_backend = 0;
+
+    //内置存储引擎的日志文件
+    user_store_path = "./userstore.log";
+
     //线程池内的线程数量,默认8
     thread_num = 8;
 
+    //线程池线程数上限,默认不扩缩容
+    max_threads = 0;
+
+    //线程池任务分派,默认共享队列
+    sched_mode = 0;
+
+    //舱壁隔离,默认所有类别共用线程池
+    bulkheads = "";
+
+    //排队截止时间,默认只以连接定时器为限
+    queue_deadline = 0;
+
+    //截止时间优先,默认不启用
+    edf_backlog = 0;
+
+    //准入控制,默认只在队列已满或描述符耗尽时拒绝
+    shed_mode = 0;
+    shed_wait = 100;
+
+    //各阶段超时,默认请求头5秒、请求体10秒、keep-alive空闲15秒、发送停滞5秒
+    timeouts = "5000,10000,15000,5000";
+
+    //日志文件,默认所有线程合并
+    log_split = 0;
+
+    //日志格式,默认文本
+    log_binary = 0;
+
+    //访问日志,默认关闭
+    access_log = 0;
+
+    //日志缓冲区内存预算,默认64MB
+    log_mem = 64;
+
+    //日志缓冲区用尽时,默认丢弃新的日志
+    log_overflow = 0;
+    log_overflow_arg = 0;
+
+    //绑核,默认都不绑定
+    loop_cpus = "";
+    worker_cpus = "";
+    log_cpus = "";
+
     //关闭日志,默认不关闭
     close_log = 0;
 
@@ -34,7 +95,7 @@ Config::Config(){
 
 void Config::parse_arg(int argc, char*argv[]){
     int opt;
-    const char *str = "p:l:m:o:s:t:c:a:";
+    const char *str = "p:l:m:o:s:t:c:a:S:u:C:N:b:F:w:T:E:W:G:K:D:e:A:Q:H:L:B:R:M:O:P:";
     while ((opt = getopt(argc, argv, str)) != -1)
     {
         switch (opt)
@@ -79,6 +140,121 @@ void Config::parse_arg(int argc, char*argv[]){
             actor_model = atoi(optarg);
             break;
         }
+        case 'S':
+        {
+            sql_shards = optarg;
+            break;
+        }
+        case 'u':
+        {
+            user_cache_mode = atoi(optarg);
+            break;
+        }
+        case 'C':
+        {
+            user_cache_size = atoi(optarg);
+            break;
+        }
+        case 'N':
+        {
+            user_snapshot = optarg;
+            break;
+        }
+        case 'b':
+        {
+            user_store_backend = atoi(optarg);
+            break;
+        }
+        case 'F':
+        {
+            user_store_path = optarg;
+            break;
+        }
+        case 'w':
+        {
+            sched_mode = atoi(optarg);
+            break;
+        }
+        case 'T':
+        {
+            max_threads = atoi(optarg);
+            break;
+        }
+        case 'E':
+        {
+            loop_cpus = optarg;
+            break;
+        }
+        case 'W':
+        {
+            worker_cpus = optarg;
+            break;
+        }
+        case 'G':
+        {
+            log_cpus = optarg;
+            break;
+        }
+        case 'K':
+        {
+            bulkheads = optarg;
+            break;
+        }
+        case 'D':
+        {
+            queue_deadline = atoi(optarg);
+            break;
+        }
+        case 'e':
+        {
+            edf_backlog = atoi(optarg);
+            break;
+        }
+        case 'A':
+        {
+            shed_mode = atoi(optarg);
+            break;
+        }
+        case 'Q':
+        {
+            shed_wait = atoi(optarg);
+            break;
+        }
+        case 'H':
+        {
+            timeouts = optarg;
+            break;
+        }
+        case 'L':
+        {
+            log_split = atoi(optarg);
+            break;
+        }
+        case 'B':
+        {
+            log_binary = atoi(optarg);
+            break;
+        }
+        case 'R':
+        {
+            access_log = atoi(optarg);
+            break;
+        }
+        case 'M':
+        {
+            log_mem = atoi(optarg);
+            break;
+        }
+        case 'O':
+        {
+            log_overflow = atoi(optarg);
+            break;
+        }
+        case 'P':
+        {
+            log_overflow_arg = atoi(optarg);
+            break;
+        }
         default:
             break;
         }
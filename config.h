@@ -34,9 +34,78 @@ public:
     //数据库连接池数量
     int sql_num;
 
+    //用户表分片的mysqld实例列表，格式 host:port[,host:port...]
+    string sql_shards;
+
+    //用户凭据缓存模式：0全量加载，1布隆过滤器+LRU懒加载
+    int user_cache_mode;
+
+    //懒加载模式下LRU缓存的凭据条数
+    int user_cache_size;
+
+    //全量模式下凭据快照文件路径，为空则不使用快照
+    string user_snapshot;
+
+    //用户存储后端：0 MySQL，1 内置的追加日志存储引擎
+    int user_store_backend;
+
+    //内置存储引擎的日志文件路径
+    string user_store_path;
+
     //线程池内的线程数量
     int thread_num;
 
+    //线程池自适应扩缩容的线程数上限，不大于thread_num时线程数固定
+    int max_threads;
+
+    //线程池任务分派：0共享队列，1工作窃取+轮流分派，2工作窃取+按连接哈希分派，3按连接亲和分派
+    int sched_mode;
+
+    //舱壁隔离：静态、数据库、管理三个工作类别各自的线程数[/队列上限]，如"6,4/2000,1/100"；为空则共用一个线程池
+    string bulkheads;
+
+    //请求排队的最长时间(毫秒)，工作线程取到时已超过则丢弃并关闭连接；0表示只以连接定时器到期为限
+    int queue_deadline;
+
+    //共享队列积压达到该值时按截止时间最早优先取任务，0表示始终先进先出
+    int edf_backlog;
+
+    //准入控制：0只在队列已满或描述符耗尽时回复503，1积压或排队超过阈值时回复503，2另外在全部过载时暂停accept
+    int shed_mode;
+
+    //准入控制的排队时间阈值(毫秒)，0表示只看积压
+    int shed_wait;
+
+    //各阶段的超时(毫秒)："请求行和头部,请求体,keep-alive空闲,发送停滞"
+    string timeouts;
+
+    //日志文件：0所有线程按时间顺序合并到一个文件，1每个线程写各自的文件
+    int log_split;
+
+    //日志格式：0文本，1二进制(调用处只拷贝参数，用Log/logDecode还原)
+    int log_binary;
+
+    //访问日志：0关闭，1 Common格式，2 Combined格式，3 JSON，写到ServerLog/access.yyyymmdd.pid.log
+    int access_log;
+
+    //日志缓冲区的内存预算(MB)：缓冲区从小开始，写得多时变大，空闲时收缩，所有线程加起来不超过预算
+    int log_mem;
+
+    //日志缓冲区用尽时：0丢弃新的日志，1等待后台线程，2只保留ERROR及以上，3采样
+    int log_overflow;
+
+    //log_overflow为1时最多等待的毫秒数，为3时每N条写1条；0取默认值(10ms，100条)
+    int log_overflow_arg;
+
+    //事件循环线程绑定的CPU列表，格式同taskset -c，如"0"
+    string loop_cpus;
+
+    //工作线程绑定的CPU列表，第i个线程绑定列表中第i个CPU(循环使用)，如"2-7"
+    string worker_cpus;
+
+    //后台写日志线程绑定的CPU列表，如"1"
+    string log_cpus;
+
     //是否关闭日志
     int close_log;
 
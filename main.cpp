@@ -18,16 +18,21 @@ int main(int argc, char *argv[])
     //初始化
     server.init(config.PORT, user, passwd, databasename, config.LOGWrite, 
                 config.OPT_LINGER, config.TRIGMode,  config.sql_num,  config.thread_num, 
-                config.close_log, config.actor_model);
+                config.close_log, config.actor_model, config.sql_shards, config.sched_mode,
+                config.max_threads, config.loop_cpus, config.worker_cpus, config.log_cpus,
+                config.bulkheads, config.queue_deadline, config.edf_backlog,
+                config.shed_mode, config.shed_wait, config.timeouts, config.log_split,
+                config.log_binary, config.access_log, config.log_mem,
+                config.log_overflow, config.log_overflow_arg);
 
-    //日志
-    server.log_write();
+    //用户凭据缓存
+    user_cache::GetInstance()->init(config.user_cache_mode, config.user_cache_size, config.user_snapshot, config.close_log);
 
-    //数据库
-    server.sql_pool();
+    //用户存储后端
+    user_store::create(config.user_store_backend, config.user_store_path, config.close_log);
 
-    //线程池
-    server.thread_pool();
+    //日志、数据库、线程池及预热
+    server.startup();
 
     //触发模式
     server.trig_mode();
@@ -35,6 +40,9 @@ int main(int argc, char *argv[])
     //监听
     server.eventListen();
 
+    //绑核与内存放置
+    server.placement();
+
     //运行
     server.eventLoop();
 